@@ -0,0 +1,382 @@
+#include "Generators.h"
+
+#include "tblgen/Backend/TableGenBackends.h"
+#include "tblgen/Basic/FileManager.h"
+#include "tblgen/Basic/IdentifierInfo.h"
+#include "tblgen/Lex/Lexer.h"
+#include "tblgen/Lex/TokenBuffer.h"
+#include "tblgen/Message/DiagnosticsEngine.h"
+#include "tblgen/Parser.h"
+#include "tblgen/Record.h"
+#include "tblgen/Support/Allocator.h"
+#include "tblgen/Support/Timer.h"
+#include "tblgen/TableGen.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace tblgen;
+using namespace tblgen::diag;
+using namespace tblgen::support;
+
+using std::string;
+
+namespace {
+
+struct Options {
+   /// The workloads to run. If empty, run all of them.
+   std::vector<string> workloads;
+
+   /// The factor to multiply the size of the workloads by.
+   double scale = 1.0;
+
+   /// The number of times every workload is run.
+   unsigned repeat = 5;
+
+   /// If true, print the results as CSV.
+   bool csv = false;
+
+   /// If true, records are finalized when they are first accessed.
+   bool lazyFinalize = false;
+
+   /// If not empty, only write the generated files to this directory.
+   string dumpDir;
+};
+
+/// The stages that are timed separately.
+enum Stage {
+   S_Lexer,
+   S_Parser,
+   S_FinalizeRecord,
+   S_TemplateParser,
+   S_PrintRecords,
+   S_NumStages,
+};
+
+const char *StageNames[S_NumStages] = {
+   "Lexer", "Parser", "finalizeRecord", "TemplateParser", "PrintRecords",
+};
+
+/// The measured times of every stage in milliseconds, one per repetition.
+using Samples = std::array<std::vector<double>, S_NumStages>;
+
+void printHelpDialog(std::ostream &OS)
+{
+   OS << "Usage: tblgen-bench [options]\n"
+      << "Runs TblGen on synthetic workloads and times the lexer, the\n"
+      << "parser, finalizeRecord, the template parser and PrintRecords.\n"
+      << "Options:\n"
+      << "  -w <workload>   only run <workload>, can be given several times\n"
+      << "  -scale <f>      multiply the size of every workload by <f>\n"
+      << "  -repeat <N>     run every workload <N> times (default 5)\n"
+      << "  -csv            print the results as CSV\n"
+      << "  -lazy-finalize  finalize records when they are first accessed\n"
+      << "  -dump <dir>     write the generated files to <dir> and exit\n"
+      << "  -list           list the workloads and exit\n";
+}
+
+class BenchDiagConsumer : public DiagnosticConsumer {
+public:
+   void HandleDiagnostic(const Diagnostic &Diag) override
+   {
+      std::cerr << Diag.getMsg();
+   }
+};
+
+double elapsedMs(std::chrono::steady_clock::time_point Start)
+{
+   auto End = std::chrono::steady_clock::now();
+   return std::chrono::duration<double, std::milli>(End - Start).count();
+}
+
+bool writeFile(const std::filesystem::path &Path, const string &Contents)
+{
+   std::ofstream OS(Path, std::ios::binary);
+   OS << Contents;
+
+   return OS.good();
+}
+
+/// Run all stages on \p TGFile and \p TemplateFile once, and add their
+/// times to \p Result.
+bool runOnce(const string &TGFile, const string &TemplateFile,
+             const Options &opts, Samples &Result)
+{
+   using Clock = std::chrono::steady_clock;
+
+   BenchDiagConsumer Consumer;
+   fs::FileManager FileMgr;
+   ArenaAllocator Allocator;
+   DiagnosticsEngine Diags(Allocator, &Consumer, &FileMgr);
+
+   auto MaybeBuf = FileMgr.openFile(TGFile);
+   if (!MaybeBuf) {
+      Diags.Diag(err_generic_error) << "file not found: " + TGFile;
+      return false;
+   }
+
+   auto &Buf = MaybeBuf.getValue();
+
+   // Lex into a separate identifier table, so that the parser doesn't find
+   // the identifiers already interned.
+   {
+      auto Start = Clock::now();
+
+      ArenaAllocator LexAllocator;
+      IdentifierTable Idents(LexAllocator);
+      Idents.addTblGenKeywords();
+
+      lex::Lexer Lex(Idents, Diags, Buf.Buf, Buf.SourceId, Buf.BaseOffset,
+                     '\0');
+
+      lex::TokenBuffer Toks(Buf.Buf, Buf.BaseOffset);
+      Lex.lexAll(Toks);
+
+      Result[S_Lexer].push_back(elapsedMs(Start));
+   }
+
+   TableGen TG(Allocator, FileMgr, Diags);
+   TG.setLazyFinalization(opts.lazyFinalize);
+
+   // Records are finalized while they are parsed, unless that is done
+   // lazily. Only that phase is measured by the report, which keeps the
+   // overhead for the rest of the parser low.
+   {
+      TimeReport Report;
+      Report.setPhaseFilter("Finalize record");
+
+      auto Start = Clock::now();
+
+      Parser P(TG, Buf.Buf, Buf.SourceId, Buf.BaseOffset);
+      if (!P.parse()) {
+         return false;
+      }
+
+      double ParseMs = elapsedMs(Start);
+      double FinalizeMs
+         = Report.getPhaseStats("Finalize record").WallNs / 1e6;
+
+      Result[S_Parser].push_back(ParseMs - FinalizeMs);
+      Result[S_FinalizeRecord].push_back(FinalizeMs);
+   }
+
+   TG.freeze();
+
+   {
+      auto Start = Clock::now();
+
+      auto MaybeTemplateBuf = FileMgr.openFile(TemplateFile);
+      if (!MaybeTemplateBuf) {
+         Diags.Diag(err_generic_error) << "file not found: " + TemplateFile;
+         return false;
+      }
+
+      auto &TemplateBuf = MaybeTemplateBuf.getValue();
+      TemplateParser Template(TG, TemplateBuf.Buf, TemplateBuf.SourceId,
+                              TemplateBuf.BaseOffset);
+
+      if (!Template.compileTemplate()) {
+         return false;
+      }
+
+      std::ostringstream OS;
+      if (!Template.emitTemplate(OS)) {
+         return false;
+      }
+
+      Result[S_TemplateParser].push_back(elapsedMs(Start));
+   }
+
+   {
+      auto Start = Clock::now();
+
+      std::ostringstream OS;
+      PrintRecords(OS, *TG.GlobalRK);
+
+      Result[S_PrintRecords].push_back(elapsedMs(Start));
+   }
+
+   return true;
+}
+
+void printResults(const bench::Workload &W, Samples &Result,
+                  const Options &opts)
+{
+   for (unsigned i = 0; i < S_NumStages; ++i) {
+      auto &Times = Result[i];
+      std::sort(Times.begin(), Times.end());
+
+      double Min = Times.front();
+      double Median = Times[Times.size() / 2];
+      double Max = Times.back();
+
+      char Buf[128];
+      if (opts.csv) {
+         snprintf(Buf, sizeof(Buf), "%s,%s,%.3f,%.3f,%.3f\n",
+                  W.Name.c_str(), StageNames[i], Min, Median, Max);
+      }
+      else {
+         snprintf(Buf, sizeof(Buf), "  %-16s %12.3f %12.3f %12.3f\n",
+                  StageNames[i], Min, Median, Max);
+      }
+
+      std::cout << Buf;
+   }
+}
+
+} // anonymous namespace
+
+int main(int argc, char **argv)
+{
+   BenchDiagConsumer Consumer;
+   ArenaAllocator Allocator;
+   DiagnosticsEngine Diags(Allocator, &Consumer);
+
+   Options opts;
+   bool listOnly = false;
+
+   for (int i = 1; i < argc; ++i) {
+      string arg(argv[i]);
+      bool hasValue = i + 1 < argc;
+
+      if (arg == "-w" && hasValue) {
+         opts.workloads.emplace_back(argv[++i]);
+      }
+      else if (arg == "-scale" && hasValue) {
+         opts.scale = std::strtod(argv[++i], nullptr);
+      }
+      else if (arg == "-repeat" && hasValue) {
+         opts.repeat = (unsigned)std::strtoul(argv[++i], nullptr, 10);
+      }
+      else if (arg == "-dump" && hasValue) {
+         opts.dumpDir = argv[++i];
+      }
+      else if (arg == "-csv") {
+         opts.csv = true;
+      }
+      else if (arg == "-lazy-finalize") {
+         opts.lazyFinalize = true;
+      }
+      else if (arg == "-list") {
+         listOnly = true;
+      }
+      else if (arg == "--help") {
+         printHelpDialog(std::cout);
+         return 0;
+      }
+      else {
+         Diags.Diag(err_generic_error) << "unknown option '" + arg + "'";
+         printHelpDialog(std::cerr);
+         return 1;
+      }
+   }
+
+   if (opts.scale <= 0 || opts.repeat == 0) {
+      Diags.Diag(err_generic_error)
+         << "scale and repetitions must be positive";
+
+      return 1;
+   }
+
+   auto All = bench::generateAll(opts.scale);
+   std::vector<bench::Workload*> Workloads;
+
+   for (auto &W : All) {
+      if (opts.workloads.empty()
+          || std::find(opts.workloads.begin(), opts.workloads.end(), W.Name)
+               != opts.workloads.end()) {
+         Workloads.push_back(&W);
+      }
+   }
+
+   for (auto &Name : opts.workloads) {
+      if (std::none_of(All.begin(), All.end(), [&](const bench::Workload &W) {
+         return W.Name == Name;
+      })) {
+         Diags.Diag(err_generic_error) << "unknown workload '" + Name + "'";
+         return 1;
+      }
+   }
+
+   if (listOnly) {
+      for (auto *W : Workloads) {
+         std::cout << W->Name << ": " << W->Description << "\n";
+      }
+
+      return 0;
+   }
+
+   namespace stdfs = std::filesystem;
+   std::error_code ec;
+
+   stdfs::path Dir;
+   if (!opts.dumpDir.empty()) {
+      Dir = opts.dumpDir;
+   }
+   else {
+      Dir = stdfs::temp_directory_path(ec)
+         / ("tblgen-bench-" + std::to_string(std::random_device()()));
+   }
+
+   stdfs::create_directories(Dir, ec);
+   Dir = stdfs::absolute(Dir, ec);
+
+   for (auto *W : Workloads) {
+      if (!writeFile(Dir / (W->Name + ".tg"), W->Definitions)
+          || !writeFile(Dir / (W->Name + ".template"), W->Template)) {
+         Diags.Diag(err_generic_error)
+            << "could not write to " + Dir.u8string();
+
+         return 1;
+      }
+   }
+
+   if (!opts.dumpDir.empty()) {
+      return 0;
+   }
+
+   if (opts.csv) {
+      std::cout << "workload,stage,min_ms,median_ms,max_ms\n";
+   }
+
+   int Result = 0;
+   for (auto *W : Workloads) {
+      if (!opts.csv) {
+         char Buf[128];
+         snprintf(Buf, sizeof(Buf), "  %-16s %12s %12s %12s\n",
+                  "Stage", "Min (ms)", "Median (ms)", "Max (ms)");
+
+         std::cout << W->Name << ": " << W->Description << " ("
+                   << W->Definitions.size() / 1024 << " KB)\n" << Buf;
+      }
+
+      Samples Times;
+      bool Success = true;
+
+      for (unsigned i = 0; i < opts.repeat && Success; ++i) {
+         Success = runOnce((Dir / (W->Name + ".tg")).u8string(),
+                           (Dir / (W->Name + ".template")).u8string(),
+                           opts, Times);
+      }
+
+      if (!Success) {
+         Diags.Diag(err_generic_error) << "workload " + W->Name + " failed";
+         Result = 1;
+         continue;
+      }
+
+      printResults(*W, Times, opts);
+   }
+
+   stdfs::remove_all(Dir, ec);
+   return Result;
+}
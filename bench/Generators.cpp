@@ -0,0 +1,303 @@
+#include "Generators.h"
+
+#include <algorithm>
+#include <cmath>
+
+using std::string;
+using std::to_string;
+
+namespace tblgen {
+namespace bench {
+
+namespace {
+
+/// Append a list literal of the strings \p Prefix0 to \p Prefix<N-1>.
+void appendNameList(string &S, const string &Prefix, unsigned N)
+{
+   S += "[";
+   for (unsigned i = 0; i < N; ++i) {
+      if (i != 0)
+         S += ", ";
+
+      S += "\"" + Prefix + to_string(i) + "\"";
+   }
+
+   S += "]";
+}
+
+/// The definitions start with a newline and the templates with a line of
+/// text, since the parsers don't skip anything before the first token.
+string definitionsHeader(const string &Name)
+{
+   return "\n// " + Name + " workload, generated by tblgen-bench\n\n";
+}
+
+string templateHeader(const string &Name)
+{
+   return Name + "\n";
+}
+
+unsigned scaled(unsigned N, double Scale)
+{
+   return std::max(1u, (unsigned)std::lround(N * Scale));
+}
+
+} // anonymous namespace
+
+Workload generateHierarchy(unsigned NumChains, unsigned Depth,
+                           unsigned RecordsPerChain)
+{
+   Workload W;
+   W.Name = "hierarchy";
+   W.Description = to_string(NumChains) + " class chains of depth "
+      + to_string(Depth) + ", " + to_string(RecordsPerChain)
+      + " records each";
+
+   string &S = W.Definitions;
+   S = definitionsHeader(W.Name);
+   S += "class Base {\n    let id: i64 = 0\n}\n\n";
+
+   for (unsigned i = 0; i < NumChains; ++i) {
+      for (unsigned d = 0; d < Depth; ++d) {
+         S += "class H" + to_string(i) + "_" + to_string(d) + " : ";
+         S += d == 0 ? string("Base")
+                     : "H" + to_string(i) + "_" + to_string(d - 1);
+
+         S += " {\n    let f" + to_string(d) + ": i64 = " + to_string(d)
+            + "\n}\n";
+      }
+
+      for (unsigned r = 0; r < RecordsPerChain; ++r) {
+         S += "def HR" + to_string(i) + "_" + to_string(r) + " : H"
+            + to_string(i) + "_" + to_string(Depth - 1) + " {\n    id = "
+            + to_string(i * RecordsPerChain + r) + "\n}\n";
+      }
+
+      S += "\n";
+   }
+
+   W.Template = templateHeader(W.Name);
+   W.Template += "<% for_each_record | \"Base\" as R %> "
+                 "<%% record_name | $(R) %%> <%% $(R).id %%> "
+                 "<%% $(R).f0 %%>\n<% end %>\n";
+
+   return W;
+}
+
+Workload generateRecords(unsigned NumRecords, unsigned NumFields)
+{
+   Workload W;
+   W.Name = "records";
+   W.Description = to_string(NumRecords) + " records with "
+      + to_string(NumFields) + " fields";
+
+   // Even fields are integers, odd ones strings.
+   auto fieldName = [](unsigned f) {
+      return (f % 2 == 0 ? "i" : "s") + to_string(f);
+   };
+
+   string &S = W.Definitions;
+   S = definitionsHeader(W.Name);
+   S += "class Rec {\n";
+   for (unsigned f = 0; f < NumFields; ++f) {
+      S += "    let " + fieldName(f)
+         + (f % 2 == 0 ? ": i64 = 0\n" : ": string = \"\"\n");
+   }
+
+   S += "}\n\n";
+
+   for (unsigned r = 0; r < NumRecords; ++r) {
+      S += "def R" + to_string(r) + " : Rec {\n";
+      for (unsigned f = 0; f < NumFields; ++f) {
+         S += "    " + fieldName(f) + " = ";
+         S += f % 2 == 0 ? to_string(r * NumFields + f)
+                         : "\"value " + to_string(r) + "\"";
+
+         S += "\n";
+      }
+
+      S += "}\n";
+   }
+
+   W.Template = templateHeader(W.Name);
+   W.Template += "<% for_each_record | \"Rec\" as R %> "
+                 "<%% record_name | $(R) %%>";
+
+   for (unsigned f = 0; f < NumFields; ++f) {
+      W.Template += " <%% $(R)." + fieldName(f) + " %%>";
+   }
+
+   W.Template += "\n<% end %>\n";
+   return W;
+}
+
+Workload generateEnums(unsigned NumEnums, unsigned NumCases,
+                       unsigned NumRecords)
+{
+   Workload W;
+   W.Name = "enums";
+   W.Description = to_string(NumEnums) + " enums with "
+      + to_string(NumCases) + " cases, " + to_string(NumRecords)
+      + " records";
+
+   string &S = W.Definitions;
+   S = definitionsHeader(W.Name);
+
+   for (unsigned e = 0; e < NumEnums; ++e) {
+      S += "enum E" + to_string(e) + " {";
+      for (unsigned c = 0; c < NumCases; ++c) {
+         S += (c == 0 ? " C" : ", C") + to_string(c);
+      }
+
+      S += " }\n";
+   }
+
+   S += "\nclass EnumRec {\n";
+   for (unsigned e = 0; e < NumEnums; ++e) {
+      S += "    let e" + to_string(e) + ": E" + to_string(e) + " = .C0\n";
+   }
+
+   S += "}\n\n";
+
+   for (unsigned r = 0; r < NumRecords; ++r) {
+      S += "def ER" + to_string(r) + " : EnumRec {\n";
+      for (unsigned e = 0; e < NumEnums; ++e) {
+         S += "    e" + to_string(e) + " = .C"
+            + to_string((r + e) % NumCases) + "\n";
+      }
+
+      S += "}\n";
+   }
+
+   W.Template = templateHeader(W.Name);
+   W.Template += "<% for_each_record | \"EnumRec\" as R %> "
+                 "<%% record_name | $(R) %%>";
+
+   for (unsigned e = 0; e < NumEnums; ++e) {
+      W.Template += " <%% case_name | $(R).e" + to_string(e)
+         + " %%> = <%% case_value | $(R).e" + to_string(e) + " %%>";
+   }
+
+   W.Template += "\n<% end %>\n";
+   return W;
+}
+
+Workload generateForEach(unsigned NumOuter, unsigned NumInner)
+{
+   Workload W;
+   W.Name = "foreach";
+   W.Description = to_string(NumOuter) + " x " + to_string(NumInner)
+      + " nested foreach elements";
+
+   string &S = W.Definitions;
+   S = definitionsHeader(W.Name);
+
+   S += "foreach c in ";
+   appendNameList(S, "FC", NumOuter);
+   S += " {\n    class $(c) {\n        foreach f in ";
+   appendNameList(S, "g", NumInner);
+   S += " {\n            let $(f): i64 = 1\n        }\n    }\n}\n\n";
+
+   S += "class FBase {\n    let v: string = \"\"\n}\n\n";
+   S += "foreach n in ";
+   appendNameList(S, "FR", NumOuter);
+   S += " {\n    def $(n) : FBase {\n"
+        "        v = !str_concat(\"v_\", $(n))\n    }\n}\n";
+
+   W.Template = templateHeader(W.Name);
+   W.Template += "<% for_each_record | \"FBase\" as R %> "
+                 "<%% record_name | $(R) %%> <%% $(R).v %%>\n<% end %>\n";
+
+   return W;
+}
+
+Workload generateAllOf(unsigned NumRecords, unsigned NumQueries)
+{
+   Workload W;
+   W.Name = "allof";
+   W.Description = to_string(NumRecords) + " records, "
+      + to_string(NumQueries) + " !allof queries";
+
+   string &S = W.Definitions;
+   S = definitionsHeader(W.Name);
+   S += "class Item {\n    let w: i64 = 0\n}\n"
+        "class Special : Item {\n    let s: i64 = 1\n}\n\n";
+
+   for (unsigned r = 0; r < NumRecords; ++r) {
+      S += "def It" + to_string(r) + (r % 4 == 0 ? " : Special" : " : Item")
+         + " {\n    w = " + to_string(r) + "\n}\n";
+   }
+
+   S += "\n";
+   for (unsigned q = 0; q < NumQueries; ++q) {
+      S += "let q" + to_string(q)
+         + (q % 2 == 0 ? " = !allof(\"Item\")\n" : " = !allof(\"Special\")\n");
+   }
+
+   W.Template = templateHeader(W.Name);
+   W.Template += "<% for_each | q0 as R %> <%% record_name | $(R) %%>\n"
+                 "<% end %>\n"
+                 "<% for_each | !allof(\"Special\") as R %> <%% $(R).w %%>\n"
+                 "<% end %>\n";
+
+   return W;
+}
+
+Workload generateTemplate(unsigned NumOuter, unsigned NumInner,
+                          unsigned MacroDepth)
+{
+   Workload W;
+   W.Name = "template";
+   W.Description = to_string(NumOuter) + " x " + to_string(NumInner)
+      + " nested for_each_record, macro depth " + to_string(MacroDepth);
+
+   string &S = W.Definitions;
+   S = definitionsHeader(W.Name);
+   S += "class Outer {\n    let items: list<string> = ";
+   appendNameList(S, "item", 8);
+   S += "\n    let n: i64 = 0\n}\n"
+        "class Inner {\n    let v: i64 = 0\n}\n\n";
+
+   for (unsigned o = 0; o < NumOuter; ++o) {
+      S += "def O" + to_string(o) + " : Outer {\n    n = " + to_string(o)
+         + "\n}\n";
+   }
+
+   for (unsigned i = 0; i < NumInner; ++i) {
+      S += "def I" + to_string(i) + " : Inner {\n    v = " + to_string(i)
+         + "\n}\n";
+   }
+
+   string &T = W.Template;
+   T = templateHeader(W.Name);
+   T += "<% define m0(x) %> [ <%% $(x) %%> ] <% end %>\n";
+
+   for (unsigned d = 1; d < MacroDepth; ++d) {
+      T += "<% define m" + to_string(d) + "(x) %> ( <% invoke m"
+         + to_string(d - 1) + "($(x)) %> ) <% end %>\n";
+   }
+
+   T += "<% for_each_record | \"Outer\" as O %> <%% record_name | $(O) %%> "
+        ":\n<% for_each_record | \"Inner\" as In %> <% invoke m"
+      + to_string(MacroDepth - 1) + "($(In).v) %> <% end %>\n"
+        "<% for_each | $(O).items as T, j %> <%% $(j) %%> = <%% $(T) %%> "
+        "<% end %>\n<% end %>\n";
+
+   return W;
+}
+
+std::vector<Workload> generateAll(double Scale)
+{
+   std::vector<Workload> Workloads;
+   Workloads.push_back(generateHierarchy(scaled(200, Scale), 8, 20));
+   Workloads.push_back(generateRecords(scaled(5000, Scale), 20));
+   Workloads.push_back(generateEnums(20, 500, scaled(2000, Scale)));
+   Workloads.push_back(generateForEach(scaled(300, Scale), 300));
+   Workloads.push_back(generateAllOf(scaled(5000, Scale), 200));
+   Workloads.push_back(generateTemplate(scaled(200, Scale), 200, 8));
+
+   return Workloads;
+}
+
+} // namespace bench
+} // namespace tblgen
@@ -0,0 +1,61 @@
+#ifndef TBLGEN_BENCH_GENERATORS_H
+#define TBLGEN_BENCH_GENERATORS_H
+
+#include <string>
+#include <vector>
+
+namespace tblgen {
+namespace bench {
+
+/// A synthetic input for the benchmark: a definition file and a template
+/// that is applied to it.
+struct Workload {
+   /// The name used to select the workload on the command line.
+   std::string Name;
+
+   /// A short description of what the workload stresses.
+   std::string Description;
+
+   /// The contents of the .tg file.
+   std::string Definitions;
+
+   /// The contents of the template file.
+   std::string Template;
+};
+
+/// \p NumChains class hierarchies of depth \p Depth, each adding a field,
+/// with \p RecordsPerChain records deriving from the most derived class.
+Workload generateHierarchy(unsigned NumChains, unsigned Depth,
+                           unsigned RecordsPerChain);
+
+/// \p NumRecords records of a class with \p NumFields fields, all of which
+/// are set by every record.
+Workload generateRecords(unsigned NumRecords, unsigned NumFields);
+
+/// \p NumEnums enums with \p NumCases cases each, and \p NumRecords records
+/// that have a field of every enum type.
+Workload generateEnums(unsigned NumEnums, unsigned NumCases,
+                       unsigned NumRecords);
+
+/// \p NumOuter classes defined by a foreach, each with \p NumInner fields
+/// defined by a nested foreach, and \p NumOuter records defined by a
+/// foreach over their names.
+Workload generateForEach(unsigned NumOuter, unsigned NumInner);
+
+/// \p NumRecords records of two classes, and \p NumQueries values that are
+/// initialized with !allof of one of them.
+Workload generateAllOf(unsigned NumRecords, unsigned NumQueries);
+
+/// A template that iterates over \p NumInner records for each of
+/// \p NumOuter records, and formats every value through a chain of
+/// \p MacroDepth nested macro invocations.
+Workload generateTemplate(unsigned NumOuter, unsigned NumInner,
+                          unsigned MacroDepth);
+
+/// \return all workloads, with their sizes multiplied by \p Scale.
+std::vector<Workload> generateAll(double Scale);
+
+} // namespace bench
+} // namespace tblgen
+
+#endif // TBLGEN_BENCH_GENERATORS_H
@@ -10,6 +10,7 @@ class RecordKeeper;
 
 void PrintRecords(std::ostream &str, RecordKeeper const& RK);
 void EmitClassHierarchy(std::ostream &str, RecordKeeper const& RK);
+void EmitBinary(std::ostream &str, RecordKeeper const& RK);
 
 } // namespace tblgen
 
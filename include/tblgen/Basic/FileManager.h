@@ -3,9 +3,10 @@
 #define TBLGEN_FILEMANAGER_H
 
 #include "tblgen/Lex/SourceLocation.h"
+#include "tblgen/Support/MemoryBuffer.h"
 #include "tblgen/Support/Optional.h"
 
-#include <fstream>
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -24,14 +25,15 @@ using SourceOffset = unsigned;
 extern SourceID InvalidID;
 
 struct OpenFile {
-   OpenFile(const std::string &Buf,
+   OpenFile(std::string_view Buf,
             std::string_view FileName = "",
             SourceID SourceId = 0,
             unsigned int BaseOffset = 0)
       : Buf(Buf), FileName(FileName), SourceId(SourceId), BaseOffset(BaseOffset)
    { }
 
-   const std::string &Buf;
+   /// The contents of the file, always followed by a NUL character.
+   std::string_view Buf;
    std::string_view FileName;
    SourceID SourceId;
    SourceOffset BaseOffset;
@@ -48,8 +50,8 @@ public:
    OpenFile getOpenedFile(SourceLocation loc)
    { return getOpenedFile(getSourceId(loc)); }
 
-   const std::string &getBuffer(SourceID sourceId);
-   const std::string &getBuffer(SourceLocation loc)
+   std::string_view getBuffer(SourceID sourceId);
+   std::string_view getBuffer(SourceLocation loc)
    { return getBuffer(getSourceId(loc)); }
 
    SourceOffset getBaseOffset(SourceID sourceId)
@@ -73,49 +75,64 @@ public:
    std::string_view getFileName(SourceID sourceId);
 
    LineColPair getLineAndCol(SourceLocation loc);
-   LineColPair getLineAndCol(SourceLocation loc, const std::string &Buf);
+   LineColPair getLineAndCol(SourceLocation loc, std::string_view Buf);
    const std::vector<SourceOffset> &getLineOffsets(SourceID sourceID);
 
    struct CachedFile {
       CachedFile(std::string &&FN,
                  SourceID SourceId,
                  SourceOffset BaseOffset,
-                 std::string &&Buf)
+                 support::MemoryBuffer &&Buf)
          : FileName(move(FN)), SourceId(SourceId), BaseOffset(BaseOffset),
-           Buf(move(Buf)), IsMacroExpansion(false), IsMixin(false)
+           Buf(std::move(Buf)), IsMacroExpansion(false), IsMixin(false)
       { }
 
       std::string FileName;
       SourceID SourceId;
       SourceOffset BaseOffset;
-      std::string Buf;
+      support::MemoryBuffer Buf;
 
       bool IsMacroExpansion : 1;
       bool IsMixin          : 1;
    };
 
-   const std::unordered_map<std::string, CachedFile> &getSourceFiles() const
+   const std::unordered_map<std::string, std::unique_ptr<CachedFile>> &
+   getSourceFiles() const
    { return MemBufferCache; }
 
+   /// Make the next openFile() of \p fileName read the file again. The old
+   /// buffer and its source ID stay valid, since source locations might
+   /// still refer to them, but it is not returned by getSourceFiles()
+   /// anymore.
+   void closeFile(const std::string &fileName);
+
    void dumpSourceLine(SourceLocation Loc);
    void dumpSourceRange(SourceRange Loc);
 
+   /// If true (the default), large files are memory mapped instead of being
+   /// read into memory. Disable this if files might be truncated while this
+   /// FileManager is still alive.
+   bool usesMemoryMapping() const { return UseMemoryMapping; }
+   void setUseMemoryMapping(bool V) { UseMemoryMapping = V; }
+
 private:
+   bool UseMemoryMapping = true;
    std::vector<SourceOffset> sourceIdOffsets;
-   std::unordered_map<std::string, CachedFile> MemBufferCache;
-   std::unordered_map<SourceID, std::unordered_map<std::string, CachedFile>::iterator> IdFileMap;
+   std::unordered_map<std::string, std::unique_ptr<CachedFile>> MemBufferCache;
+   std::unordered_map<SourceID, CachedFile*> IdFileMap;
+
+   /// Files that were closed by closeFile().
+   std::vector<std::unique_ptr<CachedFile>> ClosedFiles;
 
    std::unordered_map<SourceID, SourceLocation> aliases;
    std::unordered_map<SourceID, std::vector<SourceOffset>> LineOffsets;
 
    const std::vector<SourceOffset> &collectLineOffsetsForFile(
-      SourceID sourceId, const std::string &Buf);
+      SourceID sourceId, std::string_view Buf);
 
    std::unordered_map<SourceID, SourceLocation> Imports;
 };
 
-using SourceFileRef = std::unordered_map<std::string, FileManager::CachedFile>::iterator;
-
 } // namespace fs
 } // namespace tblgen
 
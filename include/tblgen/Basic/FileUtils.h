@@ -3,6 +3,7 @@
 #define TBLGEN_FILEUTILS_H
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <system_error>
 
@@ -26,6 +27,17 @@ bool fileExists(const std::string &name);
 std::string findFileInDirectories(std::string_view fileName,
                                   const std::vector<std::string> &directories);
 
+/// Write \p contents to the file \p name by writing a temporary file in the
+/// same directory and renaming it, so that readers never see a partially
+/// written file.
+bool writeFileAtomically(const std::string &name, std::string_view contents,
+                         std::string *errMsg = nullptr);
+
+/// Copy the file \p from to \p to via a temporary file in the destination
+/// directory, like writeFileAtomically().
+bool copyFileAtomically(const std::string &from, const std::string &to,
+                        std::string *errMsg = nullptr);
+
 
 } // namespace fs
 } // namespace tblgen
@@ -6,6 +6,7 @@
 #include "tblgen/Support/Allocator.h"
 
 #include <cstring>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 
@@ -90,10 +91,17 @@ public:
 
    void addTblGenKeywords();
 
+   /// Synchronize get() with \p M, which has to protect the allocator as
+   /// well. Pass null to stop synchronizing.
+   void setMutex(std::mutex *M) { Mtx = M; }
+
 private:
    support::ArenaAllocator &Allocator;
    MapTy IdentMap;
 
+   /// The mutex set by setMutex(), if any.
+   std::mutex *Mtx = nullptr;
+
    void addKeyword(lex::tok::TokenType kind, std::string_view kw);
 };
 
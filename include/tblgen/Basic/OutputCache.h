@@ -0,0 +1,59 @@
+#ifndef TBLGEN_OUTPUTCACHE_H
+#define TBLGEN_OUTPUTCACHE_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace tblgen {
+namespace fs {
+
+class FileManager;
+
+/// An on-disk cache for the output of a TblGen invocation. Every entry is
+/// identified by a key that covers the options of the invocation, and
+/// records the content hash of every file that was read to produce the
+/// output. An entry is only reused if all of these files are unchanged.
+///
+/// For a key K, the cache directory contains the files K.manifest and K.out.
+class OutputCache {
+public:
+   /// \p Key must cover everything that influences the output apart from
+   /// the contents of the input files.
+   OutputCache(std::string CacheDir, uint64_t Key);
+
+   /// Look up the output of a previous invocation with the same key.
+   /// \p OutputFile is set to the file holding the cached output.
+   /// \return true if the entry exists and none of its inputs changed.
+   bool lookup(std::string &OutputFile) const;
+
+   /// Add a file that influences the output but is not opened through the
+   /// FileManager, e.g. a backend library.
+   void addInput(std::string FileName);
+
+   /// Store a copy of the file \p OutputFile, whose contents hash to
+   /// \p OutputHash, together with the hashes of all files opened by
+   /// \p FileMgr and the inputs added via addInput().
+   /// \return false if the entry could not be written.
+   bool store(const FileManager &FileMgr, const std::string &OutputFile,
+              uint64_t OutputHash, std::string *errMsg = nullptr) const;
+
+private:
+   /// The directory to store entries in.
+   std::string CacheDir;
+
+   /// The hexadecimal representation of the key.
+   std::string KeyStr;
+
+   /// Inputs that were added via addInput().
+   std::vector<std::string> ExtraInputs;
+
+   std::string getManifestFile() const;
+   std::string getOutputFile() const;
+};
+
+} // namespace fs
+} // namespace tblgen
+
+#endif // TBLGEN_OUTPUTCACHE_H
@@ -0,0 +1,107 @@
+#ifndef TBLGEN_OUTPUTFILE_H
+#define TBLGEN_OUTPUTFILE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace tblgen {
+namespace fs {
+
+/// An output stream that writes the generated output to a file without
+/// keeping it in memory.
+///
+/// The output is written through a large buffer to a temporary file in the
+/// destination's directory, which only replaces the destination once
+/// commit() is called. If TblGen fails or crashes before that, the
+/// destination is left untouched. A destination that already has exactly the
+/// generated contents is not modified either, so its modification time is
+/// kept intact.
+///
+/// Output for stdout is spooled to a temporary file as well, and copied to
+/// stdout on commit().
+class OutputFile: public std::ostream {
+public:
+   /// The size of the write buffer.
+   static constexpr size_t BufferSize = 1 << 20;
+
+   OutputFile();
+
+   /// Removes the temporary file, unless it was moved into place.
+   ~OutputFile() override;
+
+   OutputFile(const OutputFile&) = delete;
+   OutputFile &operator=(const OutputFile&) = delete;
+
+   /// Open a temporary file for the output file \p name. If \p name is
+   /// empty, the output is written to stdout.
+   bool open(const std::string &name, std::string *errMsg = nullptr);
+
+   /// Finish writing and move the output to its destination.
+   /// \p changed is set to false if the destination already had exactly
+   /// these contents.
+   bool commit(std::string *errMsg = nullptr, bool *changed = nullptr);
+
+   /// \return the name of a file that holds the complete output, only valid
+   /// after a successful call to commit().
+   const std::string &getCommittedFile() const
+   {
+      return toStdout ? tmpName : name;
+   }
+
+   /// \return the FNV-1a hash of everything that was written.
+   uint64_t getHash() const { return buf.hash; }
+
+private:
+   class OutputBuffer: public std::streambuf {
+   public:
+      OutputBuffer();
+
+      /// Write the buffered output to the temporary file.
+      bool flushBuffer();
+
+      /// The temporary file that is written to.
+      std::FILE *file = nullptr;
+
+      /// The previous contents of the destination, if it existed and all
+      /// output so far matched it.
+      std::FILE *existing = nullptr;
+
+      /// The hash of the output that was flushed so far.
+      uint64_t hash;
+
+      /// Set if a write to the temporary file failed.
+      int error = 0;
+
+   protected:
+      int_type overflow(int_type c) override;
+      int sync() override;
+
+   private:
+      std::vector<char> buffer;
+      std::vector<char> compareBuffer;
+   };
+
+   OutputBuffer buf;
+
+   /// The name of the destination file, empty for stdout.
+   std::string name;
+
+   /// The name of the temporary file.
+   std::string tmpName;
+
+   /// Whether the output goes to stdout.
+   bool toStdout = false;
+
+   /// Whether the temporary file was moved into place.
+   bool committed = false;
+
+   void closeFiles();
+};
+
+} // namespace fs
+} // namespace tblgen
+
+#endif // TBLGEN_OUTPUTFILE_H
@@ -0,0 +1,221 @@
+#ifndef TBLGEN_CHARINFO_H
+#define TBLGEN_CHARINFO_H
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__AVX2__)
+#   include <immintrin.h>
+#   define TBLGEN_LEXER_VECTOR_SIZE 32
+#elif defined(__SSE2__) || defined(_M_X64) \
+   || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#   include <emmintrin.h>
+#   define TBLGEN_LEXER_VECTOR_SIZE 16
+#endif
+
+#ifdef _MSC_VER
+#   include <intrin.h>
+#endif
+
+namespace tblgen {
+namespace lex {
+
+/// Character classes used by the lexer, see CharInfoTable.
+enum CharInfo : uint8_t {
+   /// A character that can appear inside of an identifier.
+   CHAR_IDENT = 0x01,
+};
+
+/// The character class of every byte.
+extern const uint8_t CharInfoTable[256];
+
+/// \return true if \p c can appear inside of an identifier.
+inline bool isIdentifierChar(char c)
+{
+   return (CharInfoTable[(unsigned char)c] & CHAR_IDENT) != 0;
+}
+
+namespace detail {
+
+/// \return the index of the lowest set bit of \p Mask, which must not be
+/// zero.
+inline unsigned countTrailingZeros(uint32_t Mask)
+{
+#ifdef _MSC_VER
+   unsigned long Idx;
+   _BitScanForward(&Idx, Mask);
+   return (unsigned)Idx;
+#else
+   return (unsigned)__builtin_ctz(Mask);
+#endif
+}
+
+#if TBLGEN_LEXER_VECTOR_SIZE == 32
+
+using Vector = __m256i;
+
+inline Vector load(const char *Ptr)
+{
+   return _mm256_loadu_si256((const __m256i*)Ptr);
+}
+
+inline Vector splat(char c) { return _mm256_set1_epi8(c); }
+
+inline Vector eq(Vector A, Vector B) { return _mm256_cmpeq_epi8(A, B); }
+inline Vector gt(Vector A, Vector B) { return _mm256_cmpgt_epi8(A, B); }
+inline Vector lt(Vector A, Vector B) { return _mm256_cmpgt_epi8(B, A); }
+inline Vector bitOr(Vector A, Vector B) { return _mm256_or_si256(A, B); }
+inline Vector bitAnd(Vector A, Vector B) { return _mm256_and_si256(A, B); }
+
+inline uint32_t mask(Vector V)
+{
+   return (uint32_t)_mm256_movemask_epi8(V);
+}
+
+#elif TBLGEN_LEXER_VECTOR_SIZE == 16
+
+using Vector = __m128i;
+
+inline Vector load(const char *Ptr)
+{
+   return _mm_loadu_si128((const __m128i*)Ptr);
+}
+
+inline Vector splat(char c) { return _mm_set1_epi8(c); }
+
+inline Vector eq(Vector A, Vector B) { return _mm_cmpeq_epi8(A, B); }
+inline Vector gt(Vector A, Vector B) { return _mm_cmpgt_epi8(A, B); }
+inline Vector lt(Vector A, Vector B) { return _mm_cmplt_epi8(A, B); }
+inline Vector bitOr(Vector A, Vector B) { return _mm_or_si128(A, B); }
+inline Vector bitAnd(Vector A, Vector B) { return _mm_and_si128(A, B); }
+
+inline uint32_t mask(Vector V)
+{
+   return (uint32_t)_mm_movemask_epi8(V);
+}
+
+#endif
+
+/// Bit N of the result is set if byte N of the block at \p Ptr is one of
+/// \p C0 to \p C3.
+#ifdef TBLGEN_LEXER_VECTOR_SIZE
+inline uint32_t matchAny(const char *Ptr, char C0, char C1, char C2, char C3)
+{
+   Vector V = load(Ptr);
+   return mask(bitOr(bitOr(eq(V, splat(C0)), eq(V, splat(C1))),
+                     bitOr(eq(V, splat(C2)), eq(V, splat(C3)))));
+}
+#endif
+
+} // namespace detail
+
+/// \return a pointer to the first character in [\p Ptr, \p End) that is one
+/// of \p C0 to \p C3, or \p End if there is none. Unused characters can be
+/// repeated.
+inline const char *findFirstOf(const char *Ptr, const char *End,
+                               char C0, char C1, char C2, char C3)
+{
+#ifdef TBLGEN_LEXER_VECTOR_SIZE
+   constexpr ptrdiff_t Size = TBLGEN_LEXER_VECTOR_SIZE;
+   while (End - Ptr >= Size) {
+      uint32_t Mask = detail::matchAny(Ptr, C0, C1, C2, C3);
+      if (Mask) {
+         return Ptr + detail::countTrailingZeros(Mask);
+      }
+
+      Ptr += Size;
+   }
+#endif
+
+   while (Ptr < End) {
+      char c = *Ptr;
+      if (c == C0 || c == C1 || c == C2 || c == C3) {
+         return Ptr;
+      }
+
+      ++Ptr;
+   }
+
+   return End;
+}
+
+/// \return a pointer to the first character in [\p Ptr, \p End) that is not
+/// a space, or \p End if there is none.
+inline const char *skipSpaces(const char *Ptr, const char *End)
+{
+#ifdef TBLGEN_LEXER_VECTOR_SIZE
+   constexpr ptrdiff_t Size = TBLGEN_LEXER_VECTOR_SIZE;
+   while (End - Ptr >= Size) {
+      uint32_t Mask = ~detail::mask(detail::eq(detail::load(Ptr),
+                                               detail::splat(' ')));
+
+      if (Size == 16)
+         Mask &= 0xFFFF;
+
+      if (Mask) {
+         return Ptr + detail::countTrailingZeros(Mask);
+      }
+
+      Ptr += Size;
+   }
+#endif
+
+   while (Ptr < End && *Ptr == ' ') {
+      ++Ptr;
+   }
+
+   return Ptr;
+}
+
+/// \return a pointer to the first character in [\p Ptr, \p End) that can not
+/// appear in an identifier, or \p End if there is none.
+inline const char *skipIdentifierChars(const char *Ptr, const char *End)
+{
+#ifdef TBLGEN_LEXER_VECTOR_SIZE
+   using namespace detail;
+
+   constexpr ptrdiff_t Size = TBLGEN_LEXER_VECTOR_SIZE;
+   while (End - Ptr >= Size) {
+      Vector V = load(Ptr);
+
+      // Setting bit 5 maps upper case letters to lower case ones, and no
+      // other character into the range of lower case letters. All of the
+      // ranges only contain ASCII characters, which are positive when
+      // compared as signed bytes.
+      Vector Lower = bitOr(V, splat(0x20));
+      Vector IsAlpha = bitAnd(gt(Lower, splat('a' - 1)),
+                              lt(Lower, splat('z' + 1)));
+      Vector IsDigit = bitAnd(gt(V, splat('0' - 1)), lt(V, splat('9' + 1)));
+      Vector IsSimple = bitOr(bitOr(IsAlpha, IsDigit), eq(V, splat('_')));
+
+      uint32_t Mask = ~mask(IsSimple);
+      if (Size == 16)
+         Mask &= 0xFFFF;
+
+      if (!Mask) {
+         Ptr += Size;
+         continue;
+      }
+
+      Ptr += countTrailingZeros(Mask);
+
+      // Other characters are rare in identifiers, look them up one by one.
+      if (!isIdentifierChar(*Ptr)) {
+         return Ptr;
+      }
+
+      ++Ptr;
+   }
+#endif
+
+   while (Ptr < End && isIdentifierChar(*Ptr)) {
+      ++Ptr;
+   }
+
+   return Ptr;
+}
+
+} // namespace lex
+} // namespace tblgen
+
+#endif // TBLGEN_CHARINFO_H
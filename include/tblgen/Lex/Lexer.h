@@ -4,8 +4,10 @@
 
 #include "tblgen/Message/Diagnostics.h"
 #include "tblgen/Lex/Token.h"
+#include "tblgen/Lex/TokenBuffer.h"
 
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace tblgen {
@@ -29,16 +31,18 @@ public:
 
    Lexer(IdentifierTable &Idents,
          DiagnosticsEngine &Diags,
-         const std::string &buf,
+         std::string_view buf,
          unsigned sourceId,
          unsigned offset = 1,
          const char InterpolationBegin = '$',
          bool primeLexer = true);
 
 
+   /// Create a lexer that returns the tokens in \p Tokens, followed by an
+   /// EOF token if the range doesn't end with one.
    Lexer(IdentifierTable &Idents,
          DiagnosticsEngine &Diags,
-         const std::vector<Token> &Tokens,
+         TokenRange Tokens,
          unsigned sourceId,
          unsigned offset = 1);
 
@@ -47,7 +51,11 @@ public:
 #endif
    ~Lexer() = default;
 
-   void reset(const std::vector<Token> &Tokens);
+   void reset(TokenRange Tokens);
+
+   /// Lex the rest of the buffer into \p Toks, including whitespace and the
+   /// final EOF token.
+   void lexAll(TokenBuffer &Toks);
 
    void lexDiagnostic();
    void lexStringInterpolation();
@@ -90,10 +98,45 @@ public:
 
    private:
       Lexer &L;
+
+      /// The tokens seen in this scope, or, for a lexer that returns a
+      /// TokenRange, the lookahead tokens that were pending when the scope
+      /// was entered.
       std::vector<Token> Tokens;
 
       Token LastTok;
       Token CurTok;
+
+      /// The position in the token range to rewind to.
+      unsigned TokIdx;
+
+      /// True if the lexer is rewound instead of replaying Tokens.
+      bool Rewind;
+   };
+
+   /// Makes a lexer return the tokens of a TokenRange, so that the same
+   /// tokens can be parsed several times. The previous state of the lexer is
+   /// restored at the end of the scope.
+   struct ReplayRAII {
+      ReplayRAII(Lexer &L, TokenRange Tokens);
+      ~ReplayRAII();
+
+      /// Start over at the first token of the range.
+      void restart();
+
+   private:
+      Lexer &L;
+      TokenRange Tokens;
+
+      Token LastTok;
+      Token CurTok;
+      unsigned LookaheadIdx;
+      std::vector<Token> LookaheadVec;
+      TokenRange TokRange;
+      unsigned TokIdx;
+      bool RangeEndsWithEOF;
+      bool IsTokenLexer;
+      bool AtEOF;
    };
 
    template<class ...Rest>
@@ -259,10 +302,21 @@ protected:
    /// True if this lexer is operating on a prelexed list of tokens.
    bool IsTokenLexer = false;
 
+   /// The prelexed tokens returned by a token lexer after the ones in
+   /// LookaheadVec.
+   TokenRange TokRange;
+
+   /// Index of the next token in TokRange.
+   unsigned TokIdx = 0;
+
+   /// True if TokRange is terminated by an EOF token.
+   bool RangeEndsWithEOF = true;
+
    /// True if we're currently parsing a string interpolation.
    bool InInterpolation = false;
 
    Token lexNextToken();
+   Token nextBufferedToken();
 };
 
 } // namespace lex
@@ -0,0 +1,66 @@
+#ifndef TBLGEN_PARALLELINCLUDELEXER_H
+#define TBLGEN_PARALLELINCLUDELEXER_H
+
+#include "tblgen/Basic/FileManager.h"
+#include "tblgen/Lex/Token.h"
+
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace tblgen {
+
+class IdentifierTable;
+class TableGen;
+
+namespace support {
+   class ArenaAllocator;
+} // namespace support
+
+namespace lex {
+
+/// Discovers the files that are transitively included by a definition file
+/// and lexes them on a thread pool before parsing starts. The resulting
+/// token streams are registered with the TableGen instance, where
+/// Parser::parseInclude picks them up instead of lexing the file itself.
+///
+/// Parsing itself stays serial, since name lookup and functions like !allof
+/// depend on the order in which declarations are seen.
+class ParallelIncludeLexer {
+public:
+   ParallelIncludeLexer(TableGen &TG, unsigned NumThreads = 0);
+   ~ParallelIncludeLexer();
+
+   /// Lex all files that are transitively included by \p Root.
+   void run(const fs::OpenFile &Root);
+
+private:
+   struct PrelexedFile;
+
+   /// The TableGen instance to register the tokens with.
+   TableGen &TG;
+
+   /// The number of worker threads to use.
+   unsigned NumThreads;
+
+   /// The files that were already discovered.
+   std::unordered_set<fs::SourceID> Seen;
+
+   /// Lex the complete file \p F using a private identifier table.
+   static void lexFile(PrelexedFile &F);
+
+   /// Find the include directives in \p F and open the files they refer to,
+   /// in the order they appear.
+   void collectIncludes(const PrelexedFile &F,
+                        std::vector<std::unique_ptr<PrelexedFile>> &Result);
+
+   /// Replace the identifiers of \p F with the ones in the global identifier
+   /// table.
+   void remapIdentifiers(PrelexedFile &F);
+};
+
+} // namespace lex
+} // namespace tblgen
+
+#endif // TBLGEN_PARALLELINCLUDELEXER_H
@@ -180,6 +180,12 @@ struct Token {
    }
 
 private:
+   friend class TokenBuffer;
+
+   Token(tok::TokenType kind, SourceLocation loc, unsigned Data, void *Ptr)
+      : kind(kind), loc(loc), Data(Data), Ptr(Ptr)
+   {}
+
    tok::TokenType kind;
    SourceLocation loc;
 
@@ -0,0 +1,147 @@
+#ifndef TBLGEN_TOKENBUFFER_H
+#define TBLGEN_TOKENBUFFER_H
+
+#include "tblgen/Lex/Token.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace tblgen {
+namespace lex {
+
+/// A compact, append-only sequence of tokens.
+///
+/// Tokens are stored as a structure of arrays: a kind, a source offset and
+/// the index of a payload per token, which takes 10 bytes instead of the 24
+/// of a lex::Token. The payload of a token is its identifier, or the length
+/// and position of its text. Text within the source buffer the TokenBuffer
+/// was created for is stored relative to the token's offset, so identical
+/// payloads are only stored once.
+///
+/// Parts of a TokenBuffer are referred to by a TokenRange, which is how
+/// the parser replays tokens without copying them.
+class TokenBuffer {
+public:
+   /// Create a buffer for tokens that were lexed from \p Src, which starts
+   /// at source offset \p BaseOffset.
+   explicit TokenBuffer(std::string_view Src = {}, unsigned BaseOffset = 0);
+
+   TokenBuffer(const TokenBuffer&) = delete;
+   TokenBuffer &operator=(const TokenBuffer&) = delete;
+
+   TokenBuffer(TokenBuffer&&) = default;
+   TokenBuffer &operator=(TokenBuffer&&) = default;
+
+   /// Append \p Tok.
+   void push_back(const Token &Tok);
+
+   /// \return the token at index \p Idx.
+   Token operator[](size_t Idx) const;
+
+   tok::TokenType getKind(size_t Idx) const { return Kinds[Idx]; }
+
+   size_t size() const { return Kinds.size(); }
+   bool empty() const { return Kinds.empty(); }
+
+   /// Replace the payload pointers that are not source text, i.e. the
+   /// identifiers, by the result of \p Fn.
+   template<class Fn>
+   void remapPointers(Fn &&F)
+   {
+      for (auto &P : Payloads) {
+         if (!P.Relative && P.Ptr) {
+            P.Ptr = F(P.Ptr);
+         }
+      }
+
+      // The deduplication keys are stale now.
+      PayloadMap.clear();
+   }
+
+   /// Drop the memory that is only needed for appending tokens. Tokens that
+   /// are appended afterwards don't share payloads with earlier ones.
+   void finish();
+
+   /// \return the number of bytes allocated by this buffer.
+   size_t getMemoryUsage() const;
+
+private:
+   struct Payload {
+      /// The IdentifierInfo or other object a token refers to, or, for
+      /// relative payloads, the distance of the text from the token's
+      /// offset.
+      const void *Ptr;
+
+      /// The length of the text or the number of spaces.
+      unsigned Data;
+
+      /// Whether Ptr is relative to the token's position in the source.
+      bool Relative;
+
+      bool operator==(const Payload &RHS) const
+      {
+         return Ptr == RHS.Ptr && Data == RHS.Data
+            && Relative == RHS.Relative;
+      }
+   };
+
+   struct PayloadHash {
+      size_t operator()(const Payload &P) const
+      {
+         return std::hash<const void*>()(P.Ptr)
+            ^ (std::hash<unsigned>()(P.Data) << 1)
+            ^ P.Relative;
+      }
+   };
+
+   /// The source text, used to resolve relative payloads.
+   std::string_view Src;
+
+   /// The source offset of the first character of Src.
+   unsigned BaseOffset;
+
+   std::vector<tok::TokenType> Kinds;
+   std::vector<unsigned> Offsets;
+   std::vector<unsigned> PayloadIndices;
+
+   /// The unique payloads. Index zero is the empty payload.
+   std::vector<Payload> Payloads;
+
+   /// Maps payloads to their index, only used while appending.
+   std::unordered_map<Payload, unsigned, PayloadHash> PayloadMap;
+};
+
+/// A range of tokens in a TokenBuffer.
+struct TokenRange {
+   TokenRange() = default;
+   TokenRange(const TokenBuffer &Buf, size_t Begin, size_t End)
+      : Buf(&Buf), Begin(unsigned(Begin)), End(unsigned(End))
+   {}
+
+   /// Create a range that spans all of \p Buf.
+   /*implicit*/ TokenRange(const TokenBuffer &Buf)
+      : Buf(&Buf), Begin(0), End(unsigned(Buf.size()))
+   {}
+
+   size_t size() const { return End - Begin; }
+   bool empty() const { return Begin == End; }
+
+   Token operator[](size_t Idx) const { return (*Buf)[Begin + Idx]; }
+
+   tok::TokenType getKind(size_t Idx) const
+   {
+      return Buf->getKind(Begin + Idx);
+   }
+
+   const TokenBuffer *Buf = nullptr;
+   unsigned Begin = 0;
+   unsigned End = 0;
+};
+
+} // namespace lex
+} // namespace tblgen
+
+#endif // TBLGEN_TOKENBUFFER_H
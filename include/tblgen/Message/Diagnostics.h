@@ -4,6 +4,7 @@
 
 #include "tblgen/Lex/SourceLocation.h"
 
+#include <mutex>
 #include <stack>
 #include <string>
 #include <unordered_map>
@@ -113,6 +114,10 @@ protected:
 
    DiagnosticsEngine &Engine;
 
+   /// Held until the diagnostic is emitted, so that threads sharing the
+   /// engine don't mix up their arguments.
+   std::unique_lock<std::recursive_mutex> Lock;
+
    mutable SourceRange loc;
    MessageKind msg;
 
@@ -4,6 +4,7 @@
 
 #include "tblgen/Message/Diagnostics.h"
 
+#include <mutex>
 #include <vector>
 
 namespace tblgen {
@@ -124,6 +125,9 @@ private:
    DiagnosticConsumer *Consumer;
    fs::FileManager *FileMgr = nullptr;
 
+   /// Locked by every DiagnosticBuilder while it is alive.
+   std::recursive_mutex Mtx;
+
    bool TooManyErrorsMsgEmitted : 1;
 };
 
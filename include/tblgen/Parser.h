@@ -5,16 +5,19 @@
 #include "tblgen/Basic/IdentifierInfo.h"
 #include "tblgen/Lex/Lexer.h"
 #include "tblgen/Message/DiagnosticsEngine.h"
+#include "tblgen/RecordIndex.h"
 #include "tblgen/TableGen.h"
 
 #include <array>
 #include <cstring>
+#include <memory>
 #include <sstream>
 
 namespace tblgen {
 
 class RecordKeeper;
 class Record;
+class RecordLayout;
 class Class;
 class Enum;
 class TableGen;
@@ -24,12 +27,12 @@ class Type;
 class Parser {
 public:
    Parser(TableGen &TG,
-          const std::string &Buf,
+          std::string_view Buf,
           unsigned sourceId,
           unsigned baseOffset);
 
    Parser(TableGen &TG,
-          const std::vector<lex::Token> &Toks,
+          lex::TokenRange Toks,
           unsigned sourceId,
           unsigned baseOffset);
 
@@ -43,7 +46,6 @@ protected:
    Class *currentClass = nullptr;
    RecordKeeper *RK;
 
-   lex::Lexer::LookaheadRAII *LR = nullptr;
    std::unordered_map<std::string, Value*> ForEachVals;
 
    [[noreturn]]
@@ -86,6 +88,26 @@ protected:
    Value *parseExpr(Type *contextualTy = nullptr);
    Value *parseFunction(Type *contextualTy = nullptr);
 
+   /// \return the type of the field \p fieldName of \p C, which a record
+   /// query compares, or null if \p C has no such field or its values
+   /// cannot be indexed.
+   Type *getQueryFieldType(Class *C, const std::string &fieldName);
+
+   /// \return the index of the field \p fieldName over the records of
+   /// \p C in the current namespace, see TableGen::getRecordIndex(). Reports
+   /// an error at \p loc if the field does not exist or cannot be indexed.
+   const RecordIndex &getRecordIndex(Class *C, const std::string &fieldName,
+                                     SourceLocation loc,
+                                     bool withOrder = false);
+
+   /// Append the positions of the records of \p C in the current namespace
+   /// whose field \p fieldName compares to \p Val with \p Pred to
+   /// \p Result, in declaration order, see RecordKeeper::getDefinitionsOf().
+   /// The query is answered by a cached RecordIndex.
+   void queryRecords(Class *C, const std::string &fieldName,
+                     RecordIndex::Predicate Pred, Value *Val,
+                     SourceLocation loc, std::vector<unsigned> &Result);
+
    void parseTemplateArgs(std::vector<Value*> &args,
                           std::vector<SourceLocation> &locs,
                           Class *forClass);
@@ -107,27 +129,35 @@ protected:
       RecordKeeper *RK;
    };
 
+   /// Binds the variable of a foreach. The value is replaced for every
+   /// element, and a shadowed binding of the same name is restored at the
+   /// end of the scope.
    struct ForEachScope {
-      ForEachScope(Parser &P, std::string_view name, Value *V)
-         : P(P), name(name)
+      ForEachScope(Parser &P, const std::string &name)
+         : P(P), name(name), Slot(&P.ForEachVals[name]), Prev(*Slot)
       {
-         P.ForEachVals.emplace(name, V);
       }
 
-      ForEachScope(Parser &P, const std::string &name, Value *V)
-         : P(P), name(name)
+      ~ForEachScope()
       {
-         P.ForEachVals.emplace(name, V);
+         if (Prev) {
+            *Slot = Prev;
+         }
+         else {
+            P.ForEachVals.erase(name);
+         }
       }
 
-      ~ForEachScope()
+      void setValue(Value *V)
       {
-         P.ForEachVals.erase(P.ForEachVals.find(name));
+         *Slot = V;
       }
 
    private:
       Parser &P;
       std::string name;
+      Value **Slot;
+      Value *Prev;
    };
 
    Value *getForEachVal(const std::string &name)
@@ -146,10 +176,6 @@ protected:
 
    void advance(bool ignoreNewline = true, bool ignoreWhitespace = true)
    {
-      if (LR) {
-         return LR->advance(ignoreNewline, !ignoreWhitespace);
-      }
-
       return lex.advance(ignoreNewline, !ignoreWhitespace);
    }
 
@@ -167,45 +193,182 @@ protected:
             << "unexpected token " + currentTok().toString()
             << lex.getSourceLoc();
 
-         exit(1);
+         abortBP();
       }
    }
 };
 
 class TemplateParser: public Parser {
-   struct Macro
-   {
+   struct TemplateOp;
+   using OpList = std::vector<TemplateOp>;
+
+   /// A field access in a \c $(X).a.b chain, together with the slot it was
+   /// last found at.
+   struct FieldRef {
+      explicit FieldRef(std::string_view name) : name(name)
+      {}
+
+      std::string_view name;
+      const RecordLayout *layout = nullptr;
+      unsigned slot = 0;
+   };
+
+   /// The header of a for_each command, once evaluated.
+   struct ForEachHeader {
+      std::vector<Value*> values;
+      std::string varName;
+      std::string indexName;
+      Value *separator = nullptr;
+      bool join = false;
+   };
+
+   /// A single operation of a compiled template.
+   ///
+   /// Templates are compiled once into a tree of operations, so executing a
+   /// loop body or a macro never has to look at its text again. Commands keep
+   /// the tokens between their '<%' and '%>', which are only re-parsed when
+   /// their expression can't be evaluated directly.
+   struct TemplateOp {
+      enum Kind : uint8_t {
+         Text, Expr, If, ForEach, Define, Invoke,
+      };
+
+      TemplateOp(Kind kind, bool paste, SourceLocation loc)
+         : kind(kind), paste(paste), loc(loc)
+      {}
+
+      Kind kind;
+      bool paste;
+      SourceLocation loc;
+
+      /// The output of a Text op, or the name of a defined or invoked
+      /// macro.
+      std::string text;
+
+      /// The tokens of the command, up to and including the closing '%>'.
+      lex::TokenRange tokens;
+
+      /// True if the command does not refer to any for_each or macro value,
+      /// so it always evaluates to the same result.
+      bool isConstant = false;
+
+      /// The command applied to the expression of an Expr op, if any.
+      const IdentifierInfo *command = nullptr;
+
+      /// For expressions of the form $(X).a.b, the name of X and the fields.
+      std::string varName;
+      mutable std::vector<FieldRef> fieldPath;
+
+      /// The cached result of a constant command.
+      mutable const Value *cachedValue = nullptr;
+      mutable bool cachedExplicitStr = false;
+      mutable std::unique_ptr<ForEachHeader> cachedHeader;
+
+      /// The body of an If, ForEach or Define op, and the else branch of an
+      /// If op.
+      OpList body;
+      OpList elseBody;
+
+      /// The parameters of a Define op.
       std::vector<std::string> params;
-      std::vector<lex::Token> tokens;
    };
 
 public:
    TemplateParser(TableGen &TG,
-                  const std::string &Buf,
+                  std::string_view Buf,
                   unsigned sourceId,
                   unsigned baseOffset);
 
+   ~TemplateParser();
+
+   /// Compile the template. This has to be done before emitTemplate().
+   bool compileTemplate();
+
+   /// Write the output of the compiled template to \p OS. Different
+   /// templates can be emitted on different threads at the same time, as
+   /// long as TableGen::freeze() was called.
+   bool emitTemplate(std::ostream &OS);
+
+   /// Compile the template and write its output to \p OS.
+   bool parseTemplate(std::ostream &OS)
+   {
+      return compileTemplate() && emitTemplate(OS);
+   }
+
+private:
+   /// Constructor for the parser that executes a compiled template.
    TemplateParser(TableGen &TG,
-                  const std::vector<lex::Token> &Toks,
                   unsigned sourceId,
-                  unsigned baseOffset,
-                  const std::unordered_map<std::string, Macro> &macros);
+                  unsigned baseOffset);
+
+   enum class BlockKind {
+      /// The template itself, ended by EOF.
+      TopLevel,
+      /// The body of a for_each, or the else branch of an if.
+      Body,
+      /// The body of an if, which may contain an 'else'.
+      IfBody,
+      /// The body of a macro.
+      Macro,
+   };
 
-   bool parseTemplate();
-   std::string getResult();
+   std::ostream *ActiveOS = nullptr;
 
-private:
-   std::ostringstream OS;
-   std::ostringstream *ActiveOS;
-   std::vector<lex::Token> currentTokens;
-   std::unordered_map<std::string, Macro> macros;
+   /// The text since the last command.
+   std::string currentText;
+
+   /// The position of the last newline in currentText that is only followed
+   /// by whitespace, or npos if there is none.
+   size_t currentTextNewline = std::string::npos;
+
+   /// The tokens of all commands of the template, referenced by the ops.
+   lex::TokenBuffer commandTokens;
+
+   /// The compiled template.
+   OpList program;
+
+   /// Evaluates the commands of the compiled template. It replays their
+   /// tokens, so that the template's own lexer is never rewound.
+   std::unique_ptr<TemplateParser> executor;
+
+   /// The macros visible at the current point of execution, later
+   /// definitions shadow earlier ones.
+   std::vector<std::pair<std::string_view, const TemplateOp*>> macros;
+
+   /// Index of the first macro defined by the innermost invocation.
+   size_t macroScopeBegin = 0;
 
    bool commandFollows();
 
-   void appendTokens(bool beforeCommand = false);
+   void appendTokens(OpList &ops, bool beforeCommand = false);
+
+   bool compileBlock(OpList &ops, BlockKind kind);
+   void compileCommand(OpList &ops, BlockKind kind, bool *isEnd,
+                       bool *isElse);
+   void collectCommandTokens(TemplateOp &op);
+
+   /// \return the index of the first token of kind \p kind at or after
+   /// \p begin in the command of \p op, or the number of tokens if there is
+   /// none.
+   static size_t findCommandToken(const TemplateOp &op,
+                                  lex::tok::TokenType kind,
+                                  size_t begin = 0);
 
-   void parseUntilEnd(bool *isElse = nullptr);
-   void skipUntilEnd(std::vector<lex::Token> *tokens = nullptr);
+   void checkCommandEnd(bool paste);
+   void compileBlockCommand(TemplateOp &op);
+   void compileDefine(TemplateOp &op);
+   void analyzeCommand(TemplateOp &op, size_t exprBegin);
+
+   void execute(const OpList &ops);
+   void executeExpr(const TemplateOp &op);
+   void executeIf(const TemplateOp &op);
+   void executeForeach(const TemplateOp &op);
+   void executeInvoke(const TemplateOp &op);
+
+   void resetTo(const TemplateOp &op);
+   Value *evaluatePath(const TemplateOp &op);
+   void pasteResult(const TemplateOp &op, const Value *result,
+                    bool explicitStr);
 
    void advanceNoSkip()
    {
@@ -217,16 +380,25 @@ private:
       return peek(false, false);
    }
 
-   void handleTemplateExpr(bool *isEnd = nullptr, bool *isElse = nullptr);
-
-   Value *handleCommand(bool paste, bool &explicitStr,
-                        bool *isEnd = nullptr, bool *isElse = nullptr);
+   const Value *handleTemplateExpr(bool paste, bool &explicitStr);
+   Value *handleCommand(bool &explicitStr);
+   Value *applyCommand(const IdentifierInfo *cmd, std::vector<Value*> &args,
+                       SourceLocation parenLoc, bool &explicitStr);
 
    Value *handleIf(bool paste);
-   Value *handleForeach(bool paste);
-
-   Value *handleDefine(bool paste);
-   Value *handleInvoke(bool paste);
+   void handleForeach(bool paste, ForEachHeader &header);
+
+   /// Parse the options of a for_each_record command over the records of
+   /// \p C, an optional where clause followed by either 'sort_by <field>'
+   /// or 'group_by <field>', and add the values to iterate to \p values.
+   /// Grouping yields every distinct value of the field once, in order.
+   void parseRecordQuery(Class *C, std::vector<Value*> &values);
+
+   /// Parse the conditions following 'where' in a for_each_record command,
+   /// separated by '&&', and set \p positions to the positions of the
+   /// records of \p C that satisfy all of them, in declaration order.
+   void parseWhereClause(Class *C, std::vector<unsigned> &positions);
+   const TemplateOp *handleInvoke(bool paste, std::vector<Value*> &args);
 };
 
 } // namespace tblgen
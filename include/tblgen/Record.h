@@ -4,8 +4,11 @@
 
 #include "tblgen/Lex/SourceLocation.h"
 #include "tblgen/Support/Allocator.h"
+#include "tblgen/Support/BitVector.h"
 #include "tblgen/Support/Optional.h"
 
+#include <atomic>
+#include <iterator>
 #include <unordered_map>
 #include <unordered_set>
 #include <string>
@@ -106,44 +109,20 @@ public:
                  Type *type,
                  Value *defaultValue,
                  SourceLocation declLoc,
-                 size_t associatedTemplateParm = size_t(-1)) {
-      if (getField(name))
-         return false;
-
-      fields.emplace_back(name, type, defaultValue, declLoc,
-                          associatedTemplateParm);
-
-      return true;
-   }
+                 size_t associatedTemplateParm = size_t(-1));
 
    bool addOverride(std::string_view name,
                     Type *type,
                     Value *defaultValue,
                     SourceLocation declLoc,
-                    bool append) {
-      if (getOverride(name))
-         return false;
-
-      overrides.emplace_back(name, type, defaultValue, declLoc, -1, append);
-      return true;
-   }
+                    bool append);
 
    bool addTemplateParam(std::string_view name,
                          Type *type,
                          Value *defaultValue,
-                         SourceLocation declLoc) {
-      if (getTemplateParameter(name))
-         return false;
+                         SourceLocation declLoc);
 
-      parameters.emplace_back(name, type, defaultValue, declLoc);
-
-      return true;
-   }
-
-   void addBase(Class *Base, std::vector<Value*> &&templateParams)
-   {
-      bases.emplace_back(Base, move(templateParams));
-   }
+   void addBase(Class *Base, std::vector<Value*> &&templateParams);
 
    const std::string &getName() const
    {
@@ -157,55 +136,52 @@ public:
 
    RecordField *getTemplateParameter(std::string_view name) const
    {
-      for (auto &field : parameters)
-         if (field.getName() == name)
-            return const_cast<RecordField*>(&field);
-
-      return nullptr;
+      return lookup(parameterIndex, parameters, name);
    }
 
    RecordField* getField(std::string_view name) const
    {
-      auto F = getOwnField(name);
-      if (F)
+      if (auto F = getOwnField(name))
          return F;
 
-      for (auto &b : bases)
-         if ((F = b.getBase()->getField(name)))
-            return F;
-
-      return nullptr;
+      return getInheritedField(name);
    }
 
    RecordField* getOverride(std::string_view name) const
    {
-      auto F = getOwnOverride(name);
-      if (F)
+      if (auto F = getOwnOverride(name))
          return F;
 
-      for (auto &b : bases)
-         if ((F = b.getBase()->getOverride(name)))
-            return F;
-
-      return nullptr;
+      return getInheritedOverride(name);
    }
 
    RecordField* getOwnField(std::string_view name) const
    {
-      for (auto &field : fields)
-         if (field.getName() == name)
-            return const_cast<RecordField*>(&field);
-
-      return nullptr;
+      return lookup(fieldIndex, fields, name);
    }
 
    RecordField* getOwnOverride(std::string_view name) const
    {
-      for (auto &field : overrides)
-         if (field.getName() == name)
-            return const_cast<RecordField*>(&field);
+      return lookup(overrideIndex, overrides, name);
+   }
 
-      return nullptr;
+   /// \return the field \p name declared in any (transitive) base class.
+   RecordField *getInheritedField(std::string_view name) const
+   {
+      buildInheritedFields();
+
+      auto it = inheritedFields.find(name);
+      return it == inheritedFields.end() ? nullptr : it->second;
+   }
+
+   /// \return the override of \p name declared in any (transitive) base
+   /// class.
+   RecordField *getInheritedOverride(std::string_view name) const
+   {
+      buildInheritedFields();
+
+      auto it = inheritedOverrides.find(name);
+      return it == inheritedOverrides.end() ? nullptr : it->second;
    }
 
    const std::vector<RecordField> &getParameters() const
@@ -220,7 +196,7 @@ public:
 
    const std::vector<RecordField> &getOverrides() const
    {
-      return fields;
+      return overrides;
    }
 
    const std::vector<BaseClass> &getBases() const
@@ -228,21 +204,28 @@ public:
       return bases;
    }
 
-   bool inheritsFrom(Class *C)
+   /// \return true if \p C is a direct or indirect base of this class.
+   bool inheritsFrom(Class *C) const
    {
-      for (auto &B : bases) {
-         if (B.getBase() == C)
-            return true;
-
-         if (B.getBase()->inheritsFrom(C))
-            return true;
-      }
+      return ancestors.test(C->getID());
+   }
 
-      return false;
+   /// \return the IDs of all direct and indirect bases of this class.
+   const support::BitVector &getAncestors() const
+   {
+      return ancestors;
    }
 
+   /// \return the unique ID of this class.
+   unsigned getID() const { return ID; }
+
    RecordKeeper &getRecordKeeper() const { return RK; }
 
+   /// Build the cache used by getInheritedField() and
+   /// getInheritedOverride(), if it is not up to date. Lookups don't modify
+   /// the class afterwards, so it can be shared between threads.
+   void buildInheritedFields() const;
+
    void dump();
    void printTo(std::ostream &out);
 
@@ -258,11 +241,44 @@ private:
    std::string name;
    SourceLocation declLoc;
 
+   /// Assigned by the RecordKeeper after construction.
+   unsigned ID = 0;
+
+   /// The IDs of all direct and indirect bases, filled in by addBase().
+   support::BitVector ancestors;
+
    std::vector<BaseClass> bases;
 
    std::vector<RecordField> parameters;
    std::vector<RecordField> fields;
    std::vector<RecordField> overrides;
+
+   using FieldIndexMap = std::unordered_map<std::string_view, unsigned>;
+   using FieldPtrMap = std::unordered_map<std::string_view, RecordField*>;
+
+   /// Indices into the vectors above, keyed by the interned field name.
+   FieldIndexMap parameterIndex;
+   FieldIndexMap fieldIndex;
+   FieldIndexMap overrideIndex;
+
+   /// The fields and overrides of all base classes, flattened in the order
+   /// getField() used to search them. Base classes are complete by the
+   /// time they are referenced, so this is only invalidated by addBase().
+   mutable FieldPtrMap inheritedFields;
+   mutable FieldPtrMap inheritedOverrides;
+   mutable bool inheritedFieldsValid = false;
+
+   static RecordField *lookup(const FieldIndexMap &Index,
+                              const std::vector<RecordField> &Fields,
+                              std::string_view name) {
+      auto it = Index.find(name);
+      if (it == Index.end())
+         return nullptr;
+
+      return const_cast<RecordField*>(&Fields[it->second]);
+   }
+
+   std::string_view internName(std::string_view name) const;
 };
 
 inline std::ostream &operator<<(std::ostream &str, Class &C)
@@ -277,20 +293,54 @@ inline std::ostream &operator<<(std::ostream &str, Class *C)
    return str;
 }
 
-class Record {
+/// The field layout shared by all records with the same list of base
+/// classes. Every field of the flattened class hierarchy, plus the implicit
+/// name field, is assigned a fixed slot, so records can store their values
+/// in a plain array.
+class RecordLayout {
 public:
-   void addOwnField(SourceLocation loc, std::string_view key,
-                    Type *Ty, Value *V) {
-      auto &F = ownFields.emplace_back(key, Ty, V, loc);
-      auto &Entry = *fieldValues.emplace(key, V).first;
-      F.name = std::string_view(Entry.first);
+   unsigned getNumSlots() const
+   {
+      return (unsigned)fieldNames.size();
+   }
+
+   std::string_view getFieldName(unsigned slot) const
+   {
+      return fieldNames[slot];
    }
 
-   void setFieldValue(const std::string &key, Value *V)
+   support::Optional<unsigned> getSlot(std::string_view name) const
    {
-      fieldValues[key] = V;
+      auto it = slots.find(name);
+      if (it == slots.end())
+         return support::None;
+
+      return it->second;
    }
 
+   friend class TableGen;
+
+private:
+   RecordLayout() = default;
+
+   /// Add a field with the interned name \p name, unless it already exists.
+   void addField(std::string_view name)
+   {
+      if (slots.emplace(name, (unsigned)fieldNames.size()).second)
+         fieldNames.push_back(name);
+   }
+
+   std::vector<std::string_view> fieldNames;
+   std::unordered_map<std::string_view, unsigned> slots;
+};
+
+class Record {
+public:
+   void addOwnField(SourceLocation loc, std::string_view key,
+                    Type *Ty, Value *V);
+
+   void setFieldValue(std::string_view key, Value *V);
+
    const std::string &getName() const
    {
       return name;
@@ -306,20 +356,105 @@ public:
       return bases;
    }
 
-   const std::unordered_map<std::string, Value *> &getFieldValues() const
+   /// Iterates over the (name, value) pairs of all fields that have a
+   /// value, in slot order.
+   class field_value_iterator {
+   public:
+      using value_type = std::pair<std::string_view, Value*>;
+      using reference = const value_type&;
+      using pointer = const value_type*;
+      using difference_type = std::ptrdiff_t;
+      using iterator_category = std::forward_iterator_tag;
+
+      field_value_iterator(const Record &R, unsigned idx)
+         : R(&R), idx(idx)
+      {
+         skipEmpty();
+      }
+
+      reference operator*() const { return cur; }
+      pointer operator->() const { return &cur; }
+
+      field_value_iterator &operator++()
+      {
+         ++idx;
+         skipEmpty();
+
+         return *this;
+      }
+
+      bool operator==(const field_value_iterator &rhs) const
+      {
+         return idx == rhs.idx;
+      }
+
+      bool operator!=(const field_value_iterator &rhs) const
+      {
+         return idx != rhs.idx;
+      }
+
+   private:
+      const Record *R;
+      unsigned idx;
+      value_type cur;
+
+      void skipEmpty();
+   };
+
+   struct field_value_range {
+      field_value_iterator begin() const { return Begin; }
+      field_value_iterator end() const { return End; }
+
+      field_value_iterator Begin;
+      field_value_iterator End;
+   };
+
+   field_value_range getFieldValues() const
+   {
+      ensureFinalized();
+      return { field_value_iterator(*this, 0),
+               field_value_iterator(*this, getNumFieldEntries()) };
+   }
+
+   /// \return the layout of this record's fields, or null if no value has
+   /// been set yet.
+   const RecordLayout *getLayout() const
    {
-      return fieldValues;
+      ensureFinalized();
+      return layout;
    }
 
-   void addBase(Class *Base, std::vector<Value*> &&templateParams)
+   /// \return the value in slot \p slot of this record's layout.
+   Value *getFieldValueBySlot(unsigned slot) const
    {
-      bases.emplace_back(Base, move(templateParams));
+      ensureFinalized();
+
+      assert(layout && slot < layout->getNumSlots() && "invalid slot");
+      return slotValues[slot];
    }
 
-   bool hasField(const std::string &name) const
+   /// Set the value in slot \p slot of this record's layout.
+   void setFieldValueBySlot(unsigned slot, Value *V)
    {
-      auto it = fieldValues.find(name);
-      return it != fieldValues.end();
+      assert(layout && slot < layout->getNumSlots() && "invalid slot");
+      slotValues[slot] = V;
+   }
+
+   /// \return the layout of this record's fields, which is computed from
+   /// its bases if necessary.
+   const RecordLayout *getOrCreateLayout()
+   {
+      if (!layout)
+         initLayout();
+
+      return layout;
+   }
+
+   void addBase(Class *Base, std::vector<Value*> &&templateParams);
+
+   bool hasField(std::string_view name) const
+   {
+      return getFieldValue(name) != nullptr;
    }
 
    Type *getFieldType(std::string_view fieldName) const
@@ -332,40 +467,38 @@ public:
       return nullptr;
    }
 
-   Value *getFieldValue(const std::string &fieldName) const
+   Value *getFieldValue(std::string_view fieldName) const
    {
-      auto it = fieldValues.find(fieldName);
-      if (it != fieldValues.end())
-         return it->second;
-
-      return nullptr;
+      ensureFinalized();
+      return lookupFieldValue(fieldName);
    }
 
    const std::vector<RecordField> &getOwnFields() const
    {
+      ensureFinalized();
       return ownFields;
    }
 
    RecordField *getOwnField(std::string_view name)
    {
-      for (auto &f : ownFields)
-         if (f.getName() == name)
-            return &f;
-
-      return nullptr;
+      ensureFinalized();
+      return findOwnField(name);
    }
 
-   bool inheritsFrom(Class *C)
+   /// Assign the inherited field values now if TableGen::finalizeRecord()
+   /// deferred that. Every accessor of the field values does this, so it
+   /// only needs to be called explicitly before accessing the record
+   /// through its layout.
+   void ensureFinalized() const
    {
-      for (auto &B : bases) {
-         if (B.getBase() == C)
-            return true;
-
-         if (B.getBase()->inheritsFrom(C))
-            return true;
-      }
+      if (NeedsFinalization.load(std::memory_order_acquire))
+         finalizeDeferred();
+   }
 
-      return false;
+   /// \return true if \p C is a direct or indirect base of this record.
+   bool inheritsFrom(Class *C) const
+   {
+      return ancestors && ancestors->test(C->getID());
    }
 
    RecordKeeper &getRecordKeeper() const { return RK; }
@@ -377,6 +510,7 @@ public:
    void printTo(std::ostream &out);
 
    friend class RecordKeeper;
+   friend class TableGen;
 
 private:
    Record(RecordKeeper &RK, const std::string &name, SourceLocation declLoc)
@@ -397,7 +531,41 @@ private:
    std::vector<Class::BaseClass> bases;
    std::vector<RecordField> ownFields;
 
-   std::unordered_map<std::string, Value*> fieldValues;
+   /// The layout of this record, computed from its bases when the first
+   /// value is set.
+   const RecordLayout *layout = nullptr;
+
+   /// The field values, indexed by their slot in the layout.
+   Value **slotValues = nullptr;
+
+   /// Values of fields that are not part of the layout, keyed by their
+   /// interned name.
+   std::vector<std::pair<std::string_view, Value*>> extraFieldValues;
+
+   unsigned getNumFieldEntries() const
+   {
+      if (!layout)
+         return 0;
+
+      return layout->getNumSlots() + (unsigned)extraFieldValues.size();
+   }
+
+   void initLayout();
+
+   /// The accessors used while the record is built and finalized, which
+   /// must not wait for the finalization.
+   Value *lookupFieldValue(std::string_view fieldName) const;
+   RecordField *findOwnField(std::string_view name);
+
+   /// Set if TableGen::finalizeRecord() deferred assigning the inherited
+   /// values until the first access.
+   mutable std::atomic<bool> NeedsFinalization{ false };
+
+   void finalizeDeferred() const;
+
+   /// The IDs of all direct and indirect bases, shared by the records with
+   /// the same bases, see TableGen::getAncestors(). Set by addBase().
+   const support::BitVector *ancestors = nullptr;
 
    bool IsAnonymous = false;
 };
@@ -439,6 +607,11 @@ public:
       return casesByValue.find(caseVal) != casesByValue.end();
    }
 
+   const std::unordered_map<std::string, EnumCase*> &getCases() const
+   {
+      return casesByName;
+   }
+
    std::string_view getName() const
    {
       return name;
@@ -586,6 +759,11 @@ public:
       return const_cast<RecordKeeper*>(it->second);
    }
 
+   TableGen &getTableGen() const
+   {
+      return TG;
+   }
+
    SourceLocation lookupAnyDecl(const std::string & name) const
    {
       if (auto R = lookupRecord(name))
@@ -616,6 +794,11 @@ public:
       return Records;
    }
 
+   const std::unordered_map<std::string, Enum*> &getAllEnums() const
+   {
+      return Enums;
+   }
+
    const std::unordered_map<std::string, ValueDecl> &getValueDecls() const
    {
       return Values;
@@ -643,9 +826,12 @@ public:
 
    void getAllDefinitionsOf(Class *C,
                             std::vector<Record*> &vec) const {
-      for (auto &R : Records)
-         if (R->inheritsFrom(C))
-            vec.push_back(R);
+      if (!C)
+         return;
+
+      auto it = DerivedRecords.find(C);
+      if (it != DerivedRecords.end())
+         vec.insert(vec.end(), it->second.begin(), it->second.end());
    }
 
    void getAllDefinitionsOf(const std::string &className,
@@ -653,8 +839,25 @@ public:
       return getAllDefinitionsOf(lookupClass(className), vec);
    }
 
+   /// \return the records of this namespace that (indirectly) derive from
+   /// \p C, in declaration order.
+   const std::vector<Record*> &getDefinitionsOf(Class *C) const
+   {
+      static const std::vector<Record*> Empty;
+
+      auto it = DerivedRecords.find(C);
+      if (it == DerivedRecords.end())
+         return Empty;
+
+      return it->second;
+   }
+
    support::ArenaAllocator &getAllocator() const;
 
+   /// Register \p R, which was declared in this namespace, as a definition
+   /// of \p Base and all of its bases.
+   void addDerivedRecord(Record *R, Class *Base);
+
    void dump();
    void printTo(std::ostream &out);
 
@@ -668,6 +871,10 @@ private:
    std::unordered_map<std::string, Class*> Classes;
    std::vector<Record*> Records;
    std::unordered_map<std::string, Record*> RecordsMap;
+
+   /// The records of this namespace that (indirectly) derive from a class,
+   /// in declaration order.
+   std::unordered_map<Class*, std::vector<Record*>> DerivedRecords;
    std::unordered_map<std::string, Enum*> Enums;
    std::unordered_map<std::string, ValueDecl> Values;
    std::unordered_map<std::string, RecordKeeper*> Namespaces;
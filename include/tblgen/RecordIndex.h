@@ -0,0 +1,175 @@
+#ifndef TABLEGEN_RECORDINDEX_H
+#define TABLEGEN_RECORDINDEX_H
+
+#include <cassert>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace tblgen {
+
+class Record;
+class Type;
+class Value;
+
+/// A secondary index over the values of one field of the records in a
+/// namespace that derive from a class. It answers queries like
+/// `for_each_record | "Animal" where type == .Bird` without visiting every
+/// record of the class.
+///
+/// Records are identified by their position in the list of definitions of
+/// the class, see RecordKeeper::getDefinitionsOf(). Query results are in
+/// declaration order, so the results for different fields of the same
+/// class can be intersected directly.
+///
+/// The index can also provide the records in the order of their values,
+/// which is used for sorted and grouped iteration. Integers are ordered by
+/// value, strings lexicographically, enum values by their case value and
+/// records by their name. Records with the same value stay in declaration
+/// order, so the order is deterministic.
+class RecordIndex {
+public:
+   enum Predicate {
+      Eq, Ne, Lt, Le, Gt, Ge,
+   };
+
+   /// C'tor. \p FieldTy is the declared type of the field.
+   RecordIndex(std::string_view FieldName, Type *FieldTy);
+
+   /// \return true if the values of fields of type \p Ty can be indexed.
+   static bool supportsType(Type *Ty);
+
+   /// \return true if \p Pred can be applied to the values of this field.
+   /// Ordered comparisons require an integer field.
+   bool supportsPredicate(Predicate Pred) const;
+
+   /// \return true if \p Val can be compared to the values of this field.
+   bool supportsValue(const Value *Val) const;
+
+   /// Index the records of \p Records that were added since the last
+   /// update. Definitions are only ever appended to that list, so the
+   /// records that were already indexed keep their positions.
+   void update(const std::vector<Record*> &Records);
+
+   /// \return the number of records that were indexed.
+   size_t size() const { return NumRecords; }
+
+   /// Append the positions of the records whose field compares to \p Val
+   /// with \p Pred to \p Result, in declaration order.
+   void query(Predicate Pred, const Value *Val,
+              std::vector<unsigned> &Result) const;
+
+   /// Compute the order of the records by the value of the field, unless
+   /// that was done before. Large indexes are sorted in parallel. The order
+   /// is kept up to date by later calls to update().
+   void buildOrder();
+
+   /// \return true if buildOrder() was called.
+   bool hasOrder() const { return HasOrder; }
+
+   /// \return the positions of all records, ordered by the value of the
+   /// field. Records without a value of the field's type come last.
+   const std::vector<unsigned> &getOrder() const
+   {
+      assert(HasOrder && "order was not built");
+      return Order;
+   }
+
+   /// Reorder \p Positions by the value of the field, see getOrder().
+   void sortPositions(std::vector<unsigned> &Positions) const;
+
+   /// \return the value of the field of the record at \p Position, or
+   /// null if it does not have a value of the field's type.
+   Value *getValue(unsigned Position) const { return Values[Position]; }
+
+   /// \return true if the records at \p A and \p B have equal values.
+   bool equalValues(unsigned A, unsigned B) const
+   {
+      return Keys[A] == Keys[B];
+   }
+
+private:
+   std::string FieldName;
+   Type *FieldTy;
+
+   /// True if the field has a signed integer type, in which case the keys
+   /// are ordered as signed values.
+   bool IsSigned = false;
+
+   /// The number of records that were indexed.
+   size_t NumRecords = 0;
+
+   /// Positions of the records with the same value, keyed by the integer
+   /// value, the enum case or the record. Positions are ascending.
+   std::unordered_map<uint64_t, std::vector<unsigned>> KeyBuckets;
+
+   /// Positions of the records with the same value of a string field.
+   std::unordered_map<std::string_view, std::vector<unsigned>> StringBuckets;
+
+   /// The (ordered key, position) pairs of an integer field, sorted.
+   std::vector<std::pair<uint64_t, unsigned>> SortedKeys;
+
+   /// The value of the field of every record, or null if it does not have
+   /// one of the field's type.
+   std::vector<Value*> Values;
+
+   /// The key that orders a value. Strings and records are ordered by Str,
+   /// the other values by Num.
+   struct SortKey {
+      bool Missing = true;
+      uint64_t Num = 0;
+      std::string_view Str;
+
+      bool operator==(const SortKey &RHS) const
+      {
+         return Missing == RHS.Missing && Num == RHS.Num && Str == RHS.Str;
+      }
+
+      bool operator<(const SortKey &RHS) const
+      {
+         if (Missing != RHS.Missing)
+            return RHS.Missing;
+         if (Num != RHS.Num)
+            return Num < RHS.Num;
+
+         return Str < RHS.Str;
+      }
+   };
+
+   /// The sort key of every record.
+   std::vector<SortKey> Keys;
+
+   /// Set by buildOrder().
+   bool HasOrder = false;
+
+   /// The positions of the records, ordered by their key and position.
+   std::vector<unsigned> Order;
+
+   /// The index of every position in Order.
+   std::vector<unsigned> Ranks;
+
+   /// \return true if the record at \p A comes before the one at \p B.
+   bool comesBefore(unsigned A, unsigned B) const
+   {
+      if (Keys[A] == Keys[B])
+         return A < B;
+
+      return Keys[A] < Keys[B];
+   }
+
+   /// \return the sort key of \p Val.
+   SortKey getSortKey(const Value *Val) const;
+
+   /// \return the key of \p Val in KeyBuckets and SortedKeys.
+   uint64_t getKey(const Value *Val) const;
+
+   /// \return the positions of the records whose value equals \p Val.
+   const std::vector<unsigned> *findBucket(const Value *Val) const;
+};
+
+} // namespace tblgen
+
+#endif //TABLEGEN_RECORDINDEX_H
@@ -0,0 +1,204 @@
+#ifndef TBLGEN_BINARYFORMAT_H
+#define TBLGEN_BINARYFORMAT_H
+
+#include <cstdint>
+#include <string_view>
+
+namespace tblgen {
+namespace serial {
+
+/// The binary record format is a flat file that consists of a header
+/// followed by a number of tables. Every table is an array of one of the
+/// POD structures below, and all references between entities are indices
+/// into these tables instead of pointers, so the file can be mapped and
+/// used without any relocation.
+///
+/// Entities are written in dependency order: element types precede the
+/// types that refer to them, and values precede the values that contain
+/// them. Namespaces precede their nested namespaces.
+
+/// The magic bytes at the start of every binary record file.
+constexpr std::string_view Magic = "TBLGENBR";
+
+/// Bump this whenever the format changes.
+constexpr uint32_t FormatVersion = 1;
+
+/// Marks a missing index, e.g. a field without a default value.
+constexpr uint32_t InvalidIndex = ~0u;
+
+/// A reference to a string in the string table.
+struct StringRef {
+   uint32_t Offset;
+   uint32_t Length;
+};
+
+/// A contiguous range of entries in one of the tables.
+struct Range {
+   uint32_t Begin;
+   uint32_t Count;
+};
+
+enum TableKind : uint32_t {
+   /// Raw character data, referenced by StringRef.
+   TK_Strings,
+
+   /// uint32_t indices, referenced by Range from other tables.
+   TK_Indices,
+
+   /// TypeEntry
+   TK_Types,
+
+   /// ValueEntry
+   TK_Values,
+
+   /// NamedValueEntry, used for dict entries, field values and value decls.
+   TK_NamedValues,
+
+   /// FieldEntry, used for class parameters, fields and overrides and for
+   /// the own fields of records.
+   TK_Fields,
+
+   /// BaseEntry
+   TK_Bases,
+
+   /// ClassEntry
+   TK_Classes,
+
+   /// EnumCaseEntry
+   TK_EnumCases,
+
+   /// EnumEntry
+   TK_Enums,
+
+   /// RecordEntry
+   TK_Records,
+
+   /// NamespaceEntry, the first entry is the global namespace.
+   TK_Namespaces,
+
+   TK_NumTables,
+};
+
+struct FileHeader {
+   char Magic[8];
+   uint32_t Version;
+   uint32_t NumTables;
+
+   /// The byte offset and the number of entries of every table.
+   struct {
+      uint64_t Offset;
+      uint64_t Count;
+   } Tables[TK_NumTables];
+};
+
+struct TypeEntry {
+   /// The Type::TypeID of the type.
+   uint32_t Kind;
+
+   /// The bit width of integer types, or the index of the element type,
+   /// class, record or enum.
+   uint32_t Operand;
+
+   /// True for unsigned integer types.
+   uint32_t IsUnsigned;
+};
+
+struct ValueEntry {
+   /// The Value::TypeID of the value.
+   uint32_t Kind;
+
+   /// The index of the value's type, or InvalidIndex.
+   uint32_t Type;
+
+   /// The string contents of string literals, code blocks, identifiers and
+   /// the key of dict accesses.
+   StringRef Str;
+
+   /// The elements of list literals (indices) or dict literals (named
+   /// values).
+   Range Elements;
+
+   /// The value of integer literals, the bits of floating point literals,
+   /// the index of the referenced record, enum case or dict value.
+   uint64_t Payload;
+};
+
+struct NamedValueEntry {
+   StringRef Name;
+   uint32_t Value;
+};
+
+struct FieldEntry {
+   StringRef Name;
+   uint32_t Type;
+   uint32_t DefaultValue;
+   uint32_t AssociatedTemplateParm;
+   uint32_t IsAppend;
+};
+
+struct BaseEntry {
+   uint32_t Class;
+
+   /// The template arguments, as a range of value indices.
+   Range TemplateArgs;
+};
+
+struct ClassEntry {
+   StringRef Name;
+   uint32_t Namespace;
+   Range Bases;
+   Range Parameters;
+   Range Fields;
+   Range Overrides;
+};
+
+struct EnumCaseEntry {
+   StringRef Name;
+   uint64_t Value;
+};
+
+struct EnumEntry {
+   StringRef Name;
+   uint32_t Namespace;
+   Range Cases;
+};
+
+struct RecordEntry {
+   StringRef Name;
+
+   /// The namespace the record is declared in.
+   uint32_t Namespace;
+
+   /// True if this is an anonymous record.
+   uint32_t IsAnonymous;
+
+   Range Bases;
+   Range OwnFields;
+
+   /// The final field values, as a range of named values.
+   Range FieldValues;
+};
+
+struct NamespaceEntry {
+   StringRef Name;
+
+   /// The parent namespace, or InvalidIndex for the global namespace.
+   uint32_t Parent;
+
+   /// Indices of the named records, in declaration order.
+   Range Records;
+
+   /// The value declarations, as named values.
+   Range Values;
+};
+
+/// \return true if \p Buf starts with the magic bytes of the format.
+inline bool isBinaryRecordFile(std::string_view Buf)
+{
+   return Buf.substr(0, Magic.size()) == Magic;
+}
+
+} // namespace serial
+} // namespace tblgen
+
+#endif // TBLGEN_BINARYFORMAT_H
@@ -0,0 +1,28 @@
+#ifndef TBLGEN_BINARYREADER_H
+#define TBLGEN_BINARYREADER_H
+
+#include <string>
+#include <string_view>
+
+namespace tblgen {
+
+class TableGen;
+
+namespace serial {
+
+/// Load the records of a file written by the -emit-binary backend into the
+/// global RecordKeeper of \p TG, which must be empty.
+///
+/// The file is read in a single pass over its tables without lexing or
+/// parsing anything. Some values keep referring to \p Buf, so it has to
+/// outlive \p TG; buffers opened through the FileManager always do.
+/// Source locations are not preserved.
+///
+/// \return false if \p Buf is not a valid binary record file.
+bool readBinaryRecords(TableGen &TG, std::string_view Buf,
+                       std::string *errMsg = nullptr);
+
+} // namespace serial
+} // namespace tblgen
+
+#endif // TBLGEN_BINARYREADER_H
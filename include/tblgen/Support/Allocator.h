@@ -8,96 +8,153 @@
 #include <cstdint>
 #include <cstdlib>
 #include <iterator>
+#include <ostream>
 #include <type_traits>
 #include <utility>
 #include <vector>
 
 namespace tblgen::support {
 
+/// \return the first address at or after \p Addr that is a multiple of
+/// \p Alignment, which must be a power of two.
 inline void *alignAddr(void *Addr, size_t Alignment)
 {
+   assert(Alignment && (Alignment & (Alignment - 1)) == 0
+          && "alignment is not a power of two!");
    assert((uintptr_t)Addr + Alignment - 1 >= (uintptr_t)Addr);
-   return (void*)((char*)Addr + (((uintptr_t)Addr + Alignment - 1) & ~(uintptr_t)(Alignment - 1)));
+
+   return (void*)(((uintptr_t)Addr + Alignment - 1)
+      & ~(uintptr_t)(Alignment - 1));
 }
 
+/// A bump pointer allocator. Memory is handed out from the current slab by
+/// incrementing a pointer and is only released when the allocator is
+/// destroyed. Slab sizes grow geometrically, so the number of slabs stays
+/// logarithmic in the total amount of allocated memory. Allocations larger
+/// than \p SizeThreshold get a separate slab of their own.
 class ArenaAllocator {
 private:
-   struct Slab {
-      void *beginPtr;
-      void *currentPtr;
-      size_t size;
-   };
-
-   const unsigned SlabSize;
-   std::vector<Slab> slabs;
-   unsigned totalAllocatedBytes;
-   unsigned totalUsedBytes;
-
-   Slab &CreateSlab(size_t size = -1, unsigned alignment = 16)
+   /// The size of the first slab.
+   const size_t SlabSize;
+
+   /// Allocations larger than this get a dedicated slab.
+   const size_t SizeThreshold;
+
+   /// The slab size doubles every GrowthDelay slabs.
+   static constexpr size_t GrowthDelay = 16;
+
+   /// The current bump pointer into the last slab.
+   char *CurPtr = nullptr;
+
+   /// The end of the last slab.
+   char *End = nullptr;
+
+   /// All regular slabs, in allocation order.
+   std::vector<void*> Slabs;
+
+   /// Slabs for oversized allocations, with their sizes.
+   std::vector<std::pair<void*, size_t>> CustomSizedSlabs;
+
+   /// The number of bytes that were requested by clients.
+   uint64_t BytesAllocated = 0;
+
+   /// The number of bytes lost to alignment padding and to the unused tails
+   /// of slabs that were abandoned.
+   uint64_t BytesWasted = 0;
+
+   /// The total size of all slabs, including custom sized ones.
+   uint64_t TotalMemory = 0;
+
+   size_t computeSlabSize(size_t SlabIdx) const
    {
-      if (size == -1) {
-         size = SlabSize;
+      size_t Shift = std::min<size_t>(30, SlabIdx / GrowthDelay);
+      return SlabSize << Shift;
+   }
+
+   void *allocateSlabMemory(size_t Size)
+   {
+      void *Mem = malloc(Size);
+      if (!Mem) {
+         std::abort();
       }
-      if ((size % alignment) != 0) {
-         size += size % alignment;
+
+      TotalMemory += Size;
+      return Mem;
+   }
+
+   void startNewSlab()
+   {
+      BytesWasted += (uint64_t)(End - CurPtr);
+
+      size_t Size = computeSlabSize(Slabs.size());
+      void *Mem = allocateSlabMemory(Size);
+      Slabs.push_back(Mem);
+
+      CurPtr = (char*)Mem;
+      End = CurPtr + Size;
+   }
+
+   void *AllocateSlow(size_t size, size_t alignment)
+   {
+      // Oversized objects get a slab of their own so that the current slab
+      // can still be used for subsequent small allocations.
+      size_t PaddedSize = size + alignment - 1;
+      if (PaddedSize > SizeThreshold) {
+         void *Mem = allocateSlabMemory(PaddedSize);
+         CustomSizedSlabs.emplace_back(Mem, PaddedSize);
+
+         void *AlignedPtr = alignAddr(Mem, alignment);
+         BytesWasted += PaddedSize - size;
+
+         return AlignedPtr;
       }
 
-      totalAllocatedBytes += size;
+      startNewSlab();
 
-      void *mem = malloc(size);
-      slabs.push_back(Slab { mem, mem, size, });
+      char *AlignedPtr = (char*)alignAddr(CurPtr, alignment);
+      assert(AlignedPtr + size <= End && "slab too small for allocation!");
 
-      return slabs.back();
+      BytesWasted += (uint64_t)(AlignedPtr - CurPtr);
+      CurPtr = AlignedPtr + size;
+
+      return AlignedPtr;
    }
 
 public:
-   explicit ArenaAllocator(unsigned SlabSize = 4096)
-      : SlabSize(SlabSize), totalAllocatedBytes(0), totalUsedBytes(0)
+   explicit ArenaAllocator(size_t SlabSize = 4096)
+      : SlabSize(SlabSize), SizeThreshold(SlabSize)
    {
 
    }
 
+   ArenaAllocator(const ArenaAllocator&) = delete;
+   ArenaAllocator &operator=(const ArenaAllocator&) = delete;
+
    ~ArenaAllocator()
    {
-      for (auto &slab : slabs) {
-         free(slab.beginPtr);
+      for (void *Slab : Slabs) {
+         free(Slab);
+      }
+      for (auto &Slab : CustomSizedSlabs) {
+         free(Slab.first);
       }
    }
 
-   void *Allocate(size_t size, unsigned alignment)
+   void *Allocate(size_t size, size_t alignment)
    {
-      // If size is bigger than the slab size, create a custom slab.
-      if (size > SlabSize) {
-         auto &slab = CreateSlab(size, alignment);
-         totalUsedBytes += slab.size;
-         slab.currentPtr = (void*)((char*)slab.beginPtr + slab.size);
+      BytesAllocated += size;
 
-         return slab.beginPtr;
-      }
+      // Fast path: the allocation fits into the current slab. Alignment can
+      // move AlignedPtr past the end of the slab.
+      char *AlignedPtr = (char*)alignAddr(CurPtr, alignment);
+      if (CurPtr && AlignedPtr <= End && size <= (size_t)(End - AlignedPtr)) {
+         BytesWasted += (uint64_t)(AlignedPtr - CurPtr);
+         CurPtr = AlignedPtr + size;
 
-      // Look for a slab with enough leftover space.
-      for (auto &slab : slabs) {
-         ptrdiff_t spaceLeft = ((char*)slab.beginPtr + slab.size) - (char*)slab.currentPtr;
-         if (spaceLeft > size) {
-            // Align address and check if we still have enough space.
-            void *alignedPtr = alignAddr(slab.currentPtr, alignment);
-            spaceLeft = ((char*)slab.beginPtr + slab.size) - (char*)alignedPtr;
-
-            if (spaceLeft > size) {
-               totalUsedBytes += ((char*)alignedPtr - (char*)slab.currentPtr);
-               slab.currentPtr = alignedPtr;
-
-               return alignedPtr;
-            }
-         }
+         return AlignedPtr;
       }
 
-      // Start a new slab.
-      auto &slab = CreateSlab(size, alignment);
-      totalUsedBytes += size;
-      slab.currentPtr = (void*)((char*)slab.beginPtr + size);
-
-      return slab.beginPtr;
+      return AllocateSlow(size, alignment);
    }
 
    void Deallocate(void *ptr, size_t size)
@@ -105,6 +162,31 @@ public:
 
    }
 
+   /// \return the number of bytes that were requested by clients.
+   uint64_t getBytesAllocated() const { return BytesAllocated; }
+
+   /// \return the number of bytes lost to alignment and abandoned slab tails.
+   uint64_t getBytesWasted() const { return BytesWasted; }
+
+   /// \return the total number of bytes obtained from malloc.
+   uint64_t getTotalMemory() const { return TotalMemory; }
+
+   /// \return the number of slabs, including custom sized ones.
+   size_t getNumSlabs() const
+   {
+      return Slabs.size() + CustomSizedSlabs.size();
+   }
+
+   /// Print allocation statistics to \p OS.
+   void printStats(std::ostream &OS) const
+   {
+      OS << "Number of slabs: " << Slabs.size() << " ("
+         << CustomSizedSlabs.size() << " custom sized)\n"
+         << "Bytes allocated: " << BytesAllocated << "\n"
+         << "Bytes wasted: " << BytesWasted << "\n"
+         << "Total memory: " << TotalMemory << "\n";
+   }
+
    template<class T> T *Allocate(size_t Num = 1)
    {
       return static_cast<T *>(Allocate(Num * sizeof(T), alignof(T)));
@@ -0,0 +1,66 @@
+#ifndef TABLEGEN_BITVECTOR_H
+#define TABLEGEN_BITVECTOR_H
+
+#include <cstdint>
+#include <vector>
+
+namespace tblgen::support {
+
+/// A dynamically sized set of small integers, stored as a bitmap that grows
+/// on demand.
+class BitVector {
+   using WordTy = uint64_t;
+   static constexpr unsigned BitsPerWord = 64;
+
+public:
+   BitVector() = default;
+
+   bool test(unsigned Idx) const
+   {
+      unsigned Word = Idx / BitsPerWord;
+      if (Word >= Words.size())
+         return false;
+
+      return (Words[Word] >> (Idx % BitsPerWord)) & 1;
+   }
+
+   void set(unsigned Idx)
+   {
+      unsigned Word = Idx / BitsPerWord;
+      if (Word >= Words.size())
+         Words.resize(Word + 1, 0);
+
+      Words[Word] |= WordTy(1) << (Idx % BitsPerWord);
+   }
+
+   BitVector &operator|=(const BitVector &RHS)
+   {
+      if (RHS.Words.size() > Words.size())
+         Words.resize(RHS.Words.size(), 0);
+
+      for (size_t i = 0; i < RHS.Words.size(); ++i)
+         Words[i] |= RHS.Words[i];
+
+      return *this;
+   }
+
+   /// Call \p Fn with the index of every set bit, in ascending order.
+   template<class Fn>
+   void forEachSetBit(Fn &&F) const
+   {
+      for (size_t i = 0; i < Words.size(); ++i) {
+         WordTy W = Words[i];
+         while (W) {
+            F(unsigned(i * BitsPerWord + __builtin_ctzll(W)));
+            W &= W - 1;
+         }
+      }
+   }
+
+private:
+   std::vector<WordTy> Words;
+};
+
+} // namespace tblgen::support
+
+#endif // TABLEGEN_BITVECTOR_H
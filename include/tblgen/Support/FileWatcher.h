@@ -0,0 +1,76 @@
+#ifndef TABLEGEN_FILEWATCHER_H
+#define TABLEGEN_FILEWATCHER_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace tblgen::support {
+
+/// Waits for changes to a set of files. On Linux, this uses inotify on the
+/// directories of the files, which also notices files that are replaced by
+/// renaming another file, as many editors do. Elsewhere, the modification
+/// times of the files are polled.
+class FileWatcher {
+   /// The inotify instance, or -1 if polling is used.
+   int fd = -1;
+
+   /// A watched directory, and the names of the watched files in it.
+   struct WatchedDir {
+      std::string path;
+      std::unordered_set<std::string> fileNames;
+   };
+
+   /// The watched directories, keyed by their inotify watch descriptor.
+   std::unordered_map<int, WatchedDir> Dirs;
+
+   /// The watch descriptors of the watched directories.
+   std::unordered_map<std::string, int> DirDescriptors;
+
+   /// The size and modification time of the watched files, if polling is
+   /// used. Files that don't exist have no stamp.
+   struct Stamp {
+      bool exists = false;
+      uintmax_t size = 0;
+      int64_t mtime = 0;
+
+      bool operator==(const Stamp &other) const
+      {
+         return exists == other.exists && size == other.size
+            && mtime == other.mtime;
+      }
+   };
+
+   std::unordered_map<std::string, Stamp> PolledFiles;
+
+   static Stamp getStamp(const std::string &fileName);
+
+   /// Add the watched files that the pending inotify events refer to to
+   /// \p Changed.
+   void readEvents(std::unordered_set<std::string> &Changed);
+
+public:
+   FileWatcher();
+   ~FileWatcher();
+
+   FileWatcher(const FileWatcher &) = delete;
+   FileWatcher &operator=(const FileWatcher &) = delete;
+
+   /// Watch the file \p fileName, which needs to be an absolute path. The
+   /// file does not need to exist yet. Changes are recorded from now on,
+   /// even if they happen before the next call to waitForChanges().
+   bool watchFile(const std::string &fileName, std::string *errMsg = nullptr);
+
+   /// Wait until at least one of the watched files is created, written,
+   /// replaced or removed. Editors often save a file in several steps, so
+   /// changes that follow within \p settleMs milliseconds are collected as
+   /// well.
+   /// \return the changed files, or an empty vector if waiting failed.
+   std::vector<std::string> waitForChanges(unsigned settleMs = 50);
+};
+
+} // namespace tblgen::support
+
+#endif // TABLEGEN_FILEWATCHER_H
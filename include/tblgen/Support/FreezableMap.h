@@ -0,0 +1,83 @@
+#ifndef TABLEGEN_FREEZABLEMAP_H
+#define TABLEGEN_FREEZABLEMAP_H
+
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+
+namespace tblgen::support {
+
+/// A hash map used as a cache that can be shared between threads once it is
+/// frozen.
+///
+/// Before freeze() is called, the map is a plain unordered_map that may only
+/// be used by a single thread. Afterwards, the entries that existed at that
+/// point are looked up without any locking. Entries added later go to a
+/// second map that is protected by a mutex, which is only consulted if the
+/// frozen entries don't contain the key. Entries are never removed, so
+/// references to them stay valid.
+template<class KeyT, class ValueT, class HashT = std::hash<KeyT>>
+class FreezableMap {
+public:
+   FreezableMap() = default;
+
+   FreezableMap(const FreezableMap&) = delete;
+   FreezableMap &operator=(const FreezableMap&) = delete;
+
+   /// \return the entry for \p Key, or null if there is none.
+   ValueT *find(const KeyT &Key)
+   {
+      auto it = Map.find(Key);
+      if (it != Map.end())
+         return &it->second;
+
+      if (!Frozen)
+         return nullptr;
+
+      std::lock_guard<std::mutex> Lock(Mtx);
+
+      auto overflowIt = Overflow.find(Key);
+      if (overflowIt != Overflow.end())
+         return &overflowIt->second;
+
+      return nullptr;
+   }
+
+   /// Add \p Val for \p Key, unless another thread did so first.
+   /// \return the entry for \p Key.
+   ValueT &insert(const KeyT &Key, ValueT Val)
+   {
+      if (!Frozen)
+         return Map.try_emplace(Key, std::move(Val)).first->second;
+
+      auto it = Map.find(Key);
+      if (it != Map.end())
+         return it->second;
+
+      std::lock_guard<std::mutex> Lock(Mtx);
+      return Overflow.try_emplace(Key, std::move(Val)).first->second;
+   }
+
+   /// Make the current entries immutable, so that they can be looked up
+   /// concurrently. Must not be called while other threads use the map.
+   void freeze() { Frozen = true; }
+
+   bool isFrozen() const { return Frozen; }
+
+private:
+   /// All entries before the map was frozen, immutable afterwards.
+   std::unordered_map<KeyT, ValueT, HashT> Map;
+
+   /// Entries added after the map was frozen.
+   std::unordered_map<KeyT, ValueT, HashT> Overflow;
+
+   /// Protects Overflow.
+   std::mutex Mtx;
+
+   /// Set by freeze().
+   bool Frozen = false;
+};
+
+} // namespace tblgen::support
+
+#endif // TABLEGEN_FREEZABLEMAP_H
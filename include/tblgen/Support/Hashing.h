@@ -0,0 +1,54 @@
+#ifndef TABLEGEN_HASHING_H
+#define TABLEGEN_HASHING_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace tblgen::support {
+
+/// Offset basis of the 64 bit FNV-1a hash.
+constexpr uint64_t FNVOffsetBasis = 0xcbf29ce484222325ULL;
+
+/// Prime of the 64 bit FNV-1a hash.
+constexpr uint64_t FNVPrime = 0x100000001b3ULL;
+
+/// Compute the 64 bit FNV-1a hash of \p Data, continuing from \p Hash.
+inline uint64_t hashFNV1a(std::string_view Data,
+                          uint64_t Hash = FNVOffsetBasis) {
+   for (unsigned char C : Data) {
+      Hash ^= C;
+      Hash *= FNVPrime;
+   }
+
+   return Hash;
+}
+
+/// Add \p Data and a terminating NUL character to \p Hash, so that hashing
+/// a sequence of strings is unambiguous.
+inline uint64_t hashFNV1aField(std::string_view Data, uint64_t Hash)
+{
+   Hash = hashFNV1a(Data, Hash);
+   Hash ^= 0;
+   Hash *= FNVPrime;
+
+   return Hash;
+}
+
+/// \return \p Hash formatted as 16 hexadecimal digits.
+inline std::string hashToString(uint64_t Hash)
+{
+   static const char Digits[] = "0123456789abcdef";
+
+   std::string Str(16, '0');
+   for (int i = 15; i >= 0; --i) {
+      Str[i] = Digits[Hash & 0xf];
+      Hash >>= 4;
+   }
+
+   return Str;
+}
+
+} // namespace tblgen::support
+
+#endif // TABLEGEN_HASHING_H
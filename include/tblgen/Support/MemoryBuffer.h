@@ -0,0 +1,93 @@
+#ifndef TABLEGEN_MEMORYBUFFER_H
+#define TABLEGEN_MEMORYBUFFER_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace tblgen::support {
+
+/// A read-only view of a file's contents that is guaranteed to be followed
+/// by a NUL character, which the lexer relies on as its end-of-buffer
+/// sentinel. Large files are mapped into memory instead of being copied.
+class MemoryBuffer {
+public:
+   enum BufferKind {
+      /// The buffer is invalid, e.g. because the file could not be opened.
+      MB_Invalid,
+
+      /// The buffer owns a heap allocation holding a copy of the file.
+      MB_Malloc,
+
+      /// The buffer points into pages that are mapped from the file.
+      MB_MMap,
+   };
+
+private:
+   /// Pointer to the first character of the buffer.
+   const char *BufStart;
+
+   /// Pointer to the NUL sentinel following the last character.
+   const char *BufEnd;
+
+   /// The number of bytes that were mapped, if this is a mapped buffer.
+   size_t MappedSize;
+
+   /// How the memory of this buffer is owned.
+   BufferKind Kind;
+
+   /// Private c'tor.
+   MemoryBuffer(const char *BufStart, const char *BufEnd,
+                size_t MappedSize, BufferKind Kind);
+
+   /// Read the file into a NUL-terminated heap allocation.
+   static MemoryBuffer readFile(int FD, size_t FileSize);
+
+public:
+   /// Files smaller than this are always read instead of being mapped, since
+   /// setting up the mapping costs more than copying a handful of pages.
+   static constexpr size_t MinMappedFileSize = 16 * 1024;
+
+   /// Open the file at \p path. If \p allowMapping is true, large files are
+   /// memory mapped, otherwise they are always copied into memory. Mapped
+   /// files must not be truncated while the buffer is alive.
+   static MemoryBuffer getFile(const std::string &path,
+                               bool allowMapping = true,
+                               std::string *errMsg = nullptr);
+
+   /// Create an invalid buffer.
+   MemoryBuffer();
+
+   /// D'tor for releasing the memory or the mapping.
+   ~MemoryBuffer();
+
+   /// Move c'tor.
+   MemoryBuffer(MemoryBuffer &&other) noexcept;
+
+   /// Move assignment.
+   MemoryBuffer &operator=(MemoryBuffer &&other) noexcept;
+
+   /// Disallow copy c'tor.
+   MemoryBuffer(const MemoryBuffer &) = delete;
+
+   /// Disallow copy assignment.
+   MemoryBuffer &operator=(const MemoryBuffer &) = delete;
+
+   const char *getBufferStart() const { return BufStart; }
+   const char *getBufferEnd() const { return BufEnd; }
+   size_t getBufferSize() const { return size_t(BufEnd - BufStart); }
+
+   /// \return a view of the buffer, not including the NUL sentinel.
+   std::string_view getBuffer() const
+   {
+      return std::string_view(BufStart, getBufferSize());
+   }
+
+   BufferKind getBufferKind() const { return Kind; }
+   bool isMapped() const { return Kind == MB_MMap; }
+   bool isValid() const { return Kind != MB_Invalid; }
+};
+
+} // namespace tblgen::support
+
+#endif // TABLEGEN_MEMORYBUFFER_H
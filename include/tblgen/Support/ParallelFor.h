@@ -0,0 +1,124 @@
+#ifndef TABLEGEN_PARALLELFOR_H
+#define TABLEGEN_PARALLELFOR_H
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace tblgen::support {
+
+/// Call \p F with every index in [\p Begin, \p End), distributed over
+/// \p NumThreads threads including the calling one. If \p NumThreads is
+/// zero, use one thread per hardware thread.
+///
+/// Every thread starts with an equal share of the range and takes small
+/// chunks off its front. A thread that runs out of work steals the back half
+/// of the largest remaining share, so uneven per-index costs are balanced
+/// out. This is header-only so that backend libraries can use it without
+/// linking against TblGen.
+template<class Fn>
+void parallelFor(size_t Begin, size_t End, Fn &&F, unsigned NumThreads = 0)
+{
+   if (NumThreads == 0) {
+      NumThreads = std::max(1u, std::thread::hardware_concurrency());
+   }
+
+   size_t Size = End > Begin ? End - Begin : 0;
+   NumThreads = (unsigned)std::min<size_t>(NumThreads, Size);
+
+   if (NumThreads <= 1) {
+      for (size_t i = Begin; i < End; ++i) {
+         F(i);
+      }
+
+      return;
+   }
+
+   struct WorkRange {
+      std::mutex Mtx;
+      size_t Begin;
+      size_t End;
+   };
+
+   // Chunks are small enough to balance the load, but large enough to keep
+   // the locking overhead low.
+   size_t Grain = std::max<size_t>(1, Size / (NumThreads * 32));
+
+   std::vector<std::unique_ptr<WorkRange>> Ranges;
+   for (unsigned i = 0; i < NumThreads; ++i) {
+      auto &R = Ranges.emplace_back(std::make_unique<WorkRange>());
+      R->Begin = Begin + Size * i / NumThreads;
+      R->End = Begin + Size * (i + 1) / NumThreads;
+   }
+
+   auto Worker = [&](unsigned Self) {
+      auto &Own = *Ranges[Self];
+      while (true) {
+         size_t ChunkBegin, ChunkEnd;
+         {
+            std::lock_guard<std::mutex> Lock(Own.Mtx);
+            ChunkBegin = Own.Begin;
+            ChunkEnd = std::min(Own.End, Own.Begin + Grain);
+            Own.Begin = ChunkEnd;
+         }
+
+         if (ChunkBegin < ChunkEnd) {
+            for (size_t i = ChunkBegin; i < ChunkEnd; ++i) {
+               F(i);
+            }
+
+            continue;
+         }
+
+         // Steal the back half of the largest remaining range.
+         WorkRange *Victim = nullptr;
+         size_t VictimSize = 0;
+
+         for (unsigned i = 1; i < NumThreads; ++i) {
+            auto &R = *Ranges[(Self + i) % NumThreads];
+            std::lock_guard<std::mutex> Lock(R.Mtx);
+
+            if (R.End - R.Begin > VictimSize) {
+               Victim = &R;
+               VictimSize = R.End - R.Begin;
+            }
+         }
+
+         if (!Victim) {
+            return;
+         }
+
+         size_t StolenBegin, StolenEnd;
+         {
+            std::lock_guard<std::mutex> Lock(Victim->Mtx);
+            StolenEnd = Victim->End;
+            StolenBegin = Victim->Begin + (Victim->End - Victim->Begin) / 2;
+            Victim->End = StolenBegin;
+         }
+
+         std::lock_guard<std::mutex> Lock(Own.Mtx);
+         Own.Begin = StolenBegin;
+         Own.End = StolenEnd;
+      }
+   };
+
+   std::vector<std::thread> Threads;
+   Threads.reserve(NumThreads - 1);
+
+   for (unsigned i = 1; i < NumThreads; ++i) {
+      Threads.emplace_back(Worker, i);
+   }
+
+   Worker(0);
+
+   for (auto &T : Threads) {
+      T.join();
+   }
+}
+
+} // namespace tblgen::support
+
+#endif // TABLEGEN_PARALLELFOR_H
@@ -0,0 +1,68 @@
+#ifndef TABLEGEN_PARALLELSORT_H
+#define TABLEGEN_PARALLELSORT_H
+
+#include "tblgen/Support/ParallelFor.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <thread>
+
+namespace tblgen::support {
+
+/// Sort [\p Begin, \p End) with \p Comp, using up to \p NumThreads threads
+/// including the calling one. If \p NumThreads is zero, use one thread per
+/// hardware thread.
+///
+/// The range is split into one chunk per thread, the chunks are sorted with
+/// parallelFor(), and neighbouring chunks are merged in rounds, with the
+/// merges of a round running in parallel as well. Small ranges are sorted
+/// on the calling thread. Like std::sort, this is not stable, so \p Comp
+/// should be a total order if the result needs to be deterministic.
+template<class RandomIt, class Compare>
+void parallelSort(RandomIt Begin, RandomIt End, Compare Comp,
+                  unsigned NumThreads = 0)
+{
+   // Below this size, starting threads costs more than it saves.
+   constexpr size_t MinParallelSize = 1 << 14;
+
+   if (NumThreads == 0) {
+      NumThreads = std::max(1u, std::thread::hardware_concurrency());
+   }
+
+   size_t Size = (size_t)std::distance(Begin, End);
+   size_t NumChunks = std::min<size_t>(NumThreads, Size / (MinParallelSize / 2));
+
+   if (Size < MinParallelSize || NumChunks <= 1) {
+      std::sort(Begin, End, Comp);
+      return;
+   }
+
+   auto ChunkBegin = [&](size_t i) {
+      return Begin + (ptrdiff_t)(Size * i / NumChunks);
+   };
+
+   parallelFor(0, NumChunks, [&](size_t i) {
+      std::sort(ChunkBegin(i), ChunkBegin(i + 1), Comp);
+   }, NumThreads);
+
+   // Merge runs of Width chunks pairwise until one run is left.
+   for (size_t Width = 1; Width < NumChunks; Width *= 2) {
+      size_t NumMerges = (NumChunks + 2 * Width - 1) / (2 * Width);
+
+      parallelFor(0, NumMerges, [&](size_t i) {
+         size_t First = i * 2 * Width;
+         size_t Middle = std::min(First + Width, NumChunks);
+         size_t Last = std::min(First + 2 * Width, NumChunks);
+
+         if (Middle < Last) {
+            std::inplace_merge(ChunkBegin(First), ChunkBegin(Middle),
+                               ChunkBegin(Last), Comp);
+         }
+      }, NumThreads);
+   }
+}
+
+} // namespace tblgen::support
+
+#endif // TABLEGEN_PARALLELSORT_H
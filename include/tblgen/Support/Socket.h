@@ -0,0 +1,76 @@
+#ifndef TABLEGEN_SOCKET_H
+#define TABLEGEN_SOCKET_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace tblgen::support {
+
+/// A stream socket that connects processes on the same machine, i.e. a Unix
+/// domain socket. Data is exchanged as messages that are prefixed with their
+/// length.
+class LocalSocket {
+   /// The file descriptor, or -1 if this socket is invalid.
+   int fd;
+
+   /// The path this socket listens on, if it was created by Listen().
+   std::string listenPath;
+
+   /// Private c'tor.
+   LocalSocket(int fd, std::string listenPath = "");
+
+public:
+   /// The largest message that is sent or received. The length prefix comes
+   /// from the peer, so it is checked before any memory is reserved.
+   static constexpr uint64_t MaxMessageSize = uint64_t(1) << 30;
+
+   /// Create a socket that listens on \p path. A stale socket file left
+   /// behind by a process that exited is replaced, but this fails if
+   /// another process is still listening on \p path. Only the owner can
+   /// access the socket file. This changes the umask temporarily, so no
+   /// other thread may create files at the same time.
+   static LocalSocket Listen(const std::string &path,
+                             std::string *errMsg = nullptr);
+
+   /// Connect to the socket that a process listens on at \p path.
+   static LocalSocket Connect(const std::string &path,
+                              std::string *errMsg = nullptr);
+
+   /// Wait for the next connection to this listening socket. Connections
+   /// from processes of other users are closed right away.
+   LocalSocket Accept(std::string *errMsg = nullptr) const;
+
+   /// D'tor, closes the socket and removes the socket file of a listening
+   /// socket.
+   ~LocalSocket();
+
+   /// Move c'tor.
+   LocalSocket(LocalSocket &&other) noexcept;
+
+   // Move assignment.
+   LocalSocket &operator=(LocalSocket &&other) noexcept;
+
+   /// Disallow copy c'tor.
+   LocalSocket(const LocalSocket &) = delete;
+
+   // Disallow copy assignment.
+   LocalSocket &operator=(const LocalSocket &) = delete;
+
+   /// \return true if the socket was created successfully.
+   bool isValid() const { return fd != -1; }
+
+   /// Send \p msg as a single message.
+   /// \return false if an error occurred or \p msg is larger than
+   /// MaxMessageSize.
+   bool sendMessage(std::string_view msg);
+
+   /// Receive the next message into \p msg.
+   /// \return false if the connection was closed, an error occurred or the
+   /// message is larger than MaxMessageSize.
+   bool receiveMessage(std::string &msg);
+};
+
+} // namespace tblgen::support
+
+#endif // TABLEGEN_SOCKET_H
@@ -0,0 +1,66 @@
+#ifndef TABLEGEN_THREADPOOL_H
+#define TABLEGEN_THREADPOOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace tblgen::support {
+
+/// A fixed-size pool of worker threads that execute tasks in FIFO order.
+class ThreadPool {
+public:
+   using TaskTy = std::function<void()>;
+
+   /// Create a pool with \p NumThreads workers. If \p NumThreads is zero,
+   /// use one worker per hardware thread.
+   explicit ThreadPool(unsigned NumThreads = 0);
+
+   /// D'tor, waits for all pending tasks to finish.
+   ~ThreadPool();
+
+   ThreadPool(const ThreadPool&) = delete;
+   ThreadPool &operator=(const ThreadPool&) = delete;
+
+   /// Queue \p Task for execution on one of the workers.
+   void async(TaskTy Task);
+
+   /// Block until all queued tasks have finished.
+   void wait();
+
+   unsigned getNumThreads() const { return (unsigned)Threads.size(); }
+
+   /// \return the number of hardware threads, or 1 if it is unknown.
+   static unsigned getHardwareConcurrency();
+
+private:
+   /// The worker threads.
+   std::vector<std::thread> Threads;
+
+   /// Tasks that were not picked up by a worker yet.
+   std::deque<TaskTy> Tasks;
+
+   /// Protects Tasks, ActiveTasks and EnableFlag.
+   std::mutex QueueLock;
+
+   /// Signaled when a task is queued or the pool shuts down.
+   std::condition_variable QueueCondition;
+
+   /// Signaled when a worker finishes the last outstanding task.
+   std::condition_variable CompletionCondition;
+
+   /// The number of tasks that are currently being executed.
+   unsigned ActiveTasks = 0;
+
+   /// Set to false to make the workers exit once the queue is empty.
+   bool EnableFlag = true;
+
+   void workerLoop();
+};
+
+} // namespace tblgen::support
+
+#endif // TABLEGEN_THREADPOOL_H
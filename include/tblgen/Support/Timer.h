@@ -0,0 +1,189 @@
+#ifndef TABLEGEN_TIMER_H
+#define TABLEGEN_TIMER_H
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace tblgen::support {
+
+class TimeRegion;
+
+/// Collects the time spent in the phases of an invocation.
+///
+/// Phases are measured by TimeRegion objects, which only do any work while
+/// a TimeReport is active, so instrumentation can stay in place in regular
+/// builds. For every phase, the report holds the number of calls, the wall
+/// and CPU time with and without nested phases, the arena memory allocated
+/// and the peak resident set size. Optionally, every call is also recorded
+/// as an event in the Chrome trace event format.
+class TimeReport {
+public:
+   /// Create a report and make it the active one. If \p RecordTrace is
+   /// true, keep an event for every call for writeTrace().
+   explicit TimeReport(bool RecordTrace = false);
+
+   /// D'tor, deactivates the report.
+   ~TimeReport();
+
+   TimeReport(const TimeReport&) = delete;
+   TimeReport &operator=(const TimeReport&) = delete;
+
+   /// \return the active report, or null if timing is disabled.
+   static TimeReport *getActive() { return Active; }
+
+   /// Set the function that returns the number of arena bytes allocated by
+   /// the calling thread so far. Must be called before regions are entered
+   /// on other threads.
+   void setArenaCounter(std::function<uint64_t()> Counter)
+   {
+      ArenaCounter = std::move(Counter);
+   }
+
+   /// Only measure regions of the phase \p Phase, e.g. "Finalize record".
+   /// Other regions then only cost a comparison, which keeps them from
+   /// distorting the time of their parents.
+   void setPhaseFilter(std::string_view Phase) { PhaseFilter = Phase; }
+
+   /// \return true if regions of \p Phase are measured.
+   bool isMeasured(std::string_view Phase) const
+   {
+      return PhaseFilter.empty() || Phase == PhaseFilter;
+   }
+
+   struct PhaseStats {
+      /// The number of times the phase was entered.
+      uint64_t NumCalls = 0;
+
+      /// The wall time in nanoseconds, including nested phases. Recursive
+      /// calls of a phase are only counted once.
+      uint64_t WallNs = 0;
+
+      /// The wall time in nanoseconds, excluding nested phases.
+      uint64_t SelfWallNs = 0;
+
+      /// The CPU time of the calling threads, like WallNs.
+      uint64_t CPUNs = 0;
+
+      /// The CPU time of the calling threads, like SelfWallNs.
+      uint64_t SelfCPUNs = 0;
+
+      /// The arena bytes allocated, excluding nested phases.
+      uint64_t ArenaBytes = 0;
+
+      /// The highest peak RSS in bytes that was seen at the end of a call.
+      uint64_t PeakRSS = 0;
+   };
+
+   /// \return the statistics of the phase \p Name, which is the phase and
+   /// the name of a region separated by a space.
+   PhaseStats getPhaseStats(const std::string &Name) const;
+
+   /// Print the phases, sorted by the time spent in them, to \p OS.
+   void print(std::ostream &OS) const;
+
+   /// Write the recorded events as Chrome trace JSON to \p OS.
+   void writeTrace(std::ostream &OS) const;
+
+private:
+   friend class TimeRegion;
+
+   struct TraceEvent {
+      std::string Name;
+      std::string Detail;
+      uint64_t StartNs;
+      uint64_t DurationNs;
+      unsigned ThreadID;
+   };
+
+   /// Add a finished call of \p R.
+   void addCall(const TimeRegion &R, uint64_t WallNs, uint64_t CPUNs,
+                uint64_t ArenaBytes);
+
+   /// The active report.
+   static TimeReport *Active;
+
+   /// Returns the arena bytes of the calling thread, may be empty.
+   std::function<uint64_t()> ArenaCounter;
+
+   /// The time this report was created at, in nanoseconds.
+   uint64_t StartNs;
+
+   /// Whether to record trace events.
+   bool RecordTrace;
+
+   /// If not empty, the only phase that is measured.
+   std::string PhaseFilter;
+
+   /// Protects Phases and Events.
+   mutable std::mutex Mtx;
+
+   /// The statistics of each phase.
+   std::unordered_map<std::string, PhaseStats> Phases;
+
+   /// The recorded calls, if RecordTrace is set.
+   std::vector<TraceEvent> Events;
+};
+
+/// Measures one call of a phase for the active TimeReport, from its
+/// construction until its destruction.
+///
+/// The phase is identified by \p Phase, followed by \p Name if that is not
+/// empty, e.g. "Parse class". \p Detail is only shown in trace events,
+/// e.g. the name of an included file.
+class TimeRegion {
+public:
+   explicit TimeRegion(std::string_view Phase, std::string_view Name = {},
+                       std::string_view Detail = {})
+   {
+      if (TimeReport::Active && TimeReport::Active->isMeasured(Phase))
+         start(*TimeReport::Active, Phase, Name, Detail);
+   }
+
+   ~TimeRegion()
+   {
+      if (Report)
+         stop();
+   }
+
+   TimeRegion(const TimeRegion&) = delete;
+   TimeRegion &operator=(const TimeRegion&) = delete;
+
+private:
+   friend class TimeReport;
+
+   void start(TimeReport &R, std::string_view Phase, std::string_view Name,
+              std::string_view Detail);
+
+   void stop();
+
+   /// The report this region is measured for, or null if it is inactive.
+   TimeReport *Report = nullptr;
+
+   /// The enclosing region on this thread.
+   TimeRegion *Parent = nullptr;
+
+   std::string Key;
+   std::string Detail;
+
+   uint64_t StartNs = 0;
+   uint64_t StartCPUNs = 0;
+   uint64_t StartArena = 0;
+
+   /// The time and memory spent in nested regions.
+   uint64_t ChildWallNs = 0;
+   uint64_t ChildCPUNs = 0;
+   uint64_t ChildArena = 0;
+
+   /// Whether an enclosing region measures the same phase.
+   bool IsRecursive = false;
+};
+
+} // namespace tblgen::support
+
+#endif // TABLEGEN_TIMER_H
@@ -4,12 +4,21 @@
 
 #include "tblgen/Basic/IdentifierInfo.h"
 #include "tblgen/Lex/SourceLocation.h"
+#include "tblgen/Lex/Token.h"
+#include "tblgen/Lex/TokenBuffer.h"
 #include "tblgen/Support/Allocator.h"
+#include "tblgen/Support/BitVector.h"
+#include "tblgen/Support/FreezableMap.h"
 #include "tblgen/Type.h"
 #include "tblgen/Value.h"
 
+#include <map>
 #include <memory>
+#include <mutex>
+#include <tuple>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 #define unreachable(MSG) assert(false && MSG); __builtin_unreachable()
 
@@ -17,25 +26,70 @@ namespace tblgen {
 
 namespace fs {
    class FileManager;
+   struct OpenFile;
 } // namespace fs
 
 class DiagnosticsEngine;
 class Record;
+class RecordField;
 class RecordKeeper;
 class Class;
+class RecordLayout;
+class RecordIndex;
 
 using TableGenBackend = void(std::ostream&, RecordKeeper&);
 
+/// Thrown instead of exiting on a fatal error if the TableGen instance was
+/// told to, see TableGen::setThrowOnFatalError(). The error was already
+/// reported.
+struct FatalError {};
+
 class TableGen {
+   /// Allocators for the threads that allocate from a frozen instance or
+   /// from a scratch space. Every thread gets one of its own, so that
+   /// allocating doesn't take a lock.
+   class ThreadAllocatorList {
+   public:
+      ThreadAllocatorList();
+
+      /// \return the allocator of the calling thread.
+      support::ArenaAllocator &get();
+
+      /// Print the statistics of all allocators to \p OS, each headed by
+      /// \p Name and its number.
+      void printStats(std::ostream &OS, const char *Name) const;
+
+   private:
+      /// Unique ID of this list, which a thread remembers together with its
+      /// allocator.
+      uint64_t ID;
+
+      std::vector<std::unique_ptr<support::ArenaAllocator>> Allocators;
+      mutable std::mutex Mtx;
+   };
+
 public:
    TableGen(support::ArenaAllocator &Allocator, fs::FileManager &fileMgr,
             DiagnosticsEngine &Diags);
 
+   ~TableGen();
+
+   /// Allocate memory that lives as long as this instance, or as long as
+   /// the attached scratch space, see ScratchSpace. After freeze(), every
+   /// thread allocates from an allocator of its own.
    void *Allocate(size_t size, size_t alignment = 8) const
    {
+      if (Frozen)
+         return getThreadAllocator().Allocate(size, alignment);
+
       return Allocator.Allocate(size, alignment);
    }
 
+   /// Allocate memory that lives as long as this instance, even while a
+   /// scratch space is attached. Used for the entries of caches and for the
+   /// slots of records that are finalized after freeze().
+   void *AllocatePersistent(size_t size, size_t alignment = 8) const;
+
    template <typename T>
    T *Allocate(size_t Num = 1) const
    {
@@ -44,6 +98,8 @@ public:
 
    void Deallocate(void *Ptr) const {}
 
+   /// \return the allocator used before freeze(). It must not be used
+   /// directly afterwards, use Allocate() instead.
    support::ArenaAllocator &getAllocator() const
    {
       return Allocator;
@@ -54,6 +110,48 @@ public:
       return Idents;
    }
 
+   /// Find the file named \p file that is included from the file with ID
+   /// \p sourceId. The result is cached, since resolving an include scans
+   /// the including file's directory.
+   /// \return the full path of the file, or an empty string if it was not
+   /// found.
+   std::string findIncludeFile(std::string_view file, unsigned sourceId);
+
+   /// Register the tokens of the file with ID \p sourceId that were lexed
+   /// ahead of time.
+   void addPrelexedTokens(unsigned sourceId, lex::TokenBuffer &&Toks)
+   {
+      PrelexedTokens.emplace(sourceId, std::move(Toks));
+   }
+
+   /// \return the prelexed tokens of the file with ID \p sourceId, or null
+   /// if the file was not lexed ahead of time.
+   const lex::TokenBuffer *getPrelexedTokens(unsigned sourceId) const
+   {
+      auto it = PrelexedTokens.find(sourceId);
+      if (it == PrelexedTokens.end())
+         return nullptr;
+
+      return &it->second;
+   }
+
+   /// Lex the complete file \p File into a TokenBuffer and register it,
+   /// unless that was already done.
+   /// \return the tokens, or null if the file has lexing errors. Those are
+   /// reported when the file is parsed from its buffer instead.
+   const lex::TokenBuffer *prelexFile(const fs::OpenFile &File);
+
+   /// Whether the parser lexes every file with prelexFile() before parsing
+   /// it.
+   bool shouldPrelexFiles() const { return PrelexFiles; }
+   void setPrelexFiles(bool V) { PrelexFiles = V; }
+
+   /// If true, the parsers throw a FatalError on errors they cannot recover
+   /// from instead of exiting the process. A long running process can then
+   /// discard the affected state and carry on.
+   bool throwsOnFatalError() const { return ThrowOnFatalError; }
+   void setThrowOnFatalError(bool V) { ThrowOnFatalError = V; }
+
    enum RecordFinalizeStatus {
       RFS_Success,
       RFS_MissingFieldValue,
@@ -66,8 +164,151 @@ public:
       SourceLocation declLoc;
    };
 
+   /// The inherited field values of the records that derive from the same
+   /// bases with the same template arguments.
+   struct FinalizePlan {
+      struct Entry {
+         /// The field name.
+         std::string_view Name;
+
+         /// The slot of the field in Layout.
+         unsigned Slot;
+
+         /// The resolved value of the field.
+         Value *Val;
+
+         /// The field, if it has no value unless the record defines it.
+         const RecordField *Missing;
+      };
+
+      /// The layout of the records that use this plan.
+      const RecordLayout *Layout;
+
+      /// The values in the order they are assigned. A later entry for the
+      /// same field replaces an earlier one.
+      std::vector<Entry> Entries;
+
+      /// The indices of the entries of fields that have no value unless the
+      /// record defines them.
+      std::vector<unsigned> MissingEntries;
+   };
+
+   /// Memory that is only needed for a while after freeze(), e.g. while a
+   /// server handles a request. While a scratch space exists, Allocate()
+   /// takes memory from it, which is released when it is destroyed. The
+   /// caches of the instance allocate with AllocatePersistent() instead, so
+   /// only values that are not cached may be allocated from it.
+   class ScratchSpace {
+   public:
+      /// Attach a scratch space to \p TG, which must be frozen. This must
+      /// not be done while other threads use \p TG.
+      explicit ScratchSpace(TableGen &TG);
+
+      /// Detach the scratch space and release its memory. Other threads
+      /// must be done using it.
+      ~ScratchSpace();
+
+      ScratchSpace(const ScratchSpace&) = delete;
+      ScratchSpace &operator=(const ScratchSpace&) = delete;
+
+   private:
+      friend class TableGen;
+
+      TableGen &TG;
+
+      /// The allocators of the threads that allocated from this space.
+      ThreadAllocatorList Allocators;
+
+      /// Finalize plans made while this space was attached, which might
+      /// refer to template arguments allocated from it.
+      std::map<std::vector<const void*>, FinalizePlan> FinalizePlans;
+   };
+
+   /// Assign the inherited field values to \p R and add its name field.
+   /// The values only depend on the bases of \p R and their template
+   /// arguments, so they are resolved once per combination, see
+   /// getFinalizePlan().
+   ///
+   /// With lazy finalization, this only checks that \p R defines every
+   /// field that has no value otherwise, and the values are assigned when
+   /// \p R is first accessed.
    FinalizeResult finalizeRecord(Record &R);
 
+   /// If true, finalizeRecord() defers assigning the values until a record
+   /// is accessed. Backends that only look at some of the records then
+   /// skip the work for the others.
+   bool finalizesLazily() const { return LazyFinalization; }
+   void setLazyFinalization(bool V) { LazyFinalization = V; }
+
+   /// Assign the values of \p R whose finalization was deferred, called by
+   /// Record::ensureFinalized(). Several threads may call this for the
+   /// same record after freeze().
+   void finalizeDeferredRecord(Record &R);
+
+   /// \return the value of the field overridden by the append override
+   /// \p Override, which \p C declares or inherits. The value is computed
+   /// once and shared by all records.
+   Value *getAppendedValue(Class *C, const RecordField *Override);
+
+   /// Assign a unique ID to \p C, used to index sets of classes.
+   unsigned registerClass(Class *C)
+   {
+      ClassesByID.push_back(C);
+      return (unsigned)ClassesByID.size() - 1;
+   }
+
+   /// \return the index of the field \p FieldName over the records of
+   /// \p RK that derive from \p C, which is built on first use and
+   /// extended with the records that were defined since. The field needs to
+   /// exist in \p C and have a type that RecordIndex supports. If
+   /// \p WithOrder is true, the order of the records by the field's value
+   /// is computed as well, see RecordIndex::getOrder().
+   const RecordIndex &getRecordIndex(const RecordKeeper &RK, Class *C,
+                                     std::string_view FieldName,
+                                     bool WithOrder = false);
+
+   /// \return the field layout of records that derive from \p Bases.
+   const RecordLayout *getRecordLayout(const std::vector<Class*> &Bases);
+
+   /// \return the IDs of the direct and indirect bases of a record after
+   /// \p Base is added to the bases with the IDs \p Ancestors, which is
+   /// null for a record without bases. Records with the same list of bases
+   /// share the result.
+   const support::BitVector *getAncestors(const support::BitVector *Ancestors,
+                                          Class *Base);
+
+   /// \return the class with ID \p ID.
+   Class *getClassByID(unsigned ID) const
+   {
+      return ClassesByID[ID];
+   }
+
+   /// Make the records immutable, which has to be done after parsing.
+   ///
+   /// Afterwards, the records and this instance can be used by several
+   /// threads at the same time, e.g. to generate multiple outputs in
+   /// parallel, or by a backend that partitions the records with
+   /// support::parallelFor(). The types of all classes and enums are
+   /// created ahead of time, the type and literal caches are looked up
+   /// without locking, and every thread allocates from its own allocator.
+   void freeze();
+
+   /// \return true if freeze() was called.
+   bool isFrozen() const { return Frozen; }
+
+   /// Print the statistics of all allocators to \p OS.
+   void printAllocatorStats(std::ostream &OS) const;
+
+   /// \return the number of bytes the calling thread allocated with
+   /// Allocate(). Before freeze(), this includes all threads.
+   uint64_t getBytesAllocated() const
+   {
+      if (Frozen)
+         return getThreadAllocator().getBytesAllocated();
+
+      return Allocator.getBytesAllocated();
+   }
+
    support::ArenaAllocator &Allocator;
    fs::FileManager &fileMgr;
    DiagnosticsEngine &Diags;
@@ -76,6 +317,90 @@ public:
 private:
    mutable IdentifierTable Idents;
 
+   /// Set by freeze().
+   bool Frozen = false;
+
+   /// Protect the identifier table and the allocator, and the record
+   /// layouts, the record ancestors and the finalize plans after freeze().
+   mutable std::mutex IdentsMtx;
+   mutable std::mutex LayoutsMtx;
+
+   /// The allocators of the threads that allocated memory after freeze().
+   mutable ThreadAllocatorList ThreadAllocators;
+
+   /// The attached scratch space, if any.
+   ScratchSpace *Scratch = nullptr;
+
+   /// \return the allocator of the calling thread, which belongs to the
+   /// scratch space if one is attached.
+   support::ArenaAllocator &getThreadAllocator() const;
+
+   /// Construct a T from \p Args in memory from AllocatePersistent().
+   template<class T, class ...Args>
+   T *createPersistent(Args &&...args) const
+   {
+      return new(AllocatePersistent(sizeof(T), alignof(T)))
+         T(std::forward<Args>(args)...);
+   }
+
+   /// Cache of resolved include file names, keyed by the including
+   /// directory and the file name separated by a NUL character.
+   std::unordered_map<std::string, std::string> IncludeFileCache;
+
+   /// Tokens of files that were lexed ahead of time.
+   std::unordered_map<unsigned, lex::TokenBuffer> PrelexedTokens;
+
+   /// Set by setPrelexFiles().
+   bool PrelexFiles = false;
+
+   /// Set by setThrowOnFatalError().
+   bool ThrowOnFatalError = false;
+
+   /// Set by setLazyFinalization().
+   bool LazyFinalization = false;
+
+   /// Protects the finalization of records that is done on first access
+   /// after freeze(). Accessing a record while finalizing another one
+   /// takes it again.
+   std::recursive_mutex DeferredFinalizeMtx;
+
+   /// Assign the inherited field values to \p R.
+   FinalizeResult finalizeRecordNow(Record &R);
+
+   /// All classes of all namespaces, indexed by their ID.
+   std::vector<Class*> ClassesByID;
+
+   /// Record layouts, keyed by the list of base classes.
+   std::map<std::vector<Class*>, RecordLayout*> RecordLayouts;
+
+   /// The ancestors of records, keyed by the ancestors before the last base
+   /// was added and that base. Map entries stay where they are, so records
+   /// can point to them.
+   std::map<std::pair<const support::BitVector*, Class*>, support::BitVector>
+      RecordAncestors;
+
+   /// Record indexes, keyed by the namespace, the class and the field.
+   std::map<std::tuple<const RecordKeeper*, Class*, std::string>,
+            std::unique_ptr<RecordIndex>> RecordIndexes;
+
+   /// Protects the record indexes after freeze().
+   std::mutex RecordIndexesMtx;
+
+   /// Add the fields of \p C and its bases to \p Layout, in the order in
+   /// which finalizeRecord() assigns them.
+   void addFieldsToLayout(RecordLayout &Layout, Class *C);
+
+   /// Finalize plans, keyed by the base classes of a record, each followed
+   /// by the number and values of its template arguments.
+   std::map<std::vector<const void*>, FinalizePlan> FinalizePlans;
+
+   /// \return the finalize plan for the bases of \p R.
+   const FinalizePlan &getFinalizePlan(Record &R);
+
+   /// The values of append overrides, keyed by the override. Only used
+   /// while building finalize plans, which is done under LayoutsMtx.
+   std::unordered_map<const RecordField*, Value*> AppendedValues;
+
    mutable IntType Int1Ty;
    mutable IntType Int8Ty;
    mutable IntType UInt8Ty;
@@ -93,14 +418,61 @@ private:
    mutable CodeType CodeTy;
    mutable UndefType UndefTy;
 
-   mutable std::unordered_map<Class*, ClassType>   ClassTypes;
-   mutable std::unordered_map<Record*, RecordType> RecordTypes;
-   mutable std::unordered_map<Enum*, EnumType>     EnumTypes;
-   mutable std::unordered_map<Type*, ListType>     ListTypes;
-   mutable std::unordered_map<Type*, DictType>     DictTypes;
+   mutable support::FreezableMap<Class*, ClassType>   ClassTypes;
+   mutable support::FreezableMap<Record*, RecordType> RecordTypes;
+   mutable support::FreezableMap<Enum*, EnumType>     EnumTypes;
+   mutable support::FreezableMap<Type*, ListType>     ListTypes;
+   mutable support::FreezableMap<Type*, DictType>     DictTypes;
 
    mutable UndefValue Undef;
 
+   /// Key of an interned literal, the literal's type and its value bits.
+   struct LiteralKey {
+      Type *Ty;
+      uint64_t Bits;
+
+      bool operator==(const LiteralKey &RHS) const
+      {
+         return Ty == RHS.Ty && Bits == RHS.Bits;
+      }
+   };
+
+   struct LiteralKeyHash {
+      size_t operator()(const LiteralKey &Key) const
+      {
+         return std::hash<Type*>()(Key.Ty) ^ (Key.Bits * 0x9e3779b97f4a7c15ULL);
+      }
+   };
+
+   /// Key of an interned string literal. The string refers to the one
+   /// owned by the literal.
+   struct StringLiteralKey {
+      Type *Ty;
+      std::string_view Str;
+
+      bool operator==(const StringLiteralKey &RHS) const
+      {
+         return Ty == RHS.Ty && Str == RHS.Str;
+      }
+   };
+
+   struct StringLiteralKeyHash {
+      size_t operator()(const StringLiteralKey &Key) const
+      {
+         return std::hash<Type*>()(Key.Ty)
+            ^ std::hash<std::string_view>()(Key.Str);
+      }
+   };
+
+   /// Interned literals. Floating point values are keyed by their bit
+   /// pattern.
+   support::FreezableMap<LiteralKey, IntegerLiteral*, LiteralKeyHash>
+      IntLiterals;
+   support::FreezableMap<LiteralKey, FPLiteral*, LiteralKeyHash>
+      FPLiterals;
+   support::FreezableMap<StringLiteralKey, StringLiteral*,
+                         StringLiteralKeyHash> StringLiterals;
+
 public:
    IntType *getInt1Ty() const { return &Int1Ty; }
 
@@ -149,52 +521,55 @@ public:
 
    ClassType *getClassType(Class *C) const
    {
-      auto it = ClassTypes.find(C);
-      if (it != ClassTypes.end())
-         return &it->second;
+      if (auto *Ty = ClassTypes.find(C))
+         return Ty;
 
-      return &ClassTypes.try_emplace(C, ClassType(C)).first->second;
+      return &ClassTypes.insert(C, ClassType(C));
    }
 
    RecordType *getRecordType(Record *R) const
    {
-      auto it = RecordTypes.find(R);
-      if (it != RecordTypes.end())
-         return &it->second;
+      if (auto *Ty = RecordTypes.find(R))
+         return Ty;
 
-      return &RecordTypes.try_emplace(R, RecordType(R)).first->second;
+      return &RecordTypes.insert(R, RecordType(R));
    }
 
    EnumType *getEnumType(Enum *E) const
    {
-      auto it = EnumTypes.find(E);
-      if (it != EnumTypes.end())
-         return &it->second;
+      if (auto *Ty = EnumTypes.find(E))
+         return Ty;
 
-      return &EnumTypes.try_emplace(E, EnumType(E)).first->second;
+      return &EnumTypes.insert(E, EnumType(E));
    }
 
    ListType *getListType(Type *ElementTy) const
    {
-      auto it = ListTypes.find(ElementTy);
-      if (it != ListTypes.end())
-         return &it->second;
+      if (auto *Ty = ListTypes.find(ElementTy))
+         return Ty;
 
-      return &ListTypes.try_emplace(ElementTy,
-                                    ListType(ElementTy)).first->second;
+      return &ListTypes.insert(ElementTy, ListType(ElementTy));
    }
 
-   DictType *getDictType(Type *ElementTy)
+   DictType *getDictType(Type *ElementTy) const
    {
-      auto it = DictTypes.find(ElementTy);
-      if (it != DictTypes.end())
-         return &it->second;
+      if (auto *Ty = DictTypes.find(ElementTy))
+         return Ty;
 
-      return &DictTypes.try_emplace(ElementTy,
-                                    DictType(ElementTy)).first->second;
+      return &DictTypes.insert(ElementTy, DictType(ElementTy));
    }
 
    UndefValue *getUndef() const { return &Undef; }
+
+   /// \return the unique integer literal of type \p Ty with value \p Val.
+   IntegerLiteral *getIntegerLiteral(Type *Ty, uint64_t Val);
+
+   /// \return the unique floating point literal of type \p Ty with value
+   /// \p Val.
+   FPLiteral *getFPLiteral(Type *Ty, double Val);
+
+   /// \return the unique string literal of type \p Ty with value \p Val.
+   StringLiteral *getStringLiteral(Type *Ty, std::string_view Val);
 };
 
 } // namespace tblgen
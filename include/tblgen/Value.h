@@ -58,15 +58,14 @@ protected:
 };
 
 class IntegerLiteral: public Value {
-public:
-   explicit IntegerLiteral(Type *Ty, uint64_t Val)
-      : Value(IntegerLiteralID, Ty), Val(Val)
-   { }
+   // Literals are unique, use TableGen::getIntegerLiteral().
+   friend class TableGen;
 
-   explicit IntegerLiteral(Type *Ty, int64_t Val)
+   explicit IntegerLiteral(Type *Ty, uint64_t Val)
       : Value(IntegerLiteralID, Ty), Val(Val)
    { }
 
+public:
    uint64_t getVal() const
    {
       return Val;
@@ -80,11 +79,14 @@ private:
 };
 
 class FPLiteral: public Value {
-public:
+   // Literals are unique, use TableGen::getFPLiteral().
+   friend class TableGen;
+
    explicit FPLiteral(Type *Ty, double Val)
       : Value(FPLiteralID, Ty), Val(Val)
    { }
 
+public:
    double getVal() const
    {
       return Val;
@@ -98,11 +100,14 @@ private:
 };
 
 class StringLiteral: public Value {
-public:
-   explicit StringLiteral(Type *Ty, std::string &&Val)
+   // Literals are unique, use TableGen::getStringLiteral().
+   friend class TableGen;
+
+   explicit StringLiteral(Type *Ty, std::string_view Val)
       : Value(StringLiteralID, Ty), Val(Val)
    { }
 
+public:
    const std::string &getVal() const
    {
       return Val;
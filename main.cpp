@@ -1,17 +1,34 @@
 
 #include "tblgen/Backend/TableGenBackends.h"
 #include "tblgen/Basic/FileManager.h"
+#include "tblgen/Basic/FileUtils.h"
+#include "tblgen/Basic/OutputCache.h"
+#include "tblgen/Basic/OutputFile.h"
+#include "tblgen/Lex/ParallelIncludeLexer.h"
 #include "tblgen/Message/DiagnosticsEngine.h"
 #include "tblgen/Parser.h"
 #include "tblgen/Record.h"
+#include "tblgen/Serialization/BinaryFormat.h"
+#include "tblgen/Serialization/BinaryReader.h"
 #include "tblgen/Support/Allocator.h"
 #include "tblgen/Support/DynamicLibrary.h"
+#include "tblgen/Support/FileWatcher.h"
+#include "tblgen/Support/Hashing.h"
+#include "tblgen/Support/MemoryBuffer.h"
+#include "tblgen/Support/Socket.h"
 #include "tblgen/Support/StringSwitch.h"
+#include "tblgen/Support/ThreadPool.h"
+#include "tblgen/Support/Timer.h"
 #include "tblgen/TableGen.h"
 
+#include <filesystem>
 #include <iostream>
+#include <memory>
 #include <sstream>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 using namespace tblgen;
 using namespace tblgen::diag;
@@ -21,11 +38,15 @@ using std::string;
 
 namespace {
 
+/// The version of TblGen, also used to invalidate the output cache.
+constexpr const char *TblGenVersion = "0.3";
+
 enum Backend {
    B_Template,
    B_Custom,
    B_PrintRecords,
    B_EmitClassHierarchy,
+   B_EmitBinary,
 };
 
 /// Transform a pass name argument into the symbol name to search for, e.g.
@@ -55,10 +76,8 @@ string symbolFromPassName(string passName)
    return s;
 }
 
-struct Options {
-   /// The definition (*.tg) file.
-   string tgFile;
-
+/// A single output of an invocation, produced by a backend or a template.
+struct OutputOptions {
    /// The file to print the output to. If empty, use stdout.
    string outFile;
 
@@ -75,24 +94,92 @@ struct Options {
    string templateFile;
 };
 
+struct Options {
+   /// The definition (*.tg) file.
+   string tgFile;
+
+   /// The outputs to produce, in command line order.
+   std::vector<OutputOptions> outputs;
+
+   /// If true, print allocator statistics to stderr after running.
+   bool printMemoryStats = false;
+
+   /// If true, lex included files on a thread pool before parsing.
+   bool parallelIncludes = false;
+
+   /// If true, lex every file into a token buffer before parsing it.
+   bool prelex = false;
+
+   /// If true, assign the inherited field values of a record when it is
+   /// first accessed instead of when it is parsed.
+   bool lazyFinalize = false;
+
+   /// The number of worker threads, or zero to use one per hardware thread.
+   unsigned numThreads = 0;
+
+   /// The directory to cache outputs in. If empty, caching is disabled.
+   string cacheDir;
+
+   /// If true, print the time spent in each phase to stderr.
+   bool timeReport = false;
+
+   /// The file to write a Chrome trace of the phases to, if not empty.
+   string timeTraceFile;
+};
+
 void printHelpDialog(std::ostream &OS)
 {
    OS << "TblGen, a tool for structured code generation\n"
-      << "Version 0.3, Copyright 2019 by Jonas Zell\n"
+      << "Version " << TblGenVersion << ", Copyright 2019 by Jonas Zell\n"
       << "Usage: tblgen <definition file> <backend> [<backend library>] [-o <output file>]\n"
+      << "       tblgen <definition file> -t <template> [-o <output file>]\n"
+      << "The definition file can also be a file written by -emit-binary.\n"
+      << "Several backends and templates can be given, each followed by its\n"
+      << "own -o. The definitions are parsed once and the outputs are\n"
+      << "generated in parallel.\n"
+      << "Options:\n"
+      << "  -print-memory-stats   print allocator statistics to stderr\n"
+      << "  -parallel-includes    lex included files in parallel\n"
+      << "  -prelex               lex each file completely before parsing it\n"
+      << "  -lazy-finalize        resolve inherited fields of a record on first use\n"
+      << "  -j <N>                number of worker threads to use\n"
+      << "  -cache-dir <dir>      reuse outputs of previous runs with unchanged inputs\n"
+      << "  -time-report          print the time spent in each phase to stderr\n"
+      << "  -time-trace <file>    write a Chrome trace of the phases to <file>\n"
+      << "Watch mode:\n"
+      << "  tblgen --watch <args>              run tblgen <args> again whenever one\n"
+      << "                                     of the files it read changes\n"
+      << "Server mode:\n"
+      << "  tblgen --serve <socket>            keep parsed definitions in memory and\n"
+      << "                                     run requests sent to <socket>\n"
+      << "  tblgen --client <socket> <args>    let the server run tblgen <args>, or\n"
+      << "                                     run it directly if there is no server\n"
+      << "  tblgen --stop-server <socket>      stop the server listening on <socket>\n"
       << "Refer to /examples for example usage.\n";
 }
 
 Options parseOptions(DiagnosticsEngine &Diags, int argc, char **argv)
 {
    Options opts{};
+
+   // An -o that appears before any backend applies to the first one.
+   string pendingOutFile;
+   bool hasPendingOutFile = false;
+
+   auto addOutput = [&]() -> OutputOptions& {
+      auto &output = opts.outputs.emplace_back();
+      output.outFile = move(pendingOutFile);
+
+      pendingOutFile.clear();
+      hasPendingOutFile = false;
+
+      return output;
+   };
+
    for (int i = 1; i < argc; ++i) {
       string arg(argv[i]);
       if (arg.front() == '-') {
          if (arg == "-o") {
-            if (!opts.outFile.empty())
-               Diags.Diag(err_generic_error) << "output file already specified";
-
             if (++i == argc) {
                Diags.Diag(err_generic_error)
                    << "expecting output filename after -o";
@@ -100,7 +187,21 @@ Options parseOptions(DiagnosticsEngine &Diags, int argc, char **argv)
                break;
             }
 
-            opts.outFile = argv[i];
+            if (opts.outputs.empty()) {
+               if (hasPendingOutFile)
+                  Diags.Diag(err_generic_error)
+                     << "output file already specified";
+
+               pendingOutFile = argv[i];
+               hasPendingOutFile = true;
+            }
+            else if (!opts.outputs.back().outFile.empty()) {
+               Diags.Diag(err_generic_error)
+                  << "output file already specified";
+            }
+            else {
+               opts.outputs.back().outFile = argv[i];
+            }
          }
          else if (arg == "-t") {
             if (++i == argc) {
@@ -110,21 +211,69 @@ Options parseOptions(DiagnosticsEngine &Diags, int argc, char **argv)
                break;
             }
 
-            opts.templateFile = argv[i];
-            opts.backend = B_Template;
+            auto &output = addOutput();
+            output.templateFile = argv[i];
+            output.backend = B_Template;
+         }
+         else if (arg == "-print-memory-stats") {
+            opts.printMemoryStats = true;
+         }
+         else if (arg == "-parallel-includes") {
+            opts.parallelIncludes = true;
+         }
+         else if (arg == "-prelex") {
+            opts.prelex = true;
+         }
+         else if (arg == "-lazy-finalize") {
+            opts.lazyFinalize = true;
+         }
+         else if (arg == "-time-report") {
+            opts.timeReport = true;
+         }
+         else if (arg == "-time-trace") {
+            if (++i == argc) {
+               Diags.Diag(err_generic_error)
+                  << "expecting filename after -time-trace";
+
+               break;
+            }
+
+            opts.timeTraceFile = argv[i];
+         }
+         else if (arg == "-cache-dir") {
+            if (++i == argc) {
+               Diags.Diag(err_generic_error)
+                  << "expecting directory after -cache-dir";
+
+               break;
+            }
+
+            opts.cacheDir = argv[i];
+         }
+         else if (arg == "-j") {
+            if (++i == argc) {
+               Diags.Diag(err_generic_error)
+                  << "expecting number of threads after -j";
+
+               break;
+            }
+
+            opts.numThreads = (unsigned)std::strtoul(argv[i], nullptr, 10);
          }
          else if (arg == "--help" || arg == "--version") {
             printHelpDialog(std::cout);
          }
          else {
-            opts.backendName = arg;
-            opts.backend
-                = StringSwitch<Backend>(opts.backendName)
+            auto &output = addOutput();
+            output.backendName = arg;
+            output.backend
+                = StringSwitch<Backend>(output.backendName)
                       .Case("-print-records", B_PrintRecords)
                       .Case("-emit-class-hierarchy", B_EmitClassHierarchy)
+                      .Case("-emit-binary", B_EmitBinary)
                       .Default(B_Custom);
 
-            if (opts.backend == B_Custom) {
+            if (output.backend == B_Custom) {
                if (++i >= argc) {
                   Diags.Diag(err_generic_error)
                       << "expecting shared library file name";
@@ -132,7 +281,7 @@ Options parseOptions(DiagnosticsEngine &Diags, int argc, char **argv)
                   break;
                }
 
-               opts.customBackendLib = argv[i];
+               output.customBackendLib = argv[i];
             }
          }
       }
@@ -146,9 +295,82 @@ Options parseOptions(DiagnosticsEngine &Diags, int argc, char **argv)
       }
    }
 
+   // Print the records if no backend was specified.
+   if (opts.outputs.empty()) {
+      addOutput();
+   }
+
+   // Outputs are written concurrently, so no file may be written twice.
+   std::unordered_set<string> outFiles;
+   for (auto &output : opts.outputs) {
+      if (!output.outFile.empty() && !outFiles.insert(output.outFile).second) {
+         Diags.Diag(err_generic_error)
+            << "output file '" + output.outFile + "' specified more than once";
+      }
+   }
+
    return opts;
 }
 
+/// Compute the key for the output cache. It has to cover every option that
+/// influences the output; the contents of the input files are checked
+/// separately.
+uint64_t computeCacheKey(const Options &opts, const OutputOptions &output)
+{
+   std::error_code ec;
+   auto cwd = std::filesystem::current_path(ec).u8string();
+
+   uint64_t hash = support::FNVOffsetBasis;
+   hash = support::hashFNV1aField(TblGenVersion, hash);
+   hash = support::hashFNV1aField(cwd, hash);
+   hash = support::hashFNV1aField(opts.tgFile, hash);
+   hash = support::hashFNV1aField(std::to_string(output.backend), hash);
+   hash = support::hashFNV1aField(output.backendName, hash);
+   hash = support::hashFNV1aField(output.customBackendLib, hash);
+   hash = support::hashFNV1aField(output.templateFile, hash);
+
+   return hash;
+}
+
+/// Write the cached output in \p cachedFile to the output file, or to stdout
+/// if none was specified. The output file is only touched if its contents
+/// change.
+bool emitCachedOutput(DiagnosticsEngine &Diags, const OutputOptions &output,
+                      const std::string &cachedFile)
+{
+   TimeRegion Timer("Write output", {}, output.outFile);
+
+   std::string errMsg;
+   auto Buf = support::MemoryBuffer::getFile(cachedFile, true, &errMsg);
+
+   if (!Buf.isValid()) {
+      Diags.Diag(err_generic_error)
+         << "could not read cached output: " + errMsg;
+
+      return false;
+   }
+
+   if (output.outFile.empty()) {
+      std::cout << Buf.getBuffer();
+      return true;
+   }
+
+   fs::OutputFile OS;
+   if (!OS.open(output.outFile, &errMsg)) {
+      Diags.Diag(err_generic_error) << errMsg;
+      return false;
+   }
+
+   OS << Buf.getBuffer();
+
+   if (!OS.commit(&errMsg)) {
+      Diags.Diag(err_generic_error) << errMsg;
+      return false;
+   }
+
+   return true;
+}
+
 class TblGenDiagConsumer : public DiagnosticConsumer {
 public:
    void HandleDiagnostic(const Diagnostic &Diag) override
@@ -158,17 +380,491 @@ public:
    }
 };
 
-} // anonymous namespace
+/// An output that is generated by this invocation.
+struct PendingOutput {
+   explicit PendingOutput(const OutputOptions &opts) : opts(opts)
+   {}
 
-extern "C" void __asan_version_mismatch_check_apple_clang_1100() {}
+   const OutputOptions &opts;
 
-int main(int argc, char **argv)
+   /// The output cache entry, if caching is enabled.
+   std::unique_ptr<fs::OutputCache> Cache;
+
+   /// The file holding the cached output, if there is one.
+   string cachedFile;
+
+   /// The stream the output is written to.
+   fs::OutputFile OS;
+
+   /// The compiled template, if a template is used.
+   std::unique_ptr<TemplateParser> Template;
+
+   /// The library containing the custom backend, and its entry point.
+   std::unique_ptr<DynamicLibrary> DyLib;
+   TableGenBackend *CustomBackend = nullptr;
+
+   /// Set if generating the output failed.
+   bool failed = false;
+
+   /// Set in watch mode if none of the inputs of the output changed since
+   /// the previous run.
+   bool upToDate = false;
+};
+
+/// Open the output file of \p output, and load its custom backend or
+/// compile its template.
+bool prepareOutput(TableGen &TG, PendingOutput &output)
 {
-   if (argc == 1) {
-      printHelpDialog(std::cout);
-      return 0;
+   auto &Diags = TG.Diags;
+   std::string errMsg;
+
+   // The output is streamed to a temporary file that only replaces the
+   // actual file once it is complete, so that the actual file is not
+   // affected if TblGen crashes.
+   if (!output.OS.open(output.opts.outFile, &errMsg)) {
+      Diags.Diag(err_generic_error) << errMsg;
+      return false;
+   }
+
+   switch (output.opts.backend) {
+   case B_Custom: {
+      output.DyLib = std::make_unique<DynamicLibrary>(
+         DynamicLibrary::Open(output.opts.customBackendLib, &errMsg));
+
+      if (!errMsg.empty()) {
+         Diags.Diag(err_generic_error) << "error opening dylib: " + errMsg;
+
+         return false;
+      }
+
+      auto Sym = symbolFromPassName(output.opts.backendName);
+      void *Ptr = output.DyLib->getAddressOfSymbol(Sym);
+
+      if (!Ptr) {
+         Diags.Diag(err_generic_error)
+             << "dylib does not contain symbol '" + Sym + "'";
+
+         return false;
+      }
+
+      output.CustomBackend = reinterpret_cast<TableGenBackend*>(Ptr);
+      break;
+   }
+   case B_Template: {
+      TimeRegion Timer("Compile template", {}, output.opts.templateFile);
+
+      auto maybeTemplateBuf = TG.fileMgr.openFile(output.opts.templateFile);
+      if (!maybeTemplateBuf) {
+         Diags.Diag(err_generic_error)
+            << "file not found: " + output.opts.templateFile;
+
+         return false;
+      }
+
+      auto &templateBuf = maybeTemplateBuf.getValue();
+      output.Template = std::make_unique<TemplateParser>(
+         TG, templateBuf.Buf, templateBuf.SourceId, templateBuf.BaseOffset);
+
+      if (!output.Template->compileTemplate()) {
+         return false;
+      }
+
+      break;
+   }
+   default:
+      break;
+   }
+
+   return true;
+}
+
+/// Generate \p output. This only reads the records, so several outputs can
+/// be generated at the same time.
+void generateOutput(TableGen &TG, PendingOutput &output)
+{
+   auto &RK = *TG.GlobalRK;
+   auto &OS = output.OS;
+
+   std::string_view name;
+   switch (output.opts.backend) {
+   case B_Template: name = output.opts.templateFile; break;
+   case B_PrintRecords: name = "-print-records"; break;
+   default: name = output.opts.backendName; break;
+   }
+
+   TimeRegion Timer("Backend", name);
+
+   switch (output.opts.backend) {
+   case B_Custom:
+      output.CustomBackend(OS, RK);
+      break;
+   case B_PrintRecords:
+      PrintRecords(OS, RK);
+      break;
+   case B_EmitClassHierarchy:
+      EmitClassHierarchy(OS, RK);
+      break;
+   case B_EmitBinary:
+      EmitBinary(OS, RK);
+      break;
+   case B_Template:
+      // Fatal errors only throw in server mode, where this might run on a
+      // worker thread.
+      try {
+         output.failed = !output.Template->emitTemplate(OS);
+      }
+      catch (FatalError&) {
+         output.failed = true;
+      }
+
+      break;
+   }
+}
+
+
+/// Print the time report and write the trace file, if they were requested.
+bool finishTimeReport(DiagnosticsEngine &Diags, const Options &opts,
+                      TimeReport *Report)
+{
+   if (!Report) {
+      return true;
+   }
+
+   Report->setArenaCounter(nullptr);
+   if (opts.timeReport) {
+      Report->print(std::cerr);
+   }
+
+   if (opts.timeTraceFile.empty()) {
+      return true;
+   }
+
+   std::string errMsg;
+   fs::OutputFile OS;
+   if (!OS.open(opts.timeTraceFile, &errMsg)) {
+      Diags.Diag(err_generic_error) << errMsg;
+      return false;
+   }
+
+   Report->writeTrace(OS);
+
+   if (!OS.commit(&errMsg)) {
+      Diags.Diag(err_generic_error) << errMsg;
+      return false;
+   }
+
+   return true;
+}
+
+/// Load the definitions in \p buf into \p TG.
+bool loadDefinitions(TableGen &TG, const Options &opts,
+                     const fs::OpenFile &buf)
+{
+   // Records that were serialized by -emit-binary are loaded directly,
+   // without lexing or parsing anything.
+   if (serial::isBinaryRecordFile(buf.Buf)) {
+      std::string errMsg;
+      if (!serial::readBinaryRecords(TG, buf.Buf, &errMsg)) {
+         TG.Diags.Diag(err_generic_error) << opts.tgFile + ": " + errMsg;
+         return false;
+      }
+
+      return true;
+   }
+
+   TG.setLazyFinalization(opts.lazyFinalize);
+
+   // With -prelex, foreach bodies are replayed from the token buffer
+   // instead of being copied for every element.
+   const lex::TokenBuffer *Toks = nullptr;
+   if (opts.prelex) {
+      TG.setPrelexFiles(true);
+      Toks = TG.prelexFile(buf);
+   }
+
+   Parser parser = Toks
+      ? Parser(TG, *Toks, buf.SourceId, buf.BaseOffset)
+      : Parser(TG, buf.Buf, buf.SourceId, buf.BaseOffset);
+
+   if (opts.parallelIncludes) {
+      lex::ParallelIncludeLexer(TG, opts.numThreads).run(buf);
+   }
+
+   return parser.parse();
+}
+
+/// The size and modification time of a file, which are checked to find out
+/// whether a file might have changed without reading it.
+struct FileStamp {
+   std::uintmax_t size = 0;
+   std::filesystem::file_time_type mtime;
+
+   bool operator==(const FileStamp &other) const
+   {
+      return size == other.size && mtime == other.mtime;
+   }
+};
+
+bool getFileStamp(const string &fileName, FileStamp &stamp)
+{
+   std::error_code ec;
+   stamp.size = std::filesystem::file_size(fileName, ec);
+   if (ec) {
+      return false;
+   }
+
+   stamp.mtime = std::filesystem::last_write_time(fileName, ec);
+   return !ec;
+}
+
+/// Parsed definitions that a server keeps between requests, together with
+/// everything they refer to.
+struct Session {
+   Session()
+      : Diags(Allocator, &Consumer, &FileMgr), TG(Allocator, FileMgr, Diags)
+   {
+      // The files might be edited while the session is alive.
+      FileMgr.setUseMemoryMapping(false);
+      TG.setThrowOnFatalError(true);
+   }
+
+   fs::FileManager FileMgr;
+   TblGenDiagConsumer Consumer;
+   ArenaAllocator Allocator;
+   DiagnosticsEngine Diags;
+   TableGen TG;
+
+   /// The diagnostic counts after loading the definitions, restored before
+   /// every request.
+   DiagnosticsEngine::DiagState LoadedState;
+
+   /// The files the definitions were loaded from. If one of them changes,
+   /// the session is discarded. Other open files are templates, which are
+   /// only closed.
+   std::unordered_set<string> DefinitionFiles;
+
+   /// The stamps of the open files, taken at the time they were read.
+   std::unordered_map<string, FileStamp> Stamps;
+};
+
+/// The sessions of a server or of watch mode, keyed by the absolute path of
+/// their definition file.
+class SessionCache {
+   std::unordered_map<string, std::unique_ptr<Session>> Sessions;
+
+   /// The files that were opened the last time definitions were loaded,
+   /// even if loading failed.
+   std::vector<string> LastDefinitionFiles;
+
+   /// Set if the last call to getDefinitions() loaded the definitions.
+   bool DefinitionsReloaded = false;
+
+   /// The files that changed since the previous run in watch mode, or null
+   /// if every output has to be generated.
+   const std::unordered_set<string> *ChangedFiles = nullptr;
+
+   /// The workers that generate the outputs of a request in parallel,
+   /// which are kept for later requests.
+   std::unique_ptr<ThreadPool> Pool;
+
+   /// Close the templates of \p S that changed since they were read.
+   /// \return false if one of the definition files changed.
+   bool revalidate(Session &S);
+
+public:
+   /// \return the definitions for \p opts, which are parsed again if one of
+   /// their files changed since the last request, or null if they could not
+   /// be loaded.
+   TableGen *getDefinitions(const Options &opts, DiagnosticsEngine &Diags);
+
+   /// \return the files that were opened the last time definitions were
+   /// loaded.
+   const std::vector<string> &getLastDefinitionFiles() const
+   {
+      return LastDefinitionFiles;
+   }
+
+   /// Only generate the outputs that depend on one of \p Files from now on,
+   /// or every output if \p Files is null.
+   void setChangedFiles(const std::unordered_set<string> *Files)
+   {
+      ChangedFiles = Files;
+   }
+
+   /// \return true if \p output has to be generated, see setChangedFiles().
+   /// Must be called after getDefinitions().
+   bool isAffected(const OutputOptions &output) const;
+
+   /// \return a pool with \p NumThreads workers, which is reused by later
+   /// requests that ask for the same number.
+   ThreadPool &getThreadPool(unsigned NumThreads)
+   {
+      if (!Pool || Pool->getNumThreads() != NumThreads) {
+         Pool = std::make_unique<ThreadPool>(NumThreads);
+      }
+
+      return *Pool;
+   }
+};
+
+bool SessionCache::revalidate(Session &S)
+{
+   std::vector<string> changedTemplates;
+   for (auto &Entry : S.FileMgr.getSourceFiles()) {
+      auto &fileName = Entry.first;
+      auto it = S.Stamps.find(fileName);
+
+      FileStamp stamp;
+      bool exists = getFileStamp(fileName, stamp);
+
+      if (exists && it != S.Stamps.end()) {
+         if (it->second == stamp) {
+            continue;
+         }
+
+         // The file was touched, compare its contents.
+         auto Buf = support::MemoryBuffer::getFile(fileName, false);
+         if (Buf.isValid()
+               && Buf.getBuffer() == Entry.second->Buf.getBuffer()) {
+            it->second = stamp;
+            continue;
+         }
+      }
+
+      if (S.DefinitionFiles.count(fileName) != 0) {
+         return false;
+      }
+
+      changedTemplates.push_back(fileName);
+   }
+
+   for (auto &fileName : changedTemplates) {
+      S.FileMgr.closeFile(fileName);
+      S.Stamps.erase(fileName);
+   }
+
+   return true;
+}
+
+TableGen *SessionCache::getDefinitions(const Options &opts,
+                                       DiagnosticsEngine &Diags)
+{
+   auto &S = Sessions[opts.tgFile];
+   if (S && !revalidate(*S)) {
+      S = nullptr;
+   }
+
+   DefinitionsReloaded = !S;
+
+   if (!S) {
+      TimeRegion Timer("Load definitions", {}, opts.tgFile);
+      S = std::make_unique<Session>();
+
+      FileStamp stamp;
+      bool exists = getFileStamp(opts.tgFile, stamp);
+
+      auto maybeBuf = S->FileMgr.openFile(opts.tgFile);
+      if (!exists || !maybeBuf) {
+         Diags.Diag(err_generic_error) << "file not found: " + opts.tgFile;
+         Sessions.erase(opts.tgFile);
+
+         return nullptr;
+      }
+
+      bool loaded;
+      try {
+         loaded = loadDefinitions(S->TG, opts, maybeBuf.getValue());
+      }
+      catch (FatalError&) {
+         loaded = false;
+      }
+
+      LastDefinitionFiles.clear();
+      for (auto &Entry : S->FileMgr.getSourceFiles()) {
+         LastDefinitionFiles.push_back(Entry.first);
+      }
+
+      if (!loaded) {
+         Sessions.erase(opts.tgFile);
+         return nullptr;
+      }
+
+      S->TG.freeze();
+      S->LoadedState = S->Diags.saveState();
+
+      // Included files are only known after parsing, so their stamps are
+      // taken afterwards.
+      S->Stamps[opts.tgFile] = stamp;
+      for (auto &Entry : S->FileMgr.getSourceFiles()) {
+         S->DefinitionFiles.insert(Entry.first);
+         if (S->Stamps.count(Entry.first) == 0
+               && getFileStamp(Entry.first, stamp)) {
+            S->Stamps[Entry.first] = stamp;
+         }
+      }
+   }
+   else {
+      S->Diags.restoreState(S->LoadedState);
+   }
+
+   // Templates are stamped before they are read, so that a change while
+   // they are read is noticed by the next request.
+   for (auto &output : opts.outputs) {
+      auto &fileName = output.templateFile;
+      if (fileName.empty() || S->Stamps.count(fileName) != 0) {
+         continue;
+      }
+
+      FileStamp stamp;
+      if (getFileStamp(fileName, stamp)) {
+         S->Stamps[fileName] = stamp;
+      }
+   }
+
+   return &S->TG;
+}
+
+bool SessionCache::isAffected(const OutputOptions &output) const
+{
+   if (!ChangedFiles || DefinitionsReloaded) {
+      return true;
    }
 
+   switch (output.backend) {
+   case B_Template:
+      return ChangedFiles->count(output.templateFile) != 0;
+   case B_Custom: {
+      std::error_code ec;
+      auto lib = std::filesystem::absolute(output.customBackendLib, ec);
+
+      return ChangedFiles->count(lib.u8string()) != 0;
+   }
+   default:
+      return false;
+   }
+}
+
+/// Make the paths of the definition file and the templates in \p opts
+/// absolute.
+void makePathsAbsolute(Options &opts)
+{
+   std::error_code ec;
+   opts.tgFile = std::filesystem::absolute(opts.tgFile, ec).u8string();
+
+   for (auto &output : opts.outputs) {
+      if (!output.templateFile.empty()) {
+         output.templateFile
+            = std::filesystem::absolute(output.templateFile, ec).u8string();
+      }
+   }
+}
+
+/// Run TblGen with the command line arguments \p argv. If \p Sessions is
+/// given, this is a request to a server, which takes the definitions from
+/// its sessions.
+/// \return the exit code.
+int runTblGen(int argc, char **argv, SessionCache *Sessions = nullptr)
+{
    fs::FileManager FileMgr;
    TblGenDiagConsumer Consumer;
 
@@ -180,102 +876,496 @@ int main(int argc, char **argv)
       return 1;
    }
 
+   // Phases are only timed while a report exists.
+   std::unique_ptr<TimeReport> Report;
+   if (opts.timeReport || !opts.timeTraceFile.empty()) {
+      Report = std::make_unique<TimeReport>(!opts.timeTraceFile.empty());
+   }
+
    if (opts.tgFile.empty()) {
       Diags.Diag(err_generic_error) << "no input file specified";
       return 1;
    }
 
-   auto maybeBuf = FileMgr.openFile(opts.tgFile);
-   if (!maybeBuf) {
-      Diags.Diag(err_generic_error) << "file not found: " + opts.tgFile;
-      return 1;
+   // A server is shared by clients in different directories, so the files
+   // it keeps open are identified by their absolute path.
+   if (Sessions) {
+      makePathsAbsolute(opts);
    }
 
-   auto &buf = maybeBuf.getValue();
-   TableGen TG(Allocator, FileMgr, Diags);
-   Parser parser(TG, buf.Buf, buf.SourceId, buf.BaseOffset);
+   // Values that a request to a server computes from the definitions of a
+   // session are released when it ends, see TableGen::ScratchSpace. The
+   // compiled templates refer to them, so this outlives the outputs.
+   std::unique_ptr<TableGen::ScratchSpace> Scratch;
 
-   if (!parser.parse()) {
-      return 1;
+   std::vector<std::unique_ptr<PendingOutput>> outputs;
+   for (auto &output : opts.outputs) {
+      outputs.push_back(std::make_unique<PendingOutput>(output));
    }
 
-   // use a string stream first so that the actual file is not affected if
-   // TblGen crashes
-   std::stringstream OS;
+   // Outputs with a cache hit are copied from the cache; the definitions
+   // only need to be parsed if there is at least one miss.
+   bool allCached = !opts.cacheDir.empty();
+   if (!opts.cacheDir.empty()) {
+      for (auto &output : outputs) {
+         output->Cache = std::make_unique<fs::OutputCache>(
+            opts.cacheDir, computeCacheKey(opts, output->opts));
 
-   auto &RK = *TG.GlobalRK;
-   switch (opts.backend) {
-   case B_Custom: {
-      std::string errMsg;
-      auto DyLib = DynamicLibrary::Open(opts.customBackendLib, &errMsg);
+         if (output->opts.backend == B_Custom) {
+            output->Cache->addInput(output->opts.customBackendLib);
+         }
 
-      if (!errMsg.empty()) {
-         Diags.Diag(err_generic_error) << "error opening dylib: " + errMsg;
+         if (!output->Cache->lookup(output->cachedFile)) {
+            output->cachedFile.clear();
+            allCached = false;
+         }
+      }
+   }
+
+   if (allCached) {
+      for (auto &output : outputs) {
+         if (!emitCachedOutput(Diags, output->opts, output->cachedFile)) {
+            return 1;
+         }
+      }
+
+      return finishTimeReport(Diags, opts, Report.get()) ? 0 : 1;
+   }
+
+   TableGen *TG;
+   std::unique_ptr<TableGen> LocalTG;
 
+   if (Sessions) {
+      TG = Sessions->getDefinitions(opts, Diags);
+      if (!TG) {
          return 1;
       }
 
-      auto Sym = symbolFromPassName(opts.backendName);
-      void *Ptr = DyLib.getAddressOfSymbol(Sym);
+      Scratch = std::make_unique<TableGen::ScratchSpace>(*TG);
 
-      if (!Ptr) {
-         Diags.Diag(err_generic_error)
-             << "dylib does not contain symbol '" + Sym + "'";
+      for (auto &output : outputs) {
+         output->upToDate = !Sessions->isAffected(output->opts);
+      }
 
+      if (Report) {
+         Report->setArenaCounter([TG] { return TG->getBytesAllocated(); });
+      }
+   }
+   else {
+      auto maybeBuf = FileMgr.openFile(opts.tgFile);
+      if (!maybeBuf) {
+         Diags.Diag(err_generic_error) << "file not found: " + opts.tgFile;
          return 1;
       }
 
-      auto Backend
-          = reinterpret_cast<void (*)(std::ostream &, RecordKeeper &)>(
-              Ptr);
+      LocalTG = std::make_unique<TableGen>(Allocator, FileMgr, Diags);
+      TG = LocalTG.get();
 
-      Backend(OS, RK);
-      break;
+      if (Report) {
+         Report->setArenaCounter([TG] { return TG->getBytesAllocated(); });
+      }
+
+      if (!loadDefinitions(*TG, opts, maybeBuf.getValue())) {
+         return 1;
+      }
+
+      // The records are not modified anymore, which allows generating the
+      // outputs in parallel.
+      TG->freeze();
    }
-   case B_PrintRecords:
-      PrintRecords(OS, RK);
-      break;
-   case B_EmitClassHierarchy:
-      EmitClassHierarchy(OS, RK);
-      break;
-   case B_Template: {
-      if (!opts.backendName.empty() || !opts.customBackendLib.empty()) {
-         Diags.Diag(warn_generic_warn)
-            << "backend unused because a template was specified";
+
+   std::vector<PendingOutput*> work;
+   for (auto &output : outputs) {
+      if (!output->cachedFile.empty() || output->upToDate) {
+         continue;
       }
 
-      auto maybeTemplateBuf = FileMgr.openFile(opts.templateFile);
-      if (!maybeTemplateBuf) {
-         Diags.Diag(err_generic_error)
-            << "file not found: " + opts.templateFile;
+      if (!prepareOutput(*TG, *output)) {
+         return 1;
+      }
+
+      work.push_back(output.get());
+   }
+
+   unsigned numThreads = opts.numThreads;
+   if (numThreads == 0) {
+      numThreads = ThreadPool::getHardwareConcurrency();
+   }
+
+   if (work.size() > 1 && numThreads > 1) {
+      numThreads = std::min(numThreads, (unsigned)work.size());
+
+      // A server keeps its workers instead of starting new threads for
+      // every request.
+      std::unique_ptr<ThreadPool> LocalPool;
+      ThreadPool *Pool;
+
+      if (Sessions) {
+         Pool = &Sessions->getThreadPool(numThreads);
+      }
+      else {
+         LocalPool = std::make_unique<ThreadPool>(numThreads);
+         Pool = LocalPool.get();
+      }
+
+      for (auto *output : work) {
+         Pool->async([TG, output] { generateOutput(*TG, *output); });
+      }
+
+      Pool->wait();
+   }
+   else {
+      for (auto *output : work) {
+         generateOutput(*TG, *output);
+      }
+   }
+
+   // Finish the outputs in command line order, so that outputs to stdout
+   // appear in that order as well.
+   for (auto &output : outputs) {
+      if (output->upToDate) {
+         continue;
+      }
+
+      if (!output->cachedFile.empty()) {
+         if (!emitCachedOutput(Diags, output->opts, output->cachedFile)) {
+            return 1;
+         }
 
+         continue;
+      }
+
+      if (output->failed) {
          return 1;
       }
 
-      auto &templateBuf = maybeTemplateBuf.getValue();
-      TemplateParser parser(TG, templateBuf.Buf, templateBuf.SourceId,
-                             templateBuf.BaseOffset);
+      std::string errMsg;
+      TimeRegion Timer("Write output", {}, output->opts.outFile);
 
-      if (!parser.parseTemplate()) {
+      if (!output->OS.commit(&errMsg)) {
+         Diags.Diag(err_generic_error) << errMsg;
          return 1;
       }
 
-      OS << parser.getResult();
-      break;
+      // Don't cache runs that emitted warnings, since replaying the output
+      // would silently drop them.
+      if (output->Cache && TG->Diags.getNumWarnings() == 0) {
+         if (!output->Cache->store(TG->fileMgr, output->OS.getCommittedFile(),
+                                   output->OS.getHash(), &errMsg)) {
+            Diags.Diag(warn_generic_warn)
+               << "could not write output cache: " + errMsg;
+         }
+      }
    }
+
+   if (opts.printMemoryStats) {
+      TG->printAllocatorStats(std::cerr);
    }
 
-   if (!opts.outFile.empty()) {
-      std::ofstream ofs(opts.outFile);
-      if (ofs.fail()) {
-         Diags.Diag(err_generic_error) << strerror(errno);
+   return finishTimeReport(Diags, opts, Report.get()) ? 0 : 1;
+}
+
+/// Requests are sent as a single message of fields separated by NUL
+/// characters, which cannot appear in command line arguments. The first
+/// field is the kind of request: "run" followed by the working directory and
+/// the arguments, or "stop". The server answers a run request with three
+/// messages: the exit code, stdout and stderr.
+constexpr const char *RunRequest = "run";
+constexpr const char *StopRequest = "stop";
+
+std::vector<string> splitRequest(const string &request)
+{
+   std::vector<string> fields;
+
+   size_t start = 0;
+   while (true) {
+      size_t end = request.find('\0', start);
+      fields.push_back(request.substr(start, end - start));
+
+      if (end == string::npos) {
+         break;
+      }
+
+      start = end + 1;
+   }
+
+   return fields;
+}
+
+/// Redirects a stream into a string stream while it is alive.
+class StreamCapture {
+   std::ostream &Stream;
+   std::streambuf *PrevBuf;
+
+public:
+   StreamCapture(std::ostream &Stream, std::ostringstream &Capture)
+      : Stream(Stream), PrevBuf(Stream.rdbuf(Capture.rdbuf()))
+   {}
 
+   ~StreamCapture()
+   {
+      Stream.rdbuf(PrevBuf);
+   }
+};
+
+/// Handle the run request \p fields and send the response to \p Conn.
+void handleRunRequest(SessionCache &Sessions, LocalSocket &Conn,
+                      const std::vector<string> &fields)
+{
+   std::ostringstream Out;
+   std::ostringstream Err;
+   int result = 1;
+
+   {
+      StreamCapture CaptureOut(std::cout, Out);
+      StreamCapture CaptureErr(std::cerr, Err);
+
+      std::error_code ec;
+      std::filesystem::current_path(fields[1], ec);
+
+      if (ec) {
+         std::cerr << "tblgen: could not change to directory '" << fields[1]
+                   << "': " << ec.message() << "\n";
+      }
+      else {
+         std::vector<char*> argv{ const_cast<char*>("tblgen") };
+         for (size_t i = 2; i < fields.size(); ++i) {
+            argv.push_back(const_cast<char*>(fields[i].c_str()));
+         }
+
+         try {
+            result = runTblGen((int)argv.size(), argv.data(), &Sessions);
+         }
+         catch (FatalError&) {
+            result = 1;
+         }
+      }
+   }
+
+   // The client might have gone away in the meantime, which is fine.
+   if (Conn.sendMessage(std::to_string(result))
+         && Conn.sendMessage(Out.str())) {
+      Conn.sendMessage(Err.str());
+   }
+}
+
+/// Handle requests sent to \p socketPath until a stop request arrives.
+/// Requests are handled one at a time; the outputs of a request can still
+/// be generated in parallel.
+int runServer(DiagnosticsEngine &Diags, const string &socketPath)
+{
+   std::string errMsg;
+   auto Socket = LocalSocket::Listen(socketPath, &errMsg);
+   if (!Socket.isValid()) {
+      Diags.Diag(err_generic_error) << errMsg;
+      return 1;
+   }
+
+   SessionCache Sessions;
+   while (true) {
+      auto Conn = Socket.Accept(&errMsg);
+      if (!Conn.isValid()) {
+         Diags.Diag(err_generic_error) << errMsg;
          return 1;
       }
 
-      ofs << OS.str();
+      string request;
+      if (!Conn.receiveMessage(request)) {
+         continue;
+      }
+
+      auto fields = splitRequest(request);
+      if (fields[0] == StopRequest) {
+         Conn.sendMessage("0");
+         return 0;
+      }
+
+      if (fields[0] == RunRequest && fields.size() >= 2) {
+         handleRunRequest(Sessions, Conn, fields);
+      }
    }
-   else {
-      std::cout << OS.str();
+}
+
+/// Send \p request to the server listening on \p socketPath.
+/// \return false if there is no server or it did not answer.
+bool sendRequest(const string &socketPath, const string &request,
+                 std::vector<string> &response, unsigned numResponses)
+{
+   auto Conn = LocalSocket::Connect(socketPath);
+   if (!Conn.isValid() || !Conn.sendMessage(request)) {
+      return false;
+   }
+
+   response.resize(numResponses);
+   for (auto &msg : response) {
+      if (!Conn.receiveMessage(msg)) {
+         return false;
+      }
+   }
+
+   return true;
+}
+
+/// Let the server listening on \p socketPath run TblGen with the arguments
+/// \p argv, or run it in this process if that fails.
+int runClient(const string &socketPath, int argc, char **argv)
+{
+   std::error_code ec;
+   auto cwd = std::filesystem::current_path(ec).u8string();
+
+   string request(RunRequest);
+   request += '\0';
+   request += cwd;
+
+   for (int i = 1; i < argc; ++i) {
+      request += '\0';
+      request += argv[i];
+   }
+
+   std::vector<string> response;
+   if (ec || !sendRequest(socketPath, request, response, 3)) {
+      return runTblGen(argc, argv);
+   }
+
+   std::cout << response[1];
+   std::cout.flush();
+   std::cerr << response[2];
+
+   return std::atoi(response[0].c_str());
+}
+
+/// Run TblGen with the arguments \p argv, and run it again whenever one of
+/// the files it read changes. The definitions stay in memory and are only
+/// parsed again if one of their files changed, and only the outputs that
+/// depend on a changed file are generated again.
+int runWatch(int argc, char **argv)
+{
+   TblGenDiagConsumer Consumer;
+   ArenaAllocator Allocator;
+   DiagnosticsEngine Diags(Allocator, &Consumer);
+
+   Options opts = parseOptions(Diags, argc, argv);
+   if (Diags.getNumErrors() != 0) {
+      return 1;
+   }
+
+   if (opts.tgFile.empty()) {
+      Diags.Diag(err_generic_error) << "no input file specified";
+      return 1;
+   }
+
+   makePathsAbsolute(opts);
+
+   // Files are watched before they are read, so that no change is missed.
+   std::vector<string> inputs{ opts.tgFile };
+   for (auto &output : opts.outputs) {
+      if (!output.templateFile.empty()) {
+         inputs.push_back(output.templateFile);
+      }
+      else if (!output.customBackendLib.empty()) {
+         std::error_code ec;
+         inputs.push_back(
+            std::filesystem::absolute(output.customBackendLib, ec).u8string());
+      }
+   }
+
+   FileWatcher Watcher;
+   std::string errMsg;
+
+   for (auto &fileName : inputs) {
+      if (!Watcher.watchFile(fileName, &errMsg)) {
+         Diags.Diag(err_generic_error) << errMsg;
+         return 1;
+      }
+   }
+
+   SessionCache Sessions;
+   std::unordered_set<string> changedFiles;
+   bool succeeded = false;
+
+   while (true) {
+      // Outputs of a failed run might not have been written, so the next
+      // run generates all of them.
+      Sessions.setChangedFiles(succeeded ? &changedFiles : nullptr);
+
+      try {
+         succeeded = runTblGen(argc, argv, &Sessions) == 0;
+      }
+      catch (FatalError&) {
+         succeeded = false;
+      }
+
+      std::cout.flush();
+
+      // Includes are only known after parsing.
+      for (auto &fileName : Sessions.getLastDefinitionFiles()) {
+         if (!Watcher.watchFile(fileName, &errMsg)) {
+            Diags.Diag(warn_generic_warn) << errMsg;
+         }
+      }
+
+      std::cerr << "tblgen: waiting for changes...\n";
+
+      auto changed = Watcher.waitForChanges();
+      if (changed.empty()) {
+         Diags.Diag(err_generic_error) << "waiting for file changes failed";
+         return 1;
+      }
+
+      changedFiles.clear();
+      changedFiles.insert(changed.begin(), changed.end());
+   }
+}
+
+} // anonymous namespace
+
+extern "C" void __asan_version_mismatch_check_apple_clang_1100() {}
+
+int main(int argc, char **argv)
+{
+   if (argc == 1) {
+      printHelpDialog(std::cout);
+      return 0;
+   }
+
+   string mode(argv[1]);
+   if (mode == "--watch") {
+      // Drop --watch, but keep the program name.
+      argv[1] = argv[0];
+      return runWatch(argc - 1, argv + 1);
+   }
+
+   if (mode != "--serve" && mode != "--client" && mode != "--stop-server") {
+      return runTblGen(argc, argv);
    }
-}
\ No newline at end of file
+
+   TblGenDiagConsumer Consumer;
+   ArenaAllocator Allocator;
+   DiagnosticsEngine Diags(Allocator, &Consumer);
+
+   if (argc < 3) {
+      Diags.Diag(err_generic_error) << "expecting socket path after " + mode;
+      return 1;
+   }
+
+   string socketPath(argv[2]);
+   if (mode == "--serve") {
+      return runServer(Diags, socketPath);
+   }
+
+   if (mode == "--stop-server") {
+      std::vector<string> response;
+      if (!sendRequest(socketPath, StopRequest, response, 1)) {
+         Diags.Diag(err_generic_error)
+            << "no server is listening on '" + socketPath + "'";
+
+         return 1;
+      }
+
+      return 0;
+   }
+
+   // Drop --client and the socket path, but keep the program name.
+   argv[2] = argv[0];
+   return runClient(socketPath, argc - 2, argv + 2);
+}
@@ -0,0 +1,463 @@
+#include "tblgen/Backend/TableGenBackends.h"
+#include "tblgen/Record.h"
+#include "tblgen/Serialization/BinaryFormat.h"
+#include "tblgen/Support/Casting.h"
+#include "tblgen/TableGen.h"
+#include "tblgen/Type.h"
+#include "tblgen/Value.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+using namespace tblgen::serial;
+using namespace tblgen::support;
+
+namespace tblgen {
+namespace {
+
+class BinaryWriter {
+public:
+   void write(std::ostream &OS, const RecordKeeper &RK);
+
+private:
+   std::string Strings;
+   std::vector<uint32_t> Indices;
+   std::vector<TypeEntry> Types;
+   std::vector<ValueEntry> Values;
+   std::vector<NamedValueEntry> NamedValues;
+   std::vector<FieldEntry> Fields;
+   std::vector<BaseEntry> Bases;
+   std::vector<ClassEntry> Classes;
+   std::vector<EnumCaseEntry> EnumCases;
+   std::vector<EnumEntry> Enums;
+   std::vector<RecordEntry> Records;
+   std::vector<NamespaceEntry> Namespaces;
+
+   std::unordered_map<std::string_view, StringRef> StringMap;
+   std::unordered_map<const RecordKeeper*, uint32_t> NamespaceIDs;
+   std::unordered_map<const Class*, uint32_t> ClassIDs;
+   std::unordered_map<const Enum*, uint32_t> EnumIDs;
+   std::unordered_map<const EnumCase*, uint32_t> EnumCaseIDs;
+   std::unordered_map<const Record*, uint32_t> RecordIDs;
+   std::unordered_map<const Type*, uint32_t> TypeIDs;
+   std::unordered_map<const Value*, uint32_t> ValueIDs;
+
+   /// The records in index order, anonymous records are added as they are
+   /// discovered.
+   std::vector<Record*> RecordList;
+
+   StringRef addString(std::string_view Str);
+
+   uint32_t getNamespaceID(const RecordKeeper *RK);
+   uint32_t getRecordID(Record *R);
+   uint32_t getTypeID(Type *Ty);
+   uint32_t getValueID(Value *V);
+
+   Range addValueList(const std::vector<Value*> &Vals);
+   Range addBases(const std::vector<Class::BaseClass> &BaseClasses);
+   Range addFields(const std::vector<RecordField> &Fs);
+
+   void collectNamespaces(const RecordKeeper &RK);
+   void writeClass(const Class &C);
+   void writeRecord(const Record &R);
+
+   template<class T>
+   void writeTable(std::string &Out, FileHeader &Header, TableKind Kind,
+                   const T *Data, size_t Count);
+};
+
+} // anonymous namespace
+
+StringRef BinaryWriter::addString(std::string_view Str)
+{
+   auto it = StringMap.find(Str);
+   if (it != StringMap.end())
+      return it->second;
+
+   StringRef Ref{ (uint32_t)Strings.size(), (uint32_t)Str.size() };
+   Strings += Str;
+
+   StringMap.emplace(Str, Ref);
+   return Ref;
+}
+
+uint32_t BinaryWriter::getNamespaceID(const RecordKeeper *RK)
+{
+   auto it = NamespaceIDs.find(RK);
+   assert(it != NamespaceIDs.end() && "unknown namespace");
+
+   return it->second;
+}
+
+uint32_t BinaryWriter::getRecordID(Record *R)
+{
+   auto it = RecordIDs.find(R);
+   if (it != RecordIDs.end())
+      return it->second;
+
+   // Anonymous records are not part of any namespace, so we only see them
+   // when they are referenced.
+   uint32_t ID = (uint32_t)RecordList.size();
+   RecordList.push_back(R);
+   RecordIDs.emplace(R, ID);
+
+   return ID;
+}
+
+uint32_t BinaryWriter::getTypeID(Type *Ty)
+{
+   if (!Ty)
+      return InvalidIndex;
+
+   auto it = TypeIDs.find(Ty);
+   if (it != TypeIDs.end())
+      return it->second;
+
+   TypeEntry Entry{ (uint32_t)Ty->getTypeID(), 0, 0 };
+   switch (Ty->getTypeID()) {
+   case Type::IntTypeID:
+      Entry.Operand = cast<IntType>(Ty)->getBitWidth();
+      Entry.IsUnsigned = cast<IntType>(Ty)->isUnsigned();
+      break;
+   case Type::ListTypeID:
+      Entry.Operand = getTypeID(cast<ListType>(Ty)->getElementType());
+      break;
+   case Type::DictTypeID:
+      Entry.Operand = getTypeID(cast<DictType>(Ty)->getElementType());
+      break;
+   case Type::ClassTypeID:
+      Entry.Operand = ClassIDs[cast<ClassType>(Ty)->getClass()];
+      break;
+   case Type::RecordTypeID:
+      Entry.Operand = getRecordID(cast<RecordType>(Ty)->getRecord());
+      break;
+   case Type::EnumTypeID:
+      Entry.Operand = EnumIDs[cast<EnumType>(Ty)->getEnum()];
+      break;
+   default:
+      break;
+   }
+
+   uint32_t ID = (uint32_t)Types.size();
+   Types.push_back(Entry);
+   TypeIDs.emplace(Ty, ID);
+
+   return ID;
+}
+
+uint32_t BinaryWriter::getValueID(Value *V)
+{
+   if (!V)
+      return InvalidIndex;
+
+   auto it = ValueIDs.find(V);
+   if (it != ValueIDs.end())
+      return it->second;
+
+   ValueEntry Entry{};
+   Entry.Kind = (uint32_t)V->getTypeID();
+   Entry.Type = getTypeID(V->getType());
+
+   switch (V->getTypeID()) {
+   case Value::IntegerLiteralID:
+      Entry.Payload = cast<IntegerLiteral>(V)->getVal();
+      break;
+   case Value::FPLiteralID: {
+      double D = cast<FPLiteral>(V)->getVal();
+      static_assert(sizeof(D) == sizeof(Entry.Payload), "");
+      memcpy(&Entry.Payload, &D, sizeof(D));
+      break;
+   }
+   case Value::StringLiteralID:
+      Entry.Str = addString(cast<StringLiteral>(V)->getVal());
+      break;
+   case Value::CodeBlockID:
+      Entry.Str = addString(cast<CodeBlock>(V)->getCode());
+      break;
+   case Value::IdentifierValID:
+      Entry.Str = addString(cast<IdentifierVal>(V)->getVal());
+      break;
+   case Value::ListLiteralID:
+      Entry.Elements = addValueList(cast<ListLiteral>(V)->getValues());
+      break;
+   case Value::DictLiteralID: {
+      std::vector<NamedValueEntry> Elements;
+      for (auto &El : cast<DictLiteral>(V)->getValues()) {
+         Elements.push_back(NamedValueEntry{ addString(El.first),
+                                             getValueID(El.second) });
+      }
+
+      Entry.Elements = { (uint32_t)NamedValues.size(),
+                         (uint32_t)Elements.size() };
+
+      NamedValues.insert(NamedValues.end(), Elements.begin(), Elements.end());
+      break;
+   }
+   case Value::RecordValID:
+      Entry.Payload = getRecordID(cast<RecordVal>(V)->getRecord());
+      break;
+   case Value::EnumValID: {
+      auto *EV = cast<EnumVal>(V);
+      Entry.Elements.Begin = EnumIDs[EV->getEnum()];
+      Entry.Payload = EnumCaseIDs[EV->getCase()];
+      break;
+   }
+   case Value::UndefValID:
+      break;
+   case Value::DictAccessExprID: {
+      auto *DA = cast<DictAccessExpr>(V);
+      Entry.Str = addString(DA->getKey());
+      Entry.Payload = getValueID(DA->getDict());
+      break;
+   }
+   }
+
+   uint32_t ID = (uint32_t)Values.size();
+   Values.push_back(Entry);
+   ValueIDs.emplace(V, ID);
+
+   return ID;
+}
+
+Range BinaryWriter::addValueList(const std::vector<Value*> &Vals)
+{
+   // Make sure all values are written before we reserve our range.
+   std::vector<uint32_t> IDs;
+   IDs.reserve(Vals.size());
+
+   for (auto *V : Vals) {
+      IDs.push_back(getValueID(V));
+   }
+
+   Range R{ (uint32_t)Indices.size(), (uint32_t)IDs.size() };
+   Indices.insert(Indices.end(), IDs.begin(), IDs.end());
+
+   return R;
+}
+
+Range BinaryWriter::addBases(const std::vector<Class::BaseClass> &BaseClasses)
+{
+   std::vector<BaseEntry> Entries;
+   for (auto &B : BaseClasses) {
+      Entries.push_back(BaseEntry{ ClassIDs[B.getBase()],
+                                   addValueList(B.getTemplateArgs()) });
+   }
+
+   Range R{ (uint32_t)Bases.size(), (uint32_t)Entries.size() };
+   Bases.insert(Bases.end(), Entries.begin(), Entries.end());
+
+   return R;
+}
+
+Range BinaryWriter::addFields(const std::vector<RecordField> &Fs)
+{
+   std::vector<FieldEntry> Entries;
+   for (auto &F : Fs) {
+      FieldEntry Entry{};
+      Entry.Name = addString(F.getName());
+      Entry.Type = getTypeID(F.getType());
+      Entry.DefaultValue = getValueID(F.getDefaultValue());
+      Entry.AssociatedTemplateParm = F.hasAssociatedTemplateParm()
+         ? (uint32_t)F.getAssociatedTemplateParm() : InvalidIndex;
+      Entry.IsAppend = F.isAppend();
+
+      Entries.push_back(Entry);
+   }
+
+   Range R{ (uint32_t)Fields.size(), (uint32_t)Entries.size() };
+   Fields.insert(Fields.end(), Entries.begin(), Entries.end());
+
+   return R;
+}
+
+void BinaryWriter::collectNamespaces(const RecordKeeper &GlobalRK)
+{
+   // Number the namespaces breadth first, so that every namespace comes
+   // after its parent.
+   std::vector<const RecordKeeper*> Worklist{ &GlobalRK };
+   for (size_t i = 0; i < Worklist.size(); ++i) {
+      auto *RK = Worklist[i];
+      NamespaceIDs.emplace(RK, (uint32_t)i);
+
+      for (auto &NS : RK->getAllNamespaces()) {
+         Worklist.push_back(NS.second);
+      }
+   }
+
+   // Number all declarations before writing anything, so that references
+   // can be resolved regardless of declaration order.
+   for (auto *RK : Worklist) {
+      for (auto &C : RK->getAllClasses()) {
+         ClassIDs.emplace(C.second, (uint32_t)ClassIDs.size());
+      }
+
+      for (auto &E : RK->getAllEnums()) {
+         EnumIDs.emplace(E.second, (uint32_t)EnumIDs.size());
+      }
+
+      for (auto *R : RK->getAllRecords()) {
+         getRecordID(R);
+      }
+   }
+
+   Namespaces.resize(Worklist.size(), NamespaceEntry{ {}, InvalidIndex });
+   for (auto *RK : Worklist) {
+      for (auto &NS : RK->getAllNamespaces()) {
+         Namespaces[NamespaceIDs[NS.second]].Parent = NamespaceIDs[RK];
+      }
+   }
+
+   Classes.resize(ClassIDs.size());
+   Enums.resize(EnumIDs.size());
+
+   for (auto *RK : Worklist) {
+      auto &Entry = Namespaces[NamespaceIDs[RK]];
+      Entry.Name = addString(RK->getNamespaceName());
+
+      // Enum cases are written in value order to keep the output stable.
+      for (auto &E : RK->getAllEnums()) {
+         std::vector<std::pair<uint64_t, std::string_view>> Cases;
+         for (auto &C : E.second->getCases()) {
+            Cases.emplace_back(C.second->caseValue, C.first);
+         }
+
+         std::sort(Cases.begin(), Cases.end());
+
+         auto &EnumEntry = Enums[EnumIDs[E.second]];
+         EnumEntry.Name = addString(E.second->getName());
+         EnumEntry.Namespace = NamespaceIDs[RK];
+         EnumEntry.Cases = { (uint32_t)EnumCases.size(),
+                             (uint32_t)Cases.size() };
+
+         for (auto &C : Cases) {
+            EnumCaseIDs.emplace(E.second->getCase(std::string(C.second)),
+                                (uint32_t)EnumCases.size());
+            EnumCases.push_back(EnumCaseEntry{ addString(C.second),
+                                               C.first });
+         }
+      }
+   }
+
+   for (auto *RK : Worklist) {
+      auto &Entry = Namespaces[NamespaceIDs[RK]];
+
+      std::vector<uint32_t> RecordIDs;
+      for (auto *R : RK->getAllRecords()) {
+         RecordIDs.push_back(getRecordID(R));
+      }
+
+      Entry.Records = { (uint32_t)Indices.size(),
+                        (uint32_t)RecordIDs.size() };
+
+      Indices.insert(Indices.end(), RecordIDs.begin(), RecordIDs.end());
+
+      std::vector<NamedValueEntry> Decls;
+      for (auto &V : RK->getValueDecls()) {
+         Decls.push_back(NamedValueEntry{ addString(V.first),
+                                          getValueID(V.second.getVal()) });
+      }
+
+      Entry.Values = { (uint32_t)NamedValues.size(),
+                       (uint32_t)Decls.size() };
+
+      NamedValues.insert(NamedValues.end(), Decls.begin(), Decls.end());
+
+      for (auto &C : RK->getAllClasses()) {
+         writeClass(*C.second);
+      }
+   }
+}
+
+void BinaryWriter::writeClass(const Class &C)
+{
+   ClassEntry Entry{};
+   Entry.Name = addString(C.getName());
+   Entry.Namespace = getNamespaceID(&C.getRecordKeeper());
+   Entry.Bases = addBases(C.getBases());
+   Entry.Parameters = addFields(C.getParameters());
+   Entry.Fields = addFields(C.getFields());
+   Entry.Overrides = addFields(C.getOverrides());
+
+   Classes[ClassIDs[&C]] = Entry;
+}
+
+void BinaryWriter::writeRecord(const Record &R)
+{
+   RecordEntry Entry{};
+   Entry.Name = addString(R.getName());
+   Entry.Namespace = getNamespaceID(&R.getRecordKeeper());
+   Entry.IsAnonymous = R.isAnonymous();
+   Entry.Bases = addBases(R.getBases());
+   Entry.OwnFields = addFields(R.getOwnFields());
+
+   std::vector<NamedValueEntry> FieldValues;
+   for (auto &FV : R.getFieldValues()) {
+      FieldValues.push_back(NamedValueEntry{ addString(FV.first),
+                                             getValueID(FV.second) });
+   }
+
+   Entry.FieldValues = { (uint32_t)NamedValues.size(),
+                         (uint32_t)FieldValues.size() };
+
+   NamedValues.insert(NamedValues.end(), FieldValues.begin(),
+                      FieldValues.end());
+
+   Records[RecordIDs[&R]] = Entry;
+}
+
+template<class T>
+void BinaryWriter::writeTable(std::string &Out, FileHeader &Header,
+                              TableKind Kind, const T *Data, size_t Count) {
+   // Keep every table 8 byte aligned.
+   Out.resize((Out.size() + 7) & ~size_t(7), '\0');
+
+   Header.Tables[Kind].Offset = Out.size();
+   Header.Tables[Kind].Count = Count;
+
+   Out.append(reinterpret_cast<const char*>(Data), Count * sizeof(T));
+}
+
+void BinaryWriter::write(std::ostream &OS, const RecordKeeper &RK)
+{
+   collectNamespaces(RK);
+
+   // Writing a record can discover new anonymous records.
+   for (size_t i = 0; i < RecordList.size(); ++i) {
+      Records.resize(RecordList.size());
+      writeRecord(*RecordList[i]);
+   }
+
+   Records.resize(RecordList.size());
+
+   FileHeader Header{};
+   memcpy(Header.Magic, Magic.data(), sizeof(Header.Magic));
+   Header.Version = FormatVersion;
+   Header.NumTables = TK_NumTables;
+
+   std::string Out(sizeof(FileHeader), '\0');
+   writeTable(Out, Header, TK_Strings, Strings.data(), Strings.size());
+   writeTable(Out, Header, TK_Indices, Indices.data(), Indices.size());
+   writeTable(Out, Header, TK_Types, Types.data(), Types.size());
+   writeTable(Out, Header, TK_Values, Values.data(), Values.size());
+   writeTable(Out, Header, TK_NamedValues, NamedValues.data(),
+              NamedValues.size());
+   writeTable(Out, Header, TK_Fields, Fields.data(), Fields.size());
+   writeTable(Out, Header, TK_Bases, Bases.data(), Bases.size());
+   writeTable(Out, Header, TK_Classes, Classes.data(), Classes.size());
+   writeTable(Out, Header, TK_EnumCases, EnumCases.data(), EnumCases.size());
+   writeTable(Out, Header, TK_Enums, Enums.data(), Enums.size());
+   writeTable(Out, Header, TK_Records, Records.data(), Records.size());
+   writeTable(Out, Header, TK_Namespaces, Namespaces.data(),
+              Namespaces.size());
+
+   memcpy(Out.data(), &Header, sizeof(Header));
+   OS.write(Out.data(), (std::streamsize)Out.size());
+}
+
+void EmitBinary(std::ostream &str, RecordKeeper const& RK)
+{
+   BinaryWriter().write(str, RK);
+}
+
+} // namespace tblgen
@@ -1,6 +1,7 @@
 
 #include "tblgen/Basic/FileManager.h"
 #include "tblgen/Basic/FileUtils.h"
+#include "tblgen/Support/Timer.h"
 
 #include <iostream>
 
@@ -18,42 +19,51 @@ FileManager::openFile(const std::string &name, bool CreateSourceID)
 {
    auto it = MemBufferCache.find(name);
    if (it != MemBufferCache.end()) {
-      auto &File = it->second;
-      return OpenFile(File.Buf, File.FileName, File.SourceId, File.BaseOffset);
+      auto &File = *it->second;
+      return OpenFile(File.Buf.getBuffer(), File.FileName, File.SourceId,
+                      File.BaseOffset);
    }
 
-   std::ifstream ifs(name);
-   if (ifs.fail()) {
+   support::TimeRegion Timer("Load file", {}, name);
+   auto buf = support::MemoryBuffer::getFile(name, UseMemoryMapping);
+   if (!buf.isValid()) {
       return support::None;
    }
 
    SourceID id;
    SourceID previous;
-   std::string buf((std::istreambuf_iterator<char>(ifs)),
-                   std::istreambuf_iterator<char>());
 
-   std::unordered_map<std::string, CachedFile>::iterator Entry;
    if (CreateSourceID) {
       previous = sourceIdOffsets.back();
       id = (unsigned)sourceIdOffsets.size();
 
-      auto offset = unsigned(previous + buf.size());
-
-      CachedFile file(string(name), id, previous, move(buf));
-      Entry  = MemBufferCache.emplace(name, std::move(file)).first;
-
-      IdFileMap.try_emplace(id, Entry);
-      sourceIdOffsets.push_back(offset);
+      sourceIdOffsets.push_back(unsigned(previous + buf.getBufferSize()));
    }
    else {
       previous = 0;
       id = 0;
+   }
+
+   auto &File = MemBufferCache[name];
+   File = std::make_unique<CachedFile>(string(name), id, previous,
+                                       std::move(buf));
+
+   if (CreateSourceID) {
+      IdFileMap.try_emplace(id, File.get());
+   }
 
-      CachedFile file(string(name), 0, 0, move(buf));
-      Entry = MemBufferCache.emplace(name, std::move(file)).first;
+   return OpenFile(File->Buf.getBuffer(), File->FileName, id, previous);
+}
+
+void FileManager::closeFile(const std::string &fileName)
+{
+   auto it = MemBufferCache.find(fileName);
+   if (it == MemBufferCache.end()) {
+      return;
    }
 
-   return OpenFile(Entry->second.Buf, Entry->second.FileName, id, previous);
+   ClosedFiles.push_back(std::move(it->second));
+   MemBufferCache.erase(it);
 }
 
 OpenFile FileManager::getOpenedFile(SourceID sourceId)
@@ -61,16 +71,16 @@ OpenFile FileManager::getOpenedFile(SourceID sourceId)
    auto index = IdFileMap.find(sourceId);
    assert(index != IdFileMap.end());
 
-   auto &F = index->second->second;
-   return OpenFile(F.Buf, F.FileName, F.SourceId, F.BaseOffset);
+   auto &F = *index->second;
+   return OpenFile(F.Buf.getBuffer(), F.FileName, F.SourceId, F.BaseOffset);
 }
 
-const std::string &FileManager::getBuffer(SourceID sourceId)
+std::string_view FileManager::getBuffer(SourceID sourceId)
 {
    auto index = IdFileMap.find(sourceId);
    assert(index != IdFileMap.end());
 
-   return index->second->second.Buf;
+   return index->second->Buf.getBuffer();
 }
 
 unsigned FileManager::getSourceId(SourceLocation loc)
@@ -108,7 +118,7 @@ std::string_view FileManager::getFileName(SourceID sourceId)
    auto index = IdFileMap.find(sourceId);
    assert (index != IdFileMap.end() && "invalid source ID!");
 
-   return index->second->first;
+   return index->second->FileName;
 }
 
 LineColPair FileManager::getLineAndCol(SourceLocation loc)
@@ -121,7 +131,7 @@ LineColPair FileManager::getLineAndCol(SourceLocation loc)
 }
 
 LineColPair FileManager::getLineAndCol(SourceLocation loc,
-                                       const std::string &Buf)
+                                       std::string_view Buf)
 {
    auto ID = getSourceId(loc);
    auto it = LineOffsets.find(ID);
@@ -169,12 +179,12 @@ const std::vector<unsigned> &FileManager::getLineOffsets(SourceID sourceID)
 
 const std::vector<unsigned> &
 FileManager::collectLineOffsetsForFile(SourceID sourceId,
-                                       const std::string &Buf)
+                                       std::string_view Buf)
 {
    std::vector<unsigned> newLines{0};
 
    unsigned idx = 0;
-   auto buf = Buf.c_str();
+   auto buf = Buf.data();
    auto size = Buf.size();
 
    while (idx < size) {
@@ -217,9 +227,9 @@ void FileManager::dumpSourceRange(SourceRange SR)
    size_t ID = getSourceId(loc);
    auto File = getOpenedFile(ID);
 
-   const std::string &Buf = File.Buf;
+   std::string_view Buf = File.Buf;
    size_t srcLen = Buf.size();
-   const char *src = Buf.c_str();
+   const char *src = Buf.data();
 
    // show file name, line number and column
    auto lineAndCol = getLineAndCol(loc, Buf);
@@ -253,7 +263,7 @@ void FileManager::dumpSourceRange(SourceRange SR)
       Len = lineEndIndex - newlineIndex - 1;
    }
 
-   std::string_view ErrLine(Buf.c_str() + newlineIndex + 1, Len);
+   std::string_view ErrLine(Buf.data() + newlineIndex + 1, Len);
 
    // show carets for any given single source location, and tildes for source
    // ranges (but only on the error line)
@@ -1,9 +1,19 @@
 
 #include "tblgen/Basic/FileUtils.h"
 
+#include <cerrno>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <filesystem>
+#include <fstream>
+
+#ifdef _WIN32
+#   include <process.h>
+#   define getpid _getpid
+#else
+#   include <unistd.h>
+#endif
 
 using std::string;
 
@@ -124,5 +134,71 @@ string findFileInDirectories(std::string_view fileName,
    return "";
 }
 
+bool writeFileAtomically(const std::string &name, std::string_view contents,
+                         std::string *errMsg) {
+   std::string tmpName = name;
+   tmpName += ".tmp.";
+   tmpName += std::to_string(getpid());
+
+   {
+      std::ofstream ofs(tmpName, std::ios::binary | std::ios::trunc);
+      if (ofs.fail()) {
+         if (errMsg)
+            *errMsg = strerror(errno);
+
+         return false;
+      }
+
+      ofs.write(contents.data(), (std::streamsize)contents.size());
+      ofs.close();
+
+      if (ofs.fail()) {
+         if (errMsg)
+            *errMsg = "error writing file '" + tmpName + "'";
+
+         std::remove(tmpName.c_str());
+         return false;
+      }
+   }
+
+   std::error_code ec;
+   std::filesystem::rename(tmpName, name, ec);
+
+   if (ec) {
+      if (errMsg)
+         *errMsg = ec.message();
+
+      std::remove(tmpName.c_str());
+      return false;
+   }
+
+   return true;
+}
+
+bool copyFileAtomically(const std::string &from, const std::string &to,
+                        std::string *errMsg) {
+   std::string tmpName = to;
+   tmpName += ".tmp.";
+   tmpName += std::to_string(getpid());
+
+   std::error_code ec;
+   std::filesystem::copy_file(
+      from, tmpName, std::filesystem::copy_options::overwrite_existing, ec);
+
+   if (!ec) {
+      std::filesystem::rename(tmpName, to, ec);
+   }
+
+   if (ec) {
+      if (errMsg)
+         *errMsg = ec.message();
+
+      std::remove(tmpName.c_str());
+      return false;
+   }
+
+   return true;
+}
+
 } // namespace fs
 } // namespace tblgen
\ No newline at end of file
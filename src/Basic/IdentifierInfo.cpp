@@ -7,6 +7,10 @@ namespace tblgen {
 
 IdentifierInfo &IdentifierTable::get(std::string_view key)
 {
+   std::unique_lock<std::mutex> Lock;
+   if (Mtx)
+      Lock = std::unique_lock<std::mutex>(*Mtx);
+
    auto it = IdentMap.find(key);
    if (it != IdentMap.end()) {
       return *it->second;
@@ -0,0 +1,165 @@
+#include "tblgen/Basic/OutputCache.h"
+
+#include "tblgen/Basic/FileManager.h"
+#include "tblgen/Basic/FileUtils.h"
+#include "tblgen/Support/Hashing.h"
+#include "tblgen/Support/MemoryBuffer.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <sstream>
+
+using std::string;
+
+namespace tblgen {
+namespace fs {
+
+/// The first line of every manifest, bump the version when changing the
+/// format.
+static constexpr std::string_view ManifestHeader = "tblgen-cache 1";
+
+OutputCache::OutputCache(std::string CacheDir, uint64_t Key)
+   : CacheDir(move(CacheDir)), KeyStr(support::hashToString(Key))
+{
+   if (!this->CacheDir.empty() && this->CacheDir.back() != PathSeparator) {
+      this->CacheDir += PathSeparator;
+   }
+}
+
+string OutputCache::getManifestFile() const
+{
+   return CacheDir + KeyStr + ".manifest";
+}
+
+string OutputCache::getOutputFile() const
+{
+   return CacheDir + KeyStr + ".out";
+}
+
+void OutputCache::addInput(std::string FileName)
+{
+   ExtraInputs.push_back(move(FileName));
+}
+
+/// Compute the hash of the current contents of \p FileName.
+static bool hashFile(const string &FileName, uint64_t &Hash)
+{
+   auto Buf = support::MemoryBuffer::getFile(FileName);
+   if (!Buf.isValid()) {
+      return false;
+   }
+
+   Hash = support::hashFNV1a(Buf.getBuffer());
+   return true;
+}
+
+bool OutputCache::lookup(std::string &OutputFile) const
+{
+   auto Manifest = support::MemoryBuffer::getFile(getManifestFile(), false);
+   if (!Manifest.isValid()) {
+      return false;
+   }
+
+   std::istringstream IS{string(Manifest.getBuffer())};
+   string Line;
+
+   if (!std::getline(IS, Line) || Line != ManifestHeader) {
+      return false;
+   }
+
+   // Every line consists of a hash, a space, and the name of the file. The
+   // last line contains the hash of the output itself.
+   uint64_t OutputHash = 0;
+   bool FoundOutput = false;
+
+   while (std::getline(IS, Line)) {
+      if (Line.size() < 18 || Line[16] != ' ') {
+         return false;
+      }
+
+      uint64_t ExpectedHash = std::strtoull(Line.substr(0, 16).c_str(),
+                                            nullptr, 16);
+
+      string FileName = Line.substr(17);
+      if (FileName == "<output>") {
+         OutputHash = ExpectedHash;
+         FoundOutput = true;
+
+         break;
+      }
+
+      uint64_t Hash;
+      if (!hashFile(FileName, Hash) || Hash != ExpectedHash) {
+         return false;
+      }
+   }
+
+   if (!FoundOutput) {
+      return false;
+   }
+
+   uint64_t Hash;
+   if (!hashFile(getOutputFile(), Hash) || Hash != OutputHash) {
+      return false;
+   }
+
+   OutputFile = getOutputFile();
+   return true;
+}
+
+bool OutputCache::store(const FileManager &FileMgr,
+                        const std::string &OutputFile, uint64_t OutputHash,
+                        std::string *errMsg) const {
+   std::error_code ec;
+   std::filesystem::create_directories(CacheDir, ec);
+
+   if (ec) {
+      if (errMsg)
+         *errMsg = ec.message();
+
+      return false;
+   }
+
+   // Hash the buffers that were actually used instead of reading the files
+   // again, since they might have changed in the meantime.
+   std::vector<std::pair<string, uint64_t>> Inputs;
+   for (auto &Entry : FileMgr.getSourceFiles()) {
+      Inputs.emplace_back(Entry.first,
+                          support::hashFNV1a(Entry.second->Buf.getBuffer()));
+   }
+
+   for (auto &FileName : ExtraInputs) {
+      uint64_t Hash;
+      if (!hashFile(FileName, Hash)) {
+         if (errMsg)
+            *errMsg = "could not read file '" + FileName + "'";
+
+         return false;
+      }
+
+      Inputs.emplace_back(FileName, Hash);
+   }
+
+   std::sort(Inputs.begin(), Inputs.end());
+
+   string Manifest(ManifestHeader);
+   Manifest += '\n';
+
+   for (auto &Input : Inputs) {
+      Manifest += support::hashToString(Input.second);
+      Manifest += ' ';
+      Manifest += Input.first;
+      Manifest += '\n';
+   }
+
+   Manifest += support::hashToString(OutputHash);
+   Manifest += " <output>\n";
+
+   // Write the output first, a manifest never refers to an output that
+   // doesn't exist yet.
+   return copyFileAtomically(OutputFile, getOutputFile(), errMsg)
+      && writeFileAtomically(getManifestFile(), Manifest, errMsg);
+}
+
+} // namespace fs
+} // namespace tblgen
@@ -0,0 +1,260 @@
+#include "tblgen/Basic/OutputFile.h"
+
+#include "tblgen/Support/Hashing.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+
+#ifdef _WIN32
+#   include <process.h>
+#   define getpid _getpid
+#else
+#   include <unistd.h>
+#endif
+
+using std::string;
+
+namespace tblgen {
+namespace fs {
+namespace {
+
+/// Temporary files that still exist. Errors exit TblGen without unwinding
+/// the stack, so these are also removed by an atexit() handler.
+std::mutex TmpFilesMtx;
+std::vector<std::string> TmpFiles;
+
+void removeTmpFiles()
+{
+   std::lock_guard<std::mutex> lock(TmpFilesMtx);
+   for (auto &file : TmpFiles) {
+      std::remove(file.c_str());
+   }
+
+   TmpFiles.clear();
+}
+
+void addTmpFile(const std::string &file)
+{
+   static bool registered = std::atexit(removeTmpFiles) == 0;
+   (void)registered;
+
+   std::lock_guard<std::mutex> lock(TmpFilesMtx);
+   TmpFiles.push_back(file);
+}
+
+void removeTmpFile(const std::string &file)
+{
+   std::lock_guard<std::mutex> lock(TmpFilesMtx);
+   TmpFiles.erase(std::remove(TmpFiles.begin(), TmpFiles.end(), file),
+                  TmpFiles.end());
+}
+
+} // anonymous namespace
+
+OutputFile::OutputBuffer::OutputBuffer()
+   : hash(support::FNVOffsetBasis), buffer(BufferSize)
+{
+   setp(buffer.data(), buffer.data() + buffer.size());
+}
+
+bool OutputFile::OutputBuffer::flushBuffer()
+{
+   size_t size = pptr() - pbase();
+   if (size == 0) {
+      return error == 0;
+   }
+
+   hash = support::hashFNV1a(std::string_view(pbase(), size), hash);
+
+   if (existing) {
+      compareBuffer.resize(size);
+      if (std::fread(compareBuffer.data(), 1, size, existing) != size
+          || std::memcmp(compareBuffer.data(), pbase(), size) != 0) {
+         std::fclose(existing);
+         existing = nullptr;
+      }
+   }
+
+   if (file && error == 0 && std::fwrite(pbase(), 1, size, file) != size) {
+      error = errno;
+   }
+
+   setp(buffer.data(), buffer.data() + buffer.size());
+   return error == 0;
+}
+
+OutputFile::OutputBuffer::int_type OutputFile::OutputBuffer::overflow(int_type c)
+{
+   if (!flushBuffer()) {
+      return traits_type::eof();
+   }
+
+   if (!traits_type::eq_int_type(c, traits_type::eof())) {
+      *pptr() = traits_type::to_char_type(c);
+      pbump(1);
+   }
+
+   return traits_type::not_eof(c);
+}
+
+int OutputFile::OutputBuffer::sync()
+{
+   return flushBuffer() ? 0 : -1;
+}
+
+OutputFile::OutputFile()
+   : std::ostream(nullptr)
+{
+   rdbuf(&buf);
+}
+
+OutputFile::~OutputFile()
+{
+   closeFiles();
+
+   if (!tmpName.empty()) {
+      if (!committed || toStdout) {
+         std::remove(tmpName.c_str());
+      }
+
+      removeTmpFile(tmpName);
+   }
+}
+
+void OutputFile::closeFiles()
+{
+   if (buf.file) {
+      std::fclose(buf.file);
+      buf.file = nullptr;
+   }
+
+   if (buf.existing) {
+      std::fclose(buf.existing);
+      buf.existing = nullptr;
+   }
+}
+
+bool OutputFile::open(const std::string &name, std::string *errMsg)
+{
+   this->name = name;
+   toStdout = name.empty();
+
+   if (toStdout) {
+      std::error_code ec;
+      auto tmpDir = std::filesystem::temp_directory_path(ec);
+
+      if (ec) {
+         if (errMsg)
+            *errMsg = ec.message();
+
+         return false;
+      }
+
+      // Several outputs of one invocation can go to stdout.
+      static std::atomic<unsigned> NumStdoutFiles(0);
+
+      tmpName = (tmpDir / "tblgen-output.").string();
+      tmpName += std::to_string(getpid());
+      tmpName += "." + std::to_string(NumStdoutFiles++);
+   }
+   else {
+      tmpName = name + ".tmp." + std::to_string(getpid());
+   }
+
+   buf.file = std::fopen(tmpName.c_str(), "wb");
+   if (!buf.file) {
+      if (errMsg)
+         *errMsg = "error opening file '" + tmpName + "': " + strerror(errno);
+
+      tmpName.clear();
+      return false;
+   }
+
+   addTmpFile(tmpName);
+
+   // Everything is buffered by the OutputBuffer already.
+   std::setvbuf(buf.file, nullptr, _IONBF, 0);
+
+   if (!toStdout) {
+      buf.existing = std::fopen(name.c_str(), "rb");
+   }
+
+   return true;
+}
+
+bool OutputFile::commit(std::string *errMsg, bool *changed)
+{
+   if (changed)
+      *changed = true;
+
+   flush();
+
+   bool unchanged = buf.existing && std::fgetc(buf.existing) == EOF;
+   bool failed = buf.error != 0 || !buf.file || std::fflush(buf.file) != 0;
+
+   closeFiles();
+
+   if (failed) {
+      if (errMsg)
+         *errMsg = "error writing file '" + tmpName + "': "
+            + strerror(buf.error ? buf.error : errno);
+
+      return false;
+   }
+
+   if (toStdout) {
+      // Copy the spooled output in chunks.
+      std::FILE *in = std::fopen(tmpName.c_str(), "rb");
+      if (!in) {
+         if (errMsg)
+            *errMsg = "error opening file '" + tmpName + "': " + strerror(errno);
+
+         return false;
+      }
+
+      std::vector<char> chunk(BufferSize);
+      size_t size;
+
+      while ((size = std::fread(chunk.data(), 1, chunk.size(), in)) != 0) {
+         std::cout.write(chunk.data(), (std::streamsize)size);
+      }
+
+      std::fclose(in);
+      std::cout.flush();
+
+      committed = true;
+      return true;
+   }
+
+   if (unchanged) {
+      if (changed)
+         *changed = false;
+
+      std::remove(tmpName.c_str());
+      committed = true;
+
+      return true;
+   }
+
+   std::error_code ec;
+   std::filesystem::rename(tmpName, name, ec);
+
+   if (ec) {
+      if (errMsg)
+         *errMsg = ec.message();
+
+      return false;
+   }
+
+   committed = true;
+   return true;
+}
+
+} // namespace fs
+} // namespace tblgen
@@ -0,0 +1,30 @@
+#include "tblgen/Lex/CharInfo.h"
+
+namespace tblgen {
+namespace lex {
+
+#define I CHAR_IDENT
+
+const uint8_t CharInfoTable[256] = {
+   0, I, I, I, I, I, I, I, I, I, 0, I, I, 0, I, I, // 0x00
+   I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, // 0x10
+   0, 0, 0, 0, 0, I, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0x20
+   I, I, I, I, I, I, I, I, I, I, 0, 0, 0, 0, 0, 0, // 0x30
+   0, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, // 0x40
+   I, I, I, I, I, I, I, I, I, I, I, 0, 0, 0, 0, I, // 0x50
+   0, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, // 0x60
+   I, I, I, I, I, I, I, I, I, I, I, 0, 0, 0, 0, I, // 0x70
+   I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, // 0x80
+   I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, // 0x90
+   I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, // 0xA0
+   I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, // 0xB0
+   I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, // 0xC0
+   I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, // 0xD0
+   I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, // 0xE0
+   I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, // 0xF0
+};
+
+#undef I
+
+} // namespace lex
+} // namespace tblgen
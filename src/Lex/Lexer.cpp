@@ -3,6 +3,7 @@
 
 #include "tblgen/TableGen.h"
 #include "tblgen/Basic/IdentifierInfo.h"
+#include "tblgen/Lex/CharInfo.h"
 #include "tblgen/Message/DiagnosticsEngine.h"
 
 #include <cassert>
@@ -18,15 +19,15 @@ namespace lex {
 
 Lexer::Lexer(IdentifierTable &Idents,
              DiagnosticsEngine &Diags,
-             const std::string &buf,
+             std::string_view buf,
              unsigned sourceId,
              unsigned offset,
              const char InterpolationBegin,
              bool primeLexer)
    : Idents(Idents), Diags(Diags),
      sourceId(sourceId),
-     CurPtr(buf.c_str()),
-     BufStart(buf.c_str()),
+     CurPtr(buf.data()),
+     BufStart(buf.data()),
      BufEnd(CurPtr + buf.size()),
      InterpolationBegin(InterpolationBegin),
      offset(offset)
@@ -37,33 +38,60 @@ Lexer::Lexer(IdentifierTable &Idents,
 
 Lexer::Lexer(IdentifierTable &Idents,
              DiagnosticsEngine &Diags,
-             const std::vector<Token> &Tokens,
+             TokenRange Tokens,
              unsigned sourceId,
              unsigned int offset)
    : Idents(Idents), Diags(Diags),
-     LookaheadVec(Tokens.begin(), Tokens.end()),
      sourceId(sourceId), CurPtr(nullptr), BufStart(nullptr), BufEnd(nullptr),
      InterpolationBegin('$'), offset(offset), IsTokenLexer(true)
 {
-   if (LookaheadVec.empty() || !LookaheadVec.back().is(tok::eof))
-      LookaheadVec.emplace_back(tok::eof);
-
-   CurTok = LookaheadVec.front();
-   LookaheadIdx = 1;
+   reset(Tokens);
 }
 
-void Lexer::reset(const std::vector<Token> &Tokens)
+void Lexer::reset(TokenRange Tokens)
 {
    assert(IsTokenLexer && "can't reset non-token lexer");
 
    LookaheadVec.clear();
-   LookaheadVec.insert(LookaheadVec.end(), Tokens.begin(), Tokens.end());
+   LookaheadIdx = 0;
 
-   if (LookaheadVec.empty() || !LookaheadVec.back().is(tok::eof))
-      LookaheadVec.emplace_back(tok::eof);
+   TokRange = Tokens;
+   TokIdx = 0;
+   AtEOF = false;
+   RangeEndsWithEOF = !Tokens.empty()
+      && Tokens.getKind(Tokens.size() - 1) == tok::eof;
 
-   CurTok = LookaheadVec.front();
-   LookaheadIdx = 1;
+   CurTok = nextBufferedToken();
+}
+
+Token Lexer::nextBufferedToken()
+{
+   if (TokIdx < TokRange.size()) {
+      return TokRange[TokIdx++];
+   }
+
+   AtEOF = true;
+
+   // Terminate the range with an EOF token if it doesn't have one, and keep
+   // returning EOF like a regular lexer does once it reached the end.
+   if (TokIdx == TokRange.size() && !RangeEndsWithEOF) {
+      ++TokIdx;
+      return Token(tok::eof);
+   }
+
+   return Token(tok::eof, CurTok.getSourceLoc());
+}
+
+void Lexer::lexAll(TokenBuffer &Toks)
+{
+   while (true) {
+      Toks.push_back(CurTok);
+      if (CurTok.is(tok::eof)) {
+         break;
+      }
+
+      advance(false, true);
+   }
 }
 
 Token Lexer::makeEOF()
@@ -80,9 +108,15 @@ std::string_view Lexer::getCurrentIdentifier() const
 // RAII utility classes
 
 Lexer::LookaheadRAII::LookaheadRAII(Lexer &L)
-   : L(L), LastTok(L.LastTok), CurTok(L.CurTok)
+   : L(L), LastTok(L.LastTok), CurTok(L.CurTok), TokIdx(L.TokIdx),
+     Rewind(L.IsTokenLexer && L.TokRange.Buf)
 {
-
+   // The tokens are still in the buffer, so we only need to remember where
+   // we are.
+   if (Rewind) {
+      Tokens.assign(L.LookaheadVec.begin() + L.LookaheadIdx,
+                    L.LookaheadVec.end());
+   }
 }
 
 Lexer::LookaheadRAII::~LookaheadRAII()
@@ -90,6 +124,14 @@ Lexer::LookaheadRAII::~LookaheadRAII()
    L.LastTok = LastTok;
    L.CurTok = CurTok;
 
+   if (Rewind) {
+      L.TokIdx = TokIdx;
+      L.LookaheadVec = std::move(Tokens);
+      L.LookaheadIdx = 0;
+
+      return;
+   }
+
    // Keep the lookahead tokens that we didn't see yet.
    Tokens.insert(Tokens.end(), L.LookaheadVec.begin() + L.LookaheadIdx, L.LookaheadVec.end());
    L.LookaheadVec = std::move(Tokens);
@@ -99,6 +141,11 @@ Lexer::LookaheadRAII::~LookaheadRAII()
 
 void Lexer::LookaheadRAII::advance(bool ignoreNewline,
                                    bool significantWhitespace) {
+   if (Rewind) {
+      L.advance(ignoreNewline, significantWhitespace);
+      return;
+   }
+
    // Keep all tokens.
    L.advance(false, true);
 
@@ -111,6 +158,36 @@ void Lexer::LookaheadRAII::advance(bool ignoreNewline,
    Tokens.push_back(L.currentTok());
 }
 
+Lexer::ReplayRAII::ReplayRAII(Lexer &L, TokenRange Tokens)
+   : L(L), Tokens(Tokens), LastTok(L.LastTok), CurTok(L.CurTok),
+     LookaheadIdx(L.LookaheadIdx), LookaheadVec(std::move(L.LookaheadVec)),
+     TokRange(L.TokRange), TokIdx(L.TokIdx),
+     RangeEndsWithEOF(L.RangeEndsWithEOF), IsTokenLexer(L.IsTokenLexer),
+     AtEOF(L.AtEOF)
+{
+   L.IsTokenLexer = true;
+   restart();
+}
+
+Lexer::ReplayRAII::~ReplayRAII()
+{
+   L.LastTok = LastTok;
+   L.CurTok = CurTok;
+   L.LookaheadIdx = LookaheadIdx;
+   L.LookaheadVec = std::move(LookaheadVec);
+   L.TokRange = TokRange;
+   L.TokIdx = TokIdx;
+   L.RangeEndsWithEOF = RangeEndsWithEOF;
+   L.IsTokenLexer = IsTokenLexer;
+   L.AtEOF = AtEOF;
+}
+
+void Lexer::ReplayRAII::restart()
+{
+   L.LastTok = Token();
+   L.reset(Tokens);
+}
+
 void Lexer::printTokensTo(std::ostream &out)
 {
    while (!eof()) {
@@ -174,6 +251,11 @@ string Lexer::unescape_char(char c)
 
 Token Lexer::lexNextToken()
 {
+   // Some malformed tokens at the end of the buffer skip over its
+   // terminator.
+   if (CurPtr > BufEnd)
+      CurPtr = BufEnd;
+
    TokBegin = CurPtr++;
    tok::TokenType kind;
 
@@ -187,8 +269,7 @@ Token Lexer::lexNextToken()
    }
    // whitespace
    case ' ': {
-      while (*CurPtr == ' ')
-         ++CurPtr;
+      CurPtr = skipSpaces(CurPtr, BufEnd);
 
       return makeToken(TokBegin, CurPtr - TokBegin, tok::space);
    }
@@ -571,6 +652,9 @@ Token Lexer::lexStringLiteral()
    ++TokBegin;
 
    while (1) {
+      CurPtr = findFirstOf(CurPtr, BufEnd, '"', '\\', '\0',
+                           InterpolationBegin);
+
       if (*CurPtr == '"')
          break;
 
@@ -580,15 +664,15 @@ Token Lexer::lexStringLiteral()
                << "unexpected end of file, expecting '\"'"
                << SourceLocation(currentIndex() + offset - 1);
 
-            --CurPtr;
-            return makeToken(TokBegin, CurPtr - TokBegin - 1,
+            return makeToken(TokBegin, CurPtr - TokBegin,
                              tok::stringliteral);
          }
       }
       else if (*CurPtr == '\\') {
 //         if (!isModuleLexer) {
             // normal escape, e.g. "\n"
-            ++CurPtr;
+            if (CurPtr + 1 < BufEnd)
+               ++CurPtr;
 //         }
 //         else {
 //            // hex escape, e.g. "\0A"
@@ -627,6 +711,9 @@ void Lexer::lexStringInterpolation()
 
    auto &Toks = LookaheadVec;
    while (1) {
+      CurPtr = findFirstOf(CurPtr, BufEnd, '"', '\\', '\0',
+                           InterpolationBegin);
+
       if (*CurPtr == '"')
          break;
 
@@ -637,12 +724,14 @@ void Lexer::lexStringInterpolation()
                << SourceLocation(currentIndex() + offset);
 
             Toks.push_back(makeToken(CurPtr - 1, 0, tok::eof));
+            return;
          }
       }
       else if (*CurPtr == '\\') {
 //         if (!isModuleLexer) {
          // normal escape, e.g. "\n"
-         ++CurPtr;
+         if (CurPtr + 1 < BufEnd)
+            ++CurPtr;
 //         }
 //         else {
 //            // hex escape, e.g. "\0A"
@@ -674,6 +763,9 @@ void Lexer::lexStringInterpolation()
                   ++openParens; break;
                case tok::close_brace:
                   ++closeParens; break;
+               case tok::eof:
+                  Toks.push_back(tok);
+                  return;
                default:
                   break;
                }
@@ -1039,45 +1131,7 @@ Token Lexer::lexClosureArgumentName()
 
 bool Lexer::isIdentifierContinuationChar(char c)
 {
-   switch (c) {
-      case '+':
-      case '-':
-      case '*':
-      case '/':
-      case '.':
-      case '=':
-      case '<':
-      case '>':
-      case '&':
-      case '|':
-      case '!':
-      case '~':
-      case '^':
-      case ',':
-      case '(':
-      case ')':
-      case ';':
-      case '[':
-      case ']':
-      case '{':
-      case '}':
-      case '\\':
-      case '@':
-      case '`':
-      case ':':
-      case '?':
-      case '\'':
-      case '"':
-      case '\n':
-      case '\r':
-      case ' ':
-      case '\0':
-      case '$':
-      case '#':
-         return false;
-      default:
-         return true;
-   }
+   return isIdentifierChar(c);
 }
 
 static bool isMacroInvocation(const char *CurPtr)
@@ -1130,9 +1184,7 @@ static bool isMacroInvocation(const char *CurPtr)
 
 Token Lexer::lexIdentifier(tok::TokenType identifierKind, bool AllowMacro)
 {
-   while (isIdentifierContinuationChar(*CurPtr)) {
-      ++CurPtr;
-   }
+   CurPtr = skipIdentifierChars(CurPtr, BufEnd);
 
    bool IsKeyword = false;
    auto &II = Idents.get({ TokBegin, size_t(CurPtr - TokBegin) });
@@ -1232,8 +1284,7 @@ void Lexer::lexOperator()
 
 Token Lexer::skipSingleLineComment()
 {
-   while (*CurPtr != '\n' && *CurPtr != '\0')
-      ++CurPtr;
+   CurPtr = findFirstOf(CurPtr, BufEnd, '\n', '\0', '\0', '\0');
 
    return Token(TokBegin, CurPtr - TokBegin,
                 tok::line_comment,
@@ -1246,6 +1297,8 @@ Token Lexer::skipMultiLineComment()
 
    ++CurPtr;
    while (1) {
+      CurPtr = findFirstOf(CurPtr, BufEnd, '*', '\0', '\0', '\0');
+
       switch (*CurPtr++) {
          case '\0': {
             return Token(TokBegin, CurPtr - TokBegin,
@@ -1295,9 +1348,13 @@ void Lexer::advance(bool ignoreNewline,
       if (LookaheadIdx == LookaheadVec.size()) {
          LookaheadVec.clear();
          LookaheadIdx = 0;
-         AtEOF |= IsTokenLexer;
+         AtEOF |= IsTokenLexer && !TokRange.Buf;
       }
    }
+   else if (IsTokenLexer) {
+      /// Get the next prelexed token.
+      CurTok = nextBufferedToken();
+   }
    else {
       /// Lex the next token.
       CurTok = lexNextToken();
@@ -1335,6 +1392,11 @@ Token Lexer::lookahead(bool ignoreNewline, bool sw, size_t offset)
 
    /// Lex as many tokens as necessary for the required lookahead.
    while (LookaheadVec.size() <= LookaheadIdx + offset) {
+      if (IsTokenLexer) {
+         LookaheadVec.push_back(nextBufferedToken());
+         continue;
+      }
+
       LookaheadVec.push_back(lexNextToken());
    }
 
@@ -0,0 +1,195 @@
+#include "tblgen/Lex/ParallelIncludeLexer.h"
+
+#include "tblgen/Basic/IdentifierInfo.h"
+#include "tblgen/Lex/Lexer.h"
+#include "tblgen/Message/DiagnosticsEngine.h"
+#include "tblgen/Support/Allocator.h"
+#include "tblgen/Support/ThreadPool.h"
+#include "tblgen/Support/Timer.h"
+#include "tblgen/TableGen.h"
+
+#include <filesystem>
+#include <unordered_map>
+#include <unordered_set>
+
+using std::string;
+
+namespace tblgen {
+namespace lex {
+
+struct ParallelIncludeLexer::PrelexedFile {
+   explicit PrelexedFile(const fs::OpenFile &File)
+      : File(File), Idents(Allocator, 256), Tokens(File.Buf, File.BaseOffset)
+   {}
+
+   /// The file to lex.
+   fs::OpenFile File;
+
+   /// Private allocator for the identifier table of this file.
+   support::ArenaAllocator Allocator;
+
+   /// Private identifier table, so that workers don't have to synchronize.
+   IdentifierTable Idents;
+
+   /// The lexed tokens, including whitespace and the final EOF token.
+   TokenBuffer Tokens;
+
+   /// True if the lexer reported an error for this file.
+   bool HadErrors = false;
+};
+
+ParallelIncludeLexer::ParallelIncludeLexer(TableGen &TG, unsigned NumThreads)
+   : TG(TG), NumThreads(NumThreads)
+{
+
+}
+
+ParallelIncludeLexer::~ParallelIncludeLexer()
+{
+
+}
+
+void ParallelIncludeLexer::lexFile(PrelexedFile &F)
+{
+   F.Idents.addTblGenKeywords();
+
+   // Diagnostics can't be emitted from worker threads. Files with lexing
+   // errors are lexed again by the parser, which reports them in order.
+   DiagnosticsEngine Diags(F.Allocator);
+   Lexer Lex(F.Idents, Diags, F.File.Buf, F.File.SourceId,
+             F.File.BaseOffset, '\0');
+
+   Lex.lexAll(F.Tokens);
+   F.HadErrors = Diags.getNumErrors() != 0;
+}
+
+void ParallelIncludeLexer::collectIncludes(
+                        const PrelexedFile &F,
+                        std::vector<std::unique_ptr<PrelexedFile>> &Result) {
+   auto &Toks = F.Tokens;
+   auto nextTok = [&](size_t i) {
+      ++i;
+      while (i < Toks.size()
+             && Toks[i].oneOf(tok::space, tok::line_comment,
+                              tok::block_comment)) {
+         ++i;
+      }
+
+      return i;
+   };
+
+   for (size_t i = 0; i < Toks.size(); ++i) {
+      if (!Toks[i].isIdentifier("include")) {
+         continue;
+      }
+
+      // Only consider includes of a single string literal, anything more
+      // complex is left to the parser.
+      size_t FileNameIdx = nextTok(i);
+      if (FileNameIdx == Toks.size()
+            || !Toks[FileNameIdx].is(tok::stringliteral)) {
+         continue;
+      }
+
+      size_t EndIdx = nextTok(FileNameIdx);
+      if (EndIdx != Toks.size()
+            && !Toks[EndIdx].oneOf(tok::newline, tok::eof)) {
+         continue;
+      }
+
+      auto file = Toks[FileNameIdx].getText();
+      if (file.empty() || file.find('\\') != std::string_view::npos) {
+         continue;
+      }
+
+      string realFile;
+      try {
+         realFile = TG.findIncludeFile(file, F.File.SourceId);
+      }
+      catch (std::filesystem::filesystem_error&) {
+         continue;
+      }
+
+      if (realFile.empty()) {
+         continue;
+      }
+
+      auto optBuf = TG.fileMgr.openFile(realFile);
+      if (!optBuf) {
+         continue;
+      }
+
+      auto &buf = optBuf.getValue();
+      if (!Seen.insert(buf.SourceId).second) {
+         continue;
+      }
+
+      Result.push_back(std::make_unique<PrelexedFile>(buf));
+   }
+}
+
+void ParallelIncludeLexer::remapIdentifiers(PrelexedFile &F)
+{
+   std::unordered_map<const void*, IdentifierInfo*> IdentMap;
+   for (auto &Entry : F.Idents) {
+      IdentMap.emplace(Entry.second, &TG.getIdents().get(Entry.first));
+   }
+
+   // Pointers that are not identifiers of this file, e.g. into the source
+   // buffer, are kept.
+   F.Tokens.remapPointers([&](const void *Ptr) -> const void* {
+      auto it = IdentMap.find(Ptr);
+      if (it == IdentMap.end())
+         return Ptr;
+
+      return it->second;
+   });
+
+   F.Tokens.finish();
+}
+
+void ParallelIncludeLexer::run(const fs::OpenFile &Root)
+{
+   support::TimeRegion Timer("Lex", {}, "parallel includes");
+   support::ThreadPool Pool(NumThreads);
+   TG.getIdents().addTblGenKeywords();
+
+   std::vector<std::unique_ptr<PrelexedFile>> Files;
+   Files.push_back(std::make_unique<PrelexedFile>(Root));
+   Seen.insert(Root.SourceId);
+
+   // Lex the include graph breadth first. All files of one level are lexed
+   // in parallel; the includes they contain are then opened serially in
+   // declaration order, so that source IDs don't depend on scheduling.
+   size_t LevelBegin = 0;
+   while (LevelBegin != Files.size()) {
+      size_t LevelEnd = Files.size();
+      for (size_t i = LevelBegin; i < LevelEnd; ++i) {
+         PrelexedFile *F = Files[i].get();
+         Pool.async([F] { lexFile(*F); });
+      }
+
+      Pool.wait();
+
+      for (size_t i = LevelBegin; i < LevelEnd; ++i) {
+         collectIncludes(*Files[i], Files);
+      }
+
+      LevelBegin = LevelEnd;
+   }
+
+   // The root file is parsed from its buffer, so we only needed its tokens
+   // to find its includes.
+   for (size_t i = 1; i < Files.size(); ++i) {
+      auto &F = *Files[i];
+      if (F.HadErrors) {
+         continue;
+      }
+
+      remapIdentifiers(F);
+      TG.addPrelexedTokens(F.File.SourceId, std::move(F.Tokens));
+   }
+}
+
+} // namespace lex
+} // namespace tblgen
@@ -0,0 +1,78 @@
+#include "tblgen/Lex/TokenBuffer.h"
+
+namespace tblgen {
+namespace lex {
+
+TokenBuffer::TokenBuffer(std::string_view Src, unsigned BaseOffset)
+   : Src(Src), BaseOffset(BaseOffset)
+{
+   Payloads.push_back(Payload{ nullptr, 0, false });
+}
+
+void TokenBuffer::push_back(const Token &Tok)
+{
+   unsigned Offset = Tok.getOffset();
+   Payload P{ Tok.Ptr, Tok.Data, false };
+
+   // Text that is part of the source is stored relative to the token, so
+   // that e.g. all string literals of the same length share a payload.
+   auto *Text = static_cast<const char*>(Tok.Ptr);
+   if (Text && !Src.empty()
+       && Text >= Src.data() && Text <= Src.data() + Src.size()
+       && Offset >= BaseOffset) {
+      P.Ptr = reinterpret_cast<const void*>(
+         Text - (Src.data() + (Offset - BaseOffset)));
+      P.Relative = true;
+   }
+
+   unsigned Idx = 0;
+   if (P.Ptr || P.Data) {
+      auto It = PayloadMap.try_emplace(P, unsigned(Payloads.size()));
+      if (It.second) {
+         Payloads.push_back(P);
+      }
+
+      Idx = It.first->second;
+   }
+
+   Kinds.push_back(Tok.getKind());
+   Offsets.push_back(Offset);
+   PayloadIndices.push_back(Idx);
+}
+
+Token TokenBuffer::operator[](size_t Idx) const
+{
+   auto &P = Payloads[PayloadIndices[Idx]];
+   unsigned Offset = Offsets[Idx];
+
+   void *Ptr = const_cast<void*>(P.Ptr);
+   if (P.Relative) {
+      Ptr = const_cast<char*>(Src.data() + (Offset - BaseOffset)
+                              + reinterpret_cast<std::ptrdiff_t>(P.Ptr));
+   }
+
+   return Token(Kinds[Idx], SourceLocation(Offset), P.Data, Ptr);
+}
+
+void TokenBuffer::finish()
+{
+   PayloadMap = {};
+
+   Kinds.shrink_to_fit();
+   Offsets.shrink_to_fit();
+   PayloadIndices.shrink_to_fit();
+   Payloads.shrink_to_fit();
+}
+
+size_t TokenBuffer::getMemoryUsage() const
+{
+   return Kinds.capacity() * sizeof(tok::TokenType)
+      + Offsets.capacity() * sizeof(unsigned)
+      + PayloadIndices.capacity() * sizeof(unsigned)
+      + Payloads.capacity() * sizeof(Payload)
+      + PayloadMap.size() * (sizeof(Payload) + sizeof(unsigned)
+                             + 2 * sizeof(void*));
+}
+
+} // namespace lex
+} // namespace tblgen
@@ -36,7 +36,7 @@ static std::string_view getMessage(MessageKind msg)
 }
 
 DiagnosticBuilder::DiagnosticBuilder(DiagnosticsEngine &Engine)
-   : Engine(Engine), msg(_first_err), showWiggle(false), showWholeLine(false),
+   : Engine(Engine), Lock(Engine.Mtx), msg(_first_err), showWiggle(false), showWholeLine(false),
      noInstCtx(false), noteMemberwiseInit(false), valid(false),
      noExpansionInfo(false), noImportInfo(false), hasFakeSourceLoc(false),
      ShowConst(false), Disabled(false)
@@ -47,7 +47,7 @@ DiagnosticBuilder::DiagnosticBuilder(DiagnosticsEngine &Engine)
 
 DiagnosticBuilder::DiagnosticBuilder(DiagnosticsEngine &Engine,
                                      MessageKind msg)
-   : Engine(Engine), msg(msg), showWiggle(false), showWholeLine(false),
+   : Engine(Engine), Lock(Engine.Mtx), msg(msg), showWiggle(false), showWholeLine(false),
      noInstCtx(false), noteMemberwiseInit(false), valid(true),
      noExpansionInfo(false), noImportInfo(false), hasFakeSourceLoc(false),
      ShowConst(false), Disabled(false)
@@ -72,7 +72,10 @@ string DiagnosticBuilder::prepareMessage(std::string_view str)
 {
    std::string buf(str);
 
-   IdentifierTable IT(Engine.Allocator, 16);
+   // Use a private allocator, the engine's one may be shared with threads
+   // that don't hold the diagnostic lock.
+   ArenaAllocator Allocator;
+   IdentifierTable IT(Allocator, 16);
 
    Lexer lex(IT, Engine, buf, 0, 1, '$', false);
    lex.lexDiagnostic();
@@ -311,7 +314,7 @@ void DiagnosticBuilder::finalize()
       return;
    }
 
-   if (!Engine.NumSourceRanges) {
+   if (!Engine.NumSourceRanges || !Engine.FileMgr) {
       out << "\n";
       out.flush();
       Engine.finalizeDiag(out.str(), severity);
@@ -327,9 +330,9 @@ void DiagnosticBuilder::finalize()
    size_t ID = Engine.FileMgr->getSourceId(loc);
    auto File = Engine.FileMgr->getOpenedFile(ID);
 
-   const std::string &Buf = File.Buf;
+   std::string_view Buf = File.Buf;
    size_t srcLen = Buf.size();
-   const char *src = Buf.c_str();
+   const char *src = Buf.data();
 
    // show file name, line number and column
    auto lineAndCol = Engine.FileMgr->getLineAndCol(loc, Buf);
@@ -363,7 +366,7 @@ void DiagnosticBuilder::finalize()
       Len = lineEndIndex - newlineIndex - 1;
    }
 
-   std::string_view ErrLine(Buf.c_str() + newlineIndex + 1, Len);
+   std::string_view ErrLine(Buf.data() + newlineIndex + 1, Len);
 
    // show carets for any given single source location, and tildes for source
    // ranges (but only on the error line)
@@ -8,8 +8,8 @@
 #include "tblgen/Basic/FileUtils.h"
 #include "tblgen/Support/Casting.h"
 #include "tblgen/Support/LiteralParser.h"
-#include "tblgen/Support/SaveAndRestore.h"
 #include "tblgen/Support/StringSwitch.h"
+#include "tblgen/Support/Timer.h"
 
 #include <iostream>
 #include <sstream>
@@ -23,7 +23,7 @@ using std::string;
 namespace tblgen {
 
 Parser::Parser(TableGen &TG,
-               const std::string &Buf,
+               std::string_view Buf,
                unsigned sourceId,
                unsigned baseOffset)
    : TG(TG), lex(TG.getIdents(), TG.Diags, Buf, sourceId,
@@ -34,7 +34,7 @@ Parser::Parser(TableGen &TG,
 }
 
 Parser::Parser(TableGen &TG,
-               const std::vector<Token> &Toks,
+               TokenRange Toks,
                unsigned sourceId,
                unsigned baseOffset)
    : TG(TG), lex(TG.getIdents(), TG.Diags, Toks, sourceId, baseOffset),
@@ -51,6 +51,9 @@ Parser::~Parser()
 void Parser::abortBP()
 {
    std::cout.flush();
+   if (TG.throwsOnFatalError())
+      throw FatalError();
+
    std::exit(1);
 }
 
@@ -70,27 +73,35 @@ bool Parser::parse()
 void Parser::parseNextDecl()
 {
    if (currentTok().is(tok::kw_class)) {
+      TimeRegion Timer("Parse", "class");
       parseClass();
    }
    else if (currentTok().is(tok::kw_def)) {
+      TimeRegion Timer("Parse", "def");
       parseRecord();
    }
    else if (currentTok().is(tok::kw_enum)) {
+      TimeRegion Timer("Parse", "enum");
       parseEnum();
    }
    else if (currentTok().is(tok::kw_let)) {
+      TimeRegion Timer("Parse", "let");
       parseValue();
    }
    else if (currentTok().is(tok::kw_namespace)) {
+      TimeRegion Timer("Parse", "namespace");
       parseNamespace();
    }
    else if (currentTok().is(tok::tblgen_if)) {
+      TimeRegion Timer("Parse", "if");
       parseIf();
    }
    else if (currentTok().is(tok::tblgen_foreach)) {
+      TimeRegion Timer("Parse", "foreach");
       parseForEach();
    }
    else if (currentTok().is(tok::tblgen_print)) {
+      TimeRegion Timer("Parse", "print");
       parsePrint();
    }
    else if (currentTok().isIdentifier("include")) {
@@ -405,7 +416,7 @@ static TemplateParamResult checkTemplateParams(Class &C,
 
 void Parser::parseOverrideDecl(Class *C, bool isAppend)
 {
-   assert(currentTok().isIdentifier("override"));
+   assert(currentTok().isIdentifier(isAppend ? "append" : "override"));
    advance();
 
    auto loc = currentTok().getSourceLoc();
@@ -870,8 +881,7 @@ void Parser::parseInclude()
    }
 
    auto file = cast<StringLiteral>(fileName)->getVal();
-   string path(fs::getPath(TG.fileMgr.getFileName(lex.getSourceId())));
-   auto realFile = fs::findFileInDirectories(file, std::vector<string>{path});
+   auto realFile = TG.findIncludeFile(file, lex.getSourceId());
 
    auto optBuf = TG.fileMgr.openFile(realFile);
    if (!optBuf) {
@@ -883,6 +893,24 @@ void Parser::parseInclude()
    }
 
    auto &buf = optBuf.getValue();
+
+   // The file name tells nested includes apart in traces.
+   TimeRegion Timer("Parse", "include", realFile);
+
+   auto *Toks = TG.getPrelexedTokens(buf.SourceId);
+   if (!Toks && TG.shouldPrelexFiles()) {
+      Toks = TG.prelexFile(buf);
+   }
+
+   if (Toks) {
+      Parser parser(TG, *Toks, buf.SourceId, buf.BaseOffset);
+      if (!parser.parse()) {
+         abortBP();
+      }
+
+      return;
+   }
+
    Parser parser(TG, buf.Buf, buf.SourceId, buf.BaseOffset);
    if (!parser.parse()) {
       abortBP();
@@ -964,61 +992,26 @@ void Parser::parseForEach(Class *C, Record *R)
    expect(tok::open_brace);
    advance();
 
-   if (auto L = dyn_cast<ListLiteral>(Range)) {
-      for (auto &V : L->getValues()) {
-         Lexer::LookaheadRAII LR(lex);
-         auto SAR = support::saveAndRestore(this->LR, &LR);
-
-         ForEachScope scope(*this, name, V);
-
-         while (!currentTok().is(tok::close_brace)) {
-            if (R) {
-               parseRecordLevelDecl(R);
-            }
-            else if (C) {
-               parseClassLevelDecl(C);
-            }
-            else {
-               parseNextDecl();
-            }
-
-            LR.advance();
-         }
-      }
-   }
-   else if (auto D = dyn_cast<DictLiteral>(Range)) {
-      for (auto &V : D->getValues()) {
-         Lexer::LookaheadRAII LR(lex);
-         auto SAR = support::saveAndRestore(this->LR, &LR);
-
-         ForEachScope scope(*this, name, V.second);
-
-         while (!currentTok().is(tok::close_brace)) {
-            if (R) {
-               parseRecordLevelDecl(R);
-            }
-            else if (C) {
-               parseClassLevelDecl(C);
-            }
-            else {
-               parseNextDecl();
-            }
-
-            LR.advance();
-         }
-      }
-   }
-   else {
-      unreachable("hmmm...");
-   }
+   // Collect the tokens of the body once, up to and including the closing
+   // brace. Every element is then parsed from this buffer instead of
+   // re-lexing or recording the body again.
+   TokenBuffer Body(TG.fileMgr.getBuffer(lex.getSourceId()), lex.getOffset());
 
    unsigned Open = 1;
    unsigned Close = 0;
 
    while (true) {
+      Body.push_back(currentTok());
+
       switch (currentTok().getKind()) {
       case tok::open_brace: ++Open; break;
       case tok::close_brace: ++Close; break;
+      case tok::eof:
+         TG.Diags.Diag(err_generic_error)
+            << "unexpected end of file, expecting '}'"
+            << currentTok().getSourceLoc();
+
+         abortBP();
       default:
          break;
       }
@@ -1026,7 +1019,45 @@ void Parser::parseForEach(Class *C, Record *R)
       if (Open == Close)
          break;
 
-      advance();
+      lex.advance(false, true);
+   }
+
+   Body.finish();
+
+   ForEachScope scope(*this, name);
+   Lexer::ReplayRAII Replay(lex, Body);
+
+   auto parseBody = [&](Value *V) {
+      Replay.restart();
+      scope.setValue(V);
+
+      while (!currentTok().is(tok::close_brace)) {
+         if (R) {
+            parseRecordLevelDecl(R);
+         }
+         else if (C) {
+            parseClassLevelDecl(C);
+         }
+         else {
+            parseNextDecl();
+         }
+
+         advance();
+      }
+   };
+
+   if (auto L = dyn_cast<ListLiteral>(Range)) {
+      for (auto &V : L->getValues()) {
+         parseBody(V);
+      }
+   }
+   else if (auto D = dyn_cast<DictLiteral>(Range)) {
+      for (auto &V : D->getValues()) {
+         parseBody(V.second);
+      }
+   }
+   else {
+      unreachable("hmmm...");
    }
 }
 
@@ -1167,7 +1198,7 @@ Value* Parser::parseExpr(Type *contextualTy)
          APSInt = -APSInt;
       }
 
-      return new(TG) IntegerLiteral(contextualTy, APSInt);
+      return TG.getIntegerLiteral(contextualTy, APSInt);
    }
 
    if (currentTok().is(tok::fpliteral)) {
@@ -1183,7 +1214,7 @@ Value* Parser::parseExpr(Type *contextualTy)
          APFloat = -APFloat;
       }
 
-      return new(TG) FPLiteral(contextualTy, APFloat);
+      return TG.getFPLiteral(contextualTy, APFloat);
    }
 
    if (isNegated) {
@@ -1195,16 +1226,15 @@ Value* Parser::parseExpr(Type *contextualTy)
    }
 
    if (currentTok().is(tok::stringliteral)) {
-      return new(TG) StringLiteral(TG.getStringTy(),
-                                   std::string(currentTok().getText()));
+      return TG.getStringLiteral(TG.getStringTy(), currentTok().getText());
    }
 
    if (currentTok().oneOf(tok::kw_true, tok::kw_false)) {
-      return new(TG) IntegerLiteral(TG.getInt1Ty(), (uint64_t)currentTok().is(tok::kw_true));
+      return TG.getIntegerLiteral(TG.getInt1Ty(), (uint64_t)currentTok().is(tok::kw_true));
    }
 
    if (currentTok().is(tok::charliteral)) {
-      return new(TG) IntegerLiteral(TG.getInt8Ty(), (uint64_t)currentTok().getText().front());
+      return TG.getIntegerLiteral(TG.getInt8Ty(), (uint64_t)currentTok().getText().front());
    }
 
    if (currentTok().is(tok::exclaim)) {
@@ -1580,11 +1610,17 @@ Value* Parser::parseExpr(Type *contextualTy)
 
 static bool Equals(Value *LHS, Value *RHS)
 {
+   // Literals are interned, so equal literals of the same type are
+   // identical.
+   if (LHS == RHS)
+      return true;
+
    bool Result = false;
    if (LHS->getTypeID() == RHS->getTypeID()) {
       switch (LHS->getTypeID()) {
       case Value::IntegerLiteralID:
-         Result = cast<IntegerLiteral>(LHS)->getVal()
+         Result = LHS->getType() != RHS->getType()
+            && cast<IntegerLiteral>(LHS)->getVal()
                   == cast<IntegerLiteral>(RHS)->getVal();
          break;
       case Value::FPLiteralID:
@@ -1592,7 +1628,8 @@ static bool Equals(Value *LHS, Value *RHS)
                   cast<FPLiteral>(RHS)->getVal();
          break;
       case Value::StringLiteralID:
-         Result = cast<StringLiteral>(LHS)->getVal()
+         Result = LHS->getType() != RHS->getType()
+            && cast<StringLiteral>(LHS)->getVal()
                   == cast<StringLiteral>(RHS)->getVal();
          break;
       case Value::CodeBlockID:
@@ -1609,7 +1646,7 @@ static bool Equals(Value *LHS, Value *RHS)
          break;
       case Value::ListLiteralID: {
          auto &values1 = cast<ListLiteral>(LHS)->getValues();
-         auto &values2 = cast<ListLiteral>(LHS)->getValues();
+         auto &values2 = cast<ListLiteral>(RHS)->getValues();
 
          if (values1.size() == values2.size()) {
             Result = true;
@@ -1631,11 +1668,78 @@ static bool Equals(Value *LHS, Value *RHS)
    return Result;
 }
 
+Type *Parser::getQueryFieldType(Class *C, const std::string &fieldName)
+{
+   auto *F = C->getField(fieldName);
+   if (!F || !RecordIndex::supportsType(F->getType()))
+      return nullptr;
+
+   return F->getType();
+}
+
+const RecordIndex &Parser::getRecordIndex(Class *C,
+                                          const std::string &fieldName,
+                                          SourceLocation loc,
+                                          bool withOrder)
+{
+   auto *F = C->getField(fieldName);
+   if (!F) {
+      TG.Diags.Diag(err_generic_error)
+         << "class " + C->getName() + " does not have a field named "
+            + fieldName
+         << loc;
+
+      abortBP();
+   }
+
+   if (!getQueryFieldType(C, fieldName)) {
+      TG.Diags.Diag(err_generic_error)
+         << "field " + fieldName + " of type " + F->getType()->toString()
+            + " cannot be indexed"
+         << loc;
+
+      abortBP();
+   }
+
+   return TG.getRecordIndex(*RK, C, fieldName, withOrder);
+}
+
+void Parser::queryRecords(Class *C, const std::string &fieldName,
+                          RecordIndex::Predicate Pred, Value *Val,
+                          SourceLocation loc, std::vector<unsigned> &Result)
+{
+   auto &Index = getRecordIndex(C, fieldName, loc);
+   auto *F = C->getField(fieldName);
+
+   if (!Index.supportsPredicate(Pred)) {
+      TG.Diags.Diag(err_generic_error)
+         << "ordered comparison of field " + fieldName + " of type "
+            + F->getType()->toString() + " is not supported"
+         << loc;
+
+      abortBP();
+   }
+
+   if (!Index.supportsValue(Val)) {
+      TG.Diags.Diag(err_generic_error)
+         << "cannot compare field " + fieldName + " of type "
+            + F->getType()->toString() + " with value of type "
+            + Val->getType()->toString()
+         << loc;
+
+      abortBP();
+   }
+
+   Index.query(Pred, Val, Result);
+}
+
 Value* Parser::parseFunction(Type *contextualTy)
 {
    enum FuncKind {
       Unknown,
       AllOf,
+      Where,
+      Sort,
       Concat,
       Push,
       Pop,
@@ -1662,6 +1766,8 @@ Value* Parser::parseFunction(Type *contextualTy)
    auto func = tryParseIdentifier();
    auto kind = StringSwitch<FuncKind>(func)
       .Case("allof", AllOf)
+      .Case("where", Where)
+      .Case("sort", Sort)
       .Case("push", Push)
       .Case("pop", Pop)
       .Case("line", First)
@@ -1692,6 +1798,8 @@ Value* Parser::parseFunction(Type *contextualTy)
       .Case("access_field", AccessField)
       .Default(Unknown);
 
+   TimeRegion Timer("Function", func);
+
    expect(tok::open_paren);
    auto parenLoc = currentTok().getSourceLoc();
 
@@ -1701,8 +1809,17 @@ Value* Parser::parseFunction(Type *contextualTy)
    std::vector<Value*> args;
 
    while (!currentTok().is(tok::close_paren)) {
+      // The value a query compares to can be an enum case like '.Bird',
+      // which needs the type of the queried field.
+      Type *argTy = nullptr;
+      if (kind == Where && args.size() >= 2
+            && isa<StringLiteral>(args[0]) && isa<StringLiteral>(args[1])) {
+         if (auto *C = RK->lookupClass(cast<StringLiteral>(args[0])->getVal()))
+            argTy = getQueryFieldType(C, cast<StringLiteral>(args[1])->getVal());
+      }
+
       argLocs.push_back(currentTok().getSourceLoc());
-      args.push_back(parseExpr());
+      args.push_back(parseExpr(argTy));
 
       advance();
       if (currentTok().is(tok::comma))
@@ -1769,6 +1886,101 @@ Value* Parser::parseFunction(Type *contextualTy)
 
       return new(TG) ListLiteral(listTy, move(vals));
    }
+   case Where: {
+      if (args.size() != 3 && args.size() != 4) {
+         TG.Diags.Diag(err_generic_error)
+            << "function " + func + " expects 3 or 4 arguments"
+            << parenLoc;
+
+         abortBP();
+      }
+
+      EXPECT_ARG_VALUE(0, StringLiteral);
+      EXPECT_ARG_VALUE(1, StringLiteral);
+
+      auto className = cast<StringLiteral>(args[0])->getVal();
+      auto C = RK->lookupClass(className);
+      if (!C) {
+         TG.Diags.Diag(err_generic_error)
+            << "class " + className + " does not exist"
+            << argLocs[0];
+
+         abortBP();
+      }
+
+      auto Pred = RecordIndex::Eq;
+      if (args.size() == 4) {
+         EXPECT_ARG_VALUE(2, StringLiteral);
+
+         auto op = cast<StringLiteral>(args[2])->getVal();
+         auto PredOrNone = StringSwitch<int>(op)
+            .Case("==", RecordIndex::Eq)
+            .Case("!=", RecordIndex::Ne)
+            .Case("<", RecordIndex::Lt)
+            .Case("<=", RecordIndex::Le)
+            .Case(">", RecordIndex::Gt)
+            .Case(">=", RecordIndex::Ge)
+            .Default(-1);
+
+         if (PredOrNone == -1) {
+            TG.Diags.Diag(err_generic_error)
+               << "invalid comparison operator '" + op + "'"
+               << argLocs[2];
+
+            abortBP();
+         }
+
+         Pred = (RecordIndex::Predicate)PredOrNone;
+      }
+
+      std::vector<unsigned> Positions;
+      queryRecords(C, cast<StringLiteral>(args[1])->getVal(), Pred,
+                   args.back(), argLocs.back(), Positions);
+
+      auto &Records = RK->getDefinitionsOf(C);
+
+      std::vector<Value *> vals;
+      for (unsigned i : Positions)
+         vals.push_back(new(TG) RecordVal(TG.getRecordType(Records[i]),
+                                          Records[i]));
+
+      Type *listTy = TG.getListType(TG.getClassType(C));
+      if (contextualTy && typesCompatible(listTy, contextualTy))
+         listTy = contextualTy;
+
+      return new(TG) ListLiteral(listTy, move(vals));
+   }
+   case Sort: {
+      EXPECT_NUM_ARGS(2);
+      EXPECT_ARG_VALUE(0, StringLiteral);
+      EXPECT_ARG_VALUE(1, StringLiteral);
+
+      auto className = cast<StringLiteral>(args[0])->getVal();
+      auto C = RK->lookupClass(className);
+      if (!C) {
+         TG.Diags.Diag(err_generic_error)
+            << "class " + className + " does not exist"
+            << argLocs[0];
+
+         abortBP();
+      }
+
+      auto &Index = getRecordIndex(C, cast<StringLiteral>(args[1])->getVal(),
+                                   argLocs[1], true);
+
+      auto &Records = RK->getDefinitionsOf(C);
+
+      std::vector<Value *> vals;
+      for (unsigned i : Index.getOrder())
+         vals.push_back(new(TG) RecordVal(TG.getRecordType(Records[i]),
+                                          Records[i]));
+
+      Type *listTy = TG.getListType(TG.getClassType(C));
+      if (contextualTy && typesCompatible(listTy, contextualTy))
+         listTy = contextualTy;
+
+      return new(TG) ListLiteral(listTy, move(vals));
+   }
    case Push: {
       EXPECT_NUM_ARGS(2);
       EXPECT_ARG_VALUE(0, ListLiteral);
@@ -1887,7 +2099,7 @@ Value* Parser::parseFunction(Type *contextualTy)
          EXPECT_ARG_VALUE(0, ListLiteral);
       }
 
-      return new(TG) IntegerLiteral(TG.getInt1Ty(), (uint64_t)result);
+      return TG.getIntegerLiteral(TG.getInt1Ty(), (uint64_t)result);
    }
    case ContainsKey: {
       EXPECT_NUM_ARGS(2);
@@ -1906,7 +2118,7 @@ Value* Parser::parseFunction(Type *contextualTy)
          }
       }
 
-      return new(TG) IntegerLiteral(TG.getInt1Ty(), (uint64_t)result);
+      return TG.getIntegerLiteral(TG.getInt1Ty(), (uint64_t)result);
    }
    case Concat: {
       EXPECT_NUM_ARGS(2);
@@ -1950,7 +2162,7 @@ Value* Parser::parseFunction(Type *contextualTy)
          str += cast<StringLiteral>(Arg)->getVal();
       }
 
-      return new(TG) StringLiteral(args.front()->getType(), move(str));
+      return TG.getStringLiteral(args.front()->getType(), str);
    }
    case ToString: {
       if (args.empty()) {
@@ -1961,7 +2173,7 @@ Value* Parser::parseFunction(Type *contextualTy)
       std::ostringstream OS;
       OS << args[0];
 
-      return new(TG) StringLiteral(TG.getStringTy(), OS.str()); 
+      return TG.getStringLiteral(TG.getStringTy(), OS.str()); 
    }
    case Upper: {
       EXPECT_NUM_ARGS(1);
@@ -1970,7 +2182,7 @@ Value* Parser::parseFunction(Type *contextualTy)
       std::string str(cast<StringLiteral>(args[0])->getVal());
       std::transform(str.begin(), str.end(), str.begin(), [](unsigned char c){ return std::toupper(c); });
 
-      return new(TG) StringLiteral(TG.getStringTy(), move(str));
+      return TG.getStringLiteral(TG.getStringTy(), str);
    }
    case Lower: {
       EXPECT_NUM_ARGS(1);
@@ -1979,13 +2191,13 @@ Value* Parser::parseFunction(Type *contextualTy)
       std::string str(cast<StringLiteral>(args[0])->getVal());
       std::transform(str.begin(), str.end(), str.begin(), [](unsigned char c){ return std::tolower(c); });
 
-      return new(TG) StringLiteral(TG.getStringTy(), move(str));
+      return TG.getStringLiteral(TG.getStringTy(), str);
    }
    case Not: {
       EXPECT_NUM_ARGS(1);
       EXPECT_ARG_VALUE(0, IntegerLiteral);
 
-      return new(TG) IntegerLiteral(TG.getInt1Ty(), (uint64_t)(cast<IntegerLiteral>(args[0])->getVal() == 0));
+      return TG.getIntegerLiteral(TG.getInt1Ty(), (uint64_t)(cast<IntegerLiteral>(args[0])->getVal() == 0));
    }
    case Empty: {
       EXPECT_NUM_ARGS(1);
@@ -2011,7 +2223,7 @@ Value* Parser::parseFunction(Type *contextualTy)
          abortBP();
       }
 
-      return new(TG) IntegerLiteral(TG.getInt1Ty(), (uint64_t)Result);
+      return TG.getIntegerLiteral(TG.getInt1Ty(), (uint64_t)Result);
    }
    case Eq:
    case Ne: {
@@ -2025,7 +2237,7 @@ Value* Parser::parseFunction(Type *contextualTy)
          Result = !Result;
       }
 
-      return new(TG) IntegerLiteral(TG.getInt1Ty(), (uint64_t)Result);
+      return TG.getIntegerLiteral(TG.getInt1Ty(), (uint64_t)Result);
    }
    case Gt: case Lt: case Ge: case Le: {
       EXPECT_NUM_ARGS(2);
@@ -2087,7 +2299,7 @@ Value* Parser::parseFunction(Type *contextualTy)
          }
       }
 
-      return new(TG) IntegerLiteral(TG.getInt1Ty(), (uint64_t)Result);
+      return TG.getIntegerLiteral(TG.getInt1Ty(), (uint64_t)Result);
    }
    case Add: case Sub: case Mul: case Div: {
       EXPECT_NUM_ARGS(2);
@@ -2120,7 +2332,7 @@ Value* Parser::parseFunction(Type *contextualTy)
                break;
             }
 
-            return new(TG) IntegerLiteral(cast<IntegerLiteral>(LHS)->getType(), Result);
+            return TG.getIntegerLiteral(cast<IntegerLiteral>(LHS)->getType(), Result);
          }
          case Value::FPLiteralID:
             double Result;
@@ -2145,7 +2357,7 @@ Value* Parser::parseFunction(Type *contextualTy)
                break;
             }
 
-            return new(TG) FPLiteral(cast<FPLiteral>(LHS)->getType(), Result);
+            return TG.getFPLiteral(cast<FPLiteral>(LHS)->getType(), Result);
          default:
             break;
          }
@@ -2159,7 +2371,7 @@ Value* Parser::parseFunction(Type *contextualTy)
          return TG.getUndef();
       }
 
-      return new(TG) StringLiteral(TG.getStringTy(), std::string(cast<RecordVal>(args[0])->getRecord()->getName()));
+      return TG.getStringLiteral(TG.getStringTy(), cast<RecordVal>(args[0])->getRecord()->getName());
    case ClassName: {
       EXPECT_NUM_ARGS(1);
       if (!isa<RecordVal>(args[0])) {
@@ -2172,7 +2384,7 @@ Value* Parser::parseFunction(Type *contextualTy)
             << "record " + cast<RecordVal>(args[0])->getRecord()->getName() + " does not have a unique base class";
       }
 
-      return new(TG) StringLiteral(TG.getStringTy(), std::string(bases[0].getBase()->getName()));
+      return TG.getStringLiteral(TG.getStringTy(), bases[0].getBase()->getName());
    }
    case CaseName:
       EXPECT_NUM_ARGS(1);
@@ -2180,14 +2392,14 @@ Value* Parser::parseFunction(Type *contextualTy)
          return TG.getUndef();
       }
 
-      return new(TG) StringLiteral(TG.getStringTy(), std::string(cast<EnumVal>(args[0])->getCase()->caseName));
+      return TG.getStringLiteral(TG.getStringTy(), cast<EnumVal>(args[0])->getCase()->caseName);
    case CaseValue:
       EXPECT_NUM_ARGS(1);
       if (!isa<EnumVal>(args[0])) {
          return TG.getUndef();
       }
 
-      return new(TG) IntegerLiteral(TG.getInt64Ty(), cast<EnumVal>(args[0])->getCase()->caseValue);
+      return TG.getIntegerLiteral(TG.getInt64Ty(), cast<EnumVal>(args[0])->getCase()->caseValue);
    case AccessField: {
       EXPECT_NUM_ARGS(2);
       EXPECT_ARG_VALUE(1, StringLiteral);
@@ -3,6 +3,7 @@
 #include "tblgen/TableGen.h"
 #include "tblgen/Value.h"
 
+#include <algorithm>
 #include <iostream>
 
 using std::string;
@@ -12,11 +13,100 @@ namespace tblgen {
 Class *RecordKeeper::CreateClass(const std::string &name, SourceLocation loc)
 {
    auto C = new (TG) Class(*this, name, loc);
+   C->ID = TG.registerClass(C);
    Classes.emplace(name, C);
 
    return C;
 }
 
+std::string_view Class::internName(std::string_view name) const
+{
+   return RK.getTableGen().getIdents().get(name).getIdentifier();
+}
+
+bool Class::addField(std::string_view name,
+                     Type *type,
+                     Value *defaultValue,
+                     SourceLocation declLoc,
+                     size_t associatedTemplateParm) {
+   if (getField(name))
+      return false;
+
+   fieldIndex.emplace(internName(name), (unsigned)fields.size());
+   fields.emplace_back(name, type, defaultValue, declLoc,
+                       associatedTemplateParm);
+
+   return true;
+}
+
+bool Class::addOverride(std::string_view name,
+                        Type *type,
+                        Value *defaultValue,
+                        SourceLocation declLoc,
+                        bool append) {
+   if (getOverride(name))
+      return false;
+
+   overrideIndex.emplace(internName(name), (unsigned)overrides.size());
+   overrides.emplace_back(name, type, defaultValue, declLoc, -1, append);
+
+   return true;
+}
+
+bool Class::addTemplateParam(std::string_view name,
+                             Type *type,
+                             Value *defaultValue,
+                             SourceLocation declLoc) {
+   if (getTemplateParameter(name))
+      return false;
+
+   parameterIndex.emplace(internName(name), (unsigned)parameters.size());
+   parameters.emplace_back(name, type, defaultValue, declLoc);
+
+   return true;
+}
+
+void Class::addBase(Class *Base, std::vector<Value*> &&templateParams)
+{
+   bases.emplace_back(Base, move(templateParams));
+   inheritedFieldsValid = false;
+
+   ancestors.set(Base->getID());
+   ancestors |= Base->getAncestors();
+}
+
+void Class::buildInheritedFields() const
+{
+   if (inheritedFieldsValid)
+      return;
+
+   inheritedFields.clear();
+   inheritedOverrides.clear();
+
+   // Earlier bases take precedence over later ones, and a base's own fields
+   // take precedence over the ones it inherits. emplace() keeps the first
+   // entry, so this matches a depth first search through the bases.
+   for (auto &B : bases) {
+      auto *Base = B.getBase();
+      Base->buildInheritedFields();
+
+      for (auto &Entry : Base->fieldIndex)
+         inheritedFields.emplace(Entry.first, &Base->fields[Entry.second]);
+
+      for (auto &Entry : Base->inheritedFields)
+         inheritedFields.emplace(Entry);
+
+      for (auto &Entry : Base->overrideIndex)
+         inheritedOverrides.emplace(Entry.first,
+                                    &Base->overrides[Entry.second]);
+
+      for (auto &Entry : Base->inheritedOverrides)
+         inheritedOverrides.emplace(Entry);
+   }
+
+   inheritedFieldsValid = true;
+}
+
 void Class::dump()
 {
    printTo(std::cerr);
@@ -88,7 +178,7 @@ void Record::dumpAllValues()
    auto &out = std::cerr;
    out << "def " << name << " {\n";
 
-   for (auto &F : fieldValues) {
+   for (auto &F : getFieldValues()) {
       out << "   " << F.first << " = " << F.second << "\n";
    }
 
@@ -155,7 +245,7 @@ void Enum::addCase(std::string_view caseName,
    uint64_t val;
    if (caseVal.hasValue())
    {
-      val = caseVal;
+      val = caseVal.getValue();
       assert(casesByValue.count(val) == 0 && "duplicate case value");
    }
    else if (!casesByValue.empty())
@@ -226,6 +316,115 @@ Record* RecordKeeper::CreateRecord(const std::string &name, SourceLocation loc)
    return R;
 }
 
+void Record::addBase(Class *Base, std::vector<Value*> &&templateParams)
+{
+   assert(!layout && "bases must be added before any field value");
+   bases.emplace_back(Base, move(templateParams));
+   ancestors = RK.getTableGen().getAncestors(ancestors, Base);
+
+   // Anonymous records are not part of any namespace.
+   if (!IsAnonymous)
+      RK.addDerivedRecord(this, Base);
+}
+
+void Record::initLayout()
+{
+   auto &TG = RK.getTableGen();
+
+   std::vector<Class*> baseClasses;
+   baseClasses.reserve(bases.size());
+
+   for (auto &B : bases)
+      baseClasses.push_back(B.getBase());
+
+   layout = TG.getRecordLayout(baseClasses);
+
+   // Records that are finalized lazily get their slots after freeze(),
+   // possibly while a scratch space is attached.
+   unsigned numSlots = layout->getNumSlots();
+   slotValues = static_cast<Value**>(
+      TG.AllocatePersistent(numSlots * sizeof(Value*), alignof(Value*)));
+   std::fill(slotValues, slotValues + numSlots, nullptr);
+}
+
+void Record::addOwnField(SourceLocation loc, std::string_view key,
+                         Type *Ty, Value *V) {
+   ownFields.emplace_back(key, Ty, V, loc);
+
+   // An own field never replaces a value that was already set.
+   if (!lookupFieldValue(key))
+      setFieldValue(key, V);
+}
+
+Value *Record::lookupFieldValue(std::string_view fieldName) const
+{
+   if (!layout)
+      return nullptr;
+
+   if (auto slot = layout->getSlot(fieldName))
+      return slotValues[slot.getValue()];
+
+   for (auto &Entry : extraFieldValues)
+      if (Entry.first == fieldName)
+         return Entry.second;
+
+   return nullptr;
+}
+
+RecordField *Record::findOwnField(std::string_view name)
+{
+   for (auto &f : ownFields)
+      if (f.getName() == name)
+         return &f;
+
+   return nullptr;
+}
+
+void Record::finalizeDeferred() const
+{
+   RK.getTableGen().finalizeDeferredRecord(const_cast<Record&>(*this));
+}
+
+void Record::setFieldValue(std::string_view key, Value *V)
+{
+   if (!layout)
+      initLayout();
+
+   if (auto slot = layout->getSlot(key)) {
+      slotValues[slot.getValue()] = V;
+      return;
+   }
+
+   for (auto &Entry : extraFieldValues) {
+      if (Entry.first == key) {
+         Entry.second = V;
+         return;
+      }
+   }
+
+   auto &Idents = RK.getTableGen().getIdents();
+   extraFieldValues.emplace_back(Idents.get(key).getIdentifier(), V);
+}
+
+void Record::field_value_iterator::skipEmpty()
+{
+   unsigned numSlots = R->layout ? R->layout->getNumSlots() : 0;
+   unsigned numEntries = R->getNumFieldEntries();
+
+   for (; idx < numEntries; ++idx) {
+      if (idx < numSlots) {
+         if (auto *V = R->slotValues[idx]) {
+            cur = { R->layout->getFieldName(idx), V };
+            return;
+         }
+      }
+      else {
+         cur = R->extraFieldValues[idx - numSlots];
+         return;
+      }
+   }
+}
+
 Record* RecordKeeper::CreateAnonymousRecord(tblgen::SourceLocation loc)
 {
    return new(TG) Record(*this, loc);
@@ -280,6 +479,23 @@ RecordKeeper *RecordKeeper::addNamespace(const std::string &name,
    return RK;
 }
 
+void RecordKeeper::addDerivedRecord(Record *R, Class *Base)
+{
+   // The bases of a record are added right after it is declared, so a
+   // record that was already registered for a class is always the last
+   // entry.
+   auto Add = [&](Class *C) {
+      auto &Vec = DerivedRecords[C];
+      if (Vec.empty() || Vec.back() != R)
+         Vec.push_back(R);
+   };
+
+   Add(Base);
+   Base->getAncestors().forEachSetBit([&](unsigned ID) {
+      Add(TG.getClassByID(ID));
+   });
+}
+
 support::ArenaAllocator& RecordKeeper::getAllocator() const
 {
    return TG.getAllocator();
@@ -0,0 +1,271 @@
+
+#include "tblgen/RecordIndex.h"
+#include "tblgen/Record.h"
+#include "tblgen/Support/Casting.h"
+#include "tblgen/Support/ParallelSort.h"
+#include "tblgen/Support/Timer.h"
+#include "tblgen/TableGen.h"
+#include "tblgen/Type.h"
+#include "tblgen/Value.h"
+
+#include <algorithm>
+#include <numeric>
+
+using namespace tblgen::support;
+
+namespace tblgen {
+
+RecordIndex::RecordIndex(std::string_view FieldName, Type *FieldTy)
+   : FieldName(FieldName), FieldTy(FieldTy)
+{
+   if (auto *IntTy = dyn_cast<IntType>(FieldTy))
+      IsSigned = !IntTy->isUnsigned();
+}
+
+bool RecordIndex::supportsType(Type *Ty)
+{
+   switch (Ty->getTypeID()) {
+   case Type::IntTypeID:
+   case Type::StringTypeID:
+   case Type::EnumTypeID:
+   case Type::ClassTypeID:
+   case Type::RecordTypeID:
+      return true;
+   default:
+      return false;
+   }
+}
+
+bool RecordIndex::supportsPredicate(Predicate Pred) const
+{
+   if (Pred == Eq || Pred == Ne)
+      return true;
+
+   return isa<IntType>(FieldTy);
+}
+
+bool RecordIndex::supportsValue(const Value *Val) const
+{
+   switch (FieldTy->getTypeID()) {
+   case Type::IntTypeID:
+      return isa<IntegerLiteral>(Val);
+   case Type::StringTypeID:
+      return isa<StringLiteral>(Val);
+   case Type::EnumTypeID:
+      return isa<EnumVal>(Val)
+         && cast<EnumType>(Val->getType())->getEnum()
+            == cast<EnumType>(FieldTy)->getEnum();
+   case Type::ClassTypeID:
+   case Type::RecordTypeID:
+      return isa<RecordVal>(Val);
+   default:
+      return false;
+   }
+}
+
+uint64_t RecordIndex::getKey(const Value *Val) const
+{
+   switch (Val->getTypeID()) {
+   case Value::IntegerLiteralID: {
+      // Flip the sign bit, so that signed values are ordered correctly when
+      // compared as unsigned keys.
+      uint64_t Key = cast<IntegerLiteral>(Val)->getVal();
+      return IsSigned ? Key ^ (uint64_t(1) << 63) : Key;
+   }
+   case Value::EnumValID:
+      return reinterpret_cast<uintptr_t>(cast<EnumVal>(Val)->getCase());
+   case Value::RecordValID:
+      return reinterpret_cast<uintptr_t>(cast<RecordVal>(Val)->getRecord());
+   default:
+      unreachable("value cannot be indexed");
+   }
+}
+
+void RecordIndex::update(const std::vector<Record*> &Records)
+{
+   if (Records.size() == NumRecords)
+      return;
+
+   support::TimeRegion Timer("Build record index", FieldName);
+
+   size_t PrevSorted = SortedKeys.size();
+   Values.resize(Records.size());
+   Keys.resize(Records.size());
+
+   for (size_t i = NumRecords; i < Records.size(); ++i) {
+      auto *Val = Records[i]->getFieldValue(FieldName);
+      if (!Val || !supportsValue(Val))
+         continue;
+
+      Values[i] = Val;
+      Keys[i] = getSortKey(Val);
+
+      if (auto *Str = dyn_cast<StringLiteral>(Val)) {
+         StringBuckets[Str->getVal()].push_back((unsigned)i);
+         continue;
+      }
+
+      uint64_t Key = getKey(Val);
+      KeyBuckets[Key].push_back((unsigned)i);
+
+      if (isa<IntegerLiteral>(Val))
+         SortedKeys.emplace_back(Key, (unsigned)i);
+   }
+
+   // Only the new keys need to be sorted, the old ones already are.
+   std::sort(SortedKeys.begin() + PrevSorted, SortedKeys.end());
+   std::inplace_merge(SortedKeys.begin(), SortedKeys.begin() + PrevSorted,
+                      SortedKeys.end());
+
+   size_t PrevNumRecords = NumRecords;
+   NumRecords = Records.size();
+
+   if (!HasOrder)
+      return;
+
+   // Merge the new records into the order.
+   auto Cmp = [this](unsigned A, unsigned B) { return comesBefore(A, B); };
+
+   Order.resize(NumRecords);
+   std::iota(Order.begin() + PrevNumRecords, Order.end(),
+             (unsigned)PrevNumRecords);
+
+   std::sort(Order.begin() + PrevNumRecords, Order.end(), Cmp);
+   std::inplace_merge(Order.begin(), Order.begin() + PrevNumRecords,
+                      Order.end(), Cmp);
+
+   Ranks.resize(NumRecords);
+   for (unsigned i = 0; i < NumRecords; ++i)
+      Ranks[Order[i]] = i;
+}
+
+RecordIndex::SortKey RecordIndex::getSortKey(const Value *Val) const
+{
+   SortKey Key;
+   Key.Missing = false;
+
+   switch (Val->getTypeID()) {
+   case Value::IntegerLiteralID:
+      Key.Num = getKey(Val);
+      break;
+   case Value::EnumValID:
+      Key.Num = cast<EnumVal>(Val)->getCase()->caseValue;
+      break;
+   case Value::StringLiteralID:
+      Key.Str = cast<StringLiteral>(Val)->getVal();
+      break;
+   case Value::RecordValID:
+      Key.Str = cast<RecordVal>(Val)->getRecord()->getName();
+      break;
+   default:
+      unreachable("value cannot be indexed");
+   }
+
+   return Key;
+}
+
+void RecordIndex::buildOrder()
+{
+   if (HasOrder)
+      return;
+
+   support::TimeRegion Timer("Sort records", FieldName);
+
+   Order.resize(NumRecords);
+   std::iota(Order.begin(), Order.end(), 0u);
+
+   support::parallelSort(Order.begin(), Order.end(),
+                         [this](unsigned A, unsigned B) {
+                            return comesBefore(A, B);
+                         });
+
+   Ranks.resize(NumRecords);
+   for (unsigned i = 0; i < NumRecords; ++i)
+      Ranks[Order[i]] = i;
+
+   HasOrder = true;
+}
+
+void RecordIndex::sortPositions(std::vector<unsigned> &Positions) const
+{
+   assert(HasOrder && "order was not built");
+   std::sort(Positions.begin(), Positions.end(), [this](unsigned A, unsigned B) {
+      return Ranks[A] < Ranks[B];
+   });
+}
+
+const std::vector<unsigned> *RecordIndex::findBucket(const Value *Val) const
+{
+   if (auto *Str = dyn_cast<StringLiteral>(Val)) {
+      auto It = StringBuckets.find(Str->getVal());
+      return It == StringBuckets.end() ? nullptr : &It->second;
+   }
+
+   auto It = KeyBuckets.find(getKey(Val));
+   return It == KeyBuckets.end() ? nullptr : &It->second;
+}
+
+void RecordIndex::query(Predicate Pred, const Value *Val,
+                        std::vector<unsigned> &Result) const
+{
+   assert(supportsPredicate(Pred) && supportsValue(Val)
+          && "unsupported query");
+
+   switch (Pred) {
+   case Eq: {
+      if (auto *Bucket = findBucket(Val))
+         Result.insert(Result.end(), Bucket->begin(), Bucket->end());
+
+      break;
+   }
+   case Ne: {
+      static const std::vector<unsigned> Empty;
+
+      auto *Bucket = findBucket(Val);
+      if (!Bucket)
+         Bucket = &Empty;
+
+      auto It = Bucket->begin();
+      for (unsigned i = 0; i < NumRecords; ++i) {
+         if (It != Bucket->end() && *It == i) {
+            ++It;
+            continue;
+         }
+
+         Result.push_back(i);
+      }
+
+      break;
+   }
+   case Lt: case Le: case Gt: case Ge: {
+      uint64_t Key = getKey(Val);
+
+      auto Lower = std::partition_point(
+         SortedKeys.begin(), SortedKeys.end(),
+         [&](const std::pair<uint64_t, unsigned> &E) { return E.first < Key; });
+      auto Upper = std::partition_point(
+         Lower, SortedKeys.end(),
+         [&](const std::pair<uint64_t, unsigned> &E) { return E.first == Key; });
+
+      auto Begin = SortedKeys.begin();
+      auto End = SortedKeys.end();
+
+      switch (Pred) {
+      case Lt: End = Lower; break;
+      case Le: End = Upper; break;
+      case Gt: Begin = Upper; break;
+      default: Begin = Lower; break;
+      }
+
+      // Restore declaration order.
+      size_t PrevSize = Result.size();
+      for (auto It = Begin; It != End; ++It)
+         Result.push_back(It->second);
+
+      std::sort(Result.begin() + PrevSize, Result.end());
+      break;
+   }
+   }
+}
+
+} // namespace tblgen
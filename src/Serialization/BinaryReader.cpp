@@ -0,0 +1,825 @@
+#include "tblgen/Serialization/BinaryReader.h"
+
+#include "tblgen/Record.h"
+#include "tblgen/Serialization/BinaryFormat.h"
+#include "tblgen/Support/Casting.h"
+#include "tblgen/TableGen.h"
+#include "tblgen/Type.h"
+#include "tblgen/Value.h"
+
+#include <cstring>
+
+using std::string;
+using namespace tblgen::support;
+
+namespace tblgen {
+namespace serial {
+namespace {
+
+template<class T>
+struct Table {
+   const T *Data = nullptr;
+   size_t Count = 0;
+
+   const T &operator[](size_t i) const { return Data[i]; }
+};
+
+class BinaryReader {
+public:
+   BinaryReader(TableGen &TG, std::string_view Buf)
+      : TG(TG), Buf(Buf)
+   {}
+
+   bool read();
+
+   const string &getErrorMessage() const
+   {
+      return ErrorMsg;
+   }
+
+private:
+   TableGen &TG;
+   std::string_view Buf;
+   string ErrorMsg;
+
+   FileHeader Header;
+
+   Table<char> Strings;
+   Table<uint32_t> Indices;
+   Table<TypeEntry> TypeEntries;
+   Table<ValueEntry> ValueEntries;
+   Table<NamedValueEntry> NamedValues;
+   Table<FieldEntry> Fields;
+   Table<BaseEntry> Bases;
+   Table<ClassEntry> ClassEntries;
+   Table<EnumCaseEntry> EnumCases;
+   Table<EnumEntry> EnumEntries;
+   Table<RecordEntry> RecordEntries;
+   Table<NamespaceEntry> NamespaceEntries;
+
+   std::vector<RecordKeeper*> Namespaces;
+   std::vector<Class*> Classes;
+   std::vector<Enum*> Enums;
+   std::vector<Record*> Records;
+   std::vector<Type*> Types;
+   std::vector<Value*> Values;
+
+   enum ClassStateKind : uint8_t {
+      CS_Unvisited, CS_Visiting, CS_Done,
+   };
+
+   std::vector<ClassStateKind> ClassState;
+
+   bool error(const string &Msg)
+   {
+      ErrorMsg = "malformed binary record file: " + Msg;
+      return false;
+   }
+
+   template<class T>
+   bool readTable(TableKind Kind, Table<T> &Result);
+
+   bool readHeader();
+
+   bool checkIndex(uint32_t Idx, size_t Count, const char *What);
+   bool checkRange(Range R, size_t Count, const char *What);
+   bool getString(StringRef Ref, std::string_view &Result);
+
+   bool getType(uint32_t Idx, Type *&Result);
+   bool getValue(uint32_t Idx, Value *&Result);
+   bool getValueList(Range R, std::vector<Value*> &Result);
+
+   bool readNamespaces();
+   bool readDecls();
+   bool readTypes();
+   bool readValues();
+   bool readValue(const ValueEntry &Entry, Value *&Result);
+   bool checkValueType(const ValueEntry &Entry, Type *Ty);
+   bool readBases(Range R, std::vector<Class::BaseClass> &Result);
+   bool readClasses();
+   bool readClass(size_t i);
+   bool readRecords();
+   bool readValueDecls();
+};
+
+} // anonymous namespace
+
+template<class T>
+bool BinaryReader::readTable(TableKind Kind, Table<T> &Result)
+{
+   uint64_t Offset = Header.Tables[Kind].Offset;
+   uint64_t Count = Header.Tables[Kind].Count;
+
+   if (Offset > Buf.size() || Count > (Buf.size() - Offset) / sizeof(T))
+      return error("table exceeds file size");
+
+   auto *Ptr = Buf.data() + Offset;
+   if (reinterpret_cast<uintptr_t>(Ptr) % alignof(T) != 0)
+      return error("misaligned table");
+
+   Result.Data = reinterpret_cast<const T*>(Ptr);
+   Result.Count = Count;
+
+   return true;
+}
+
+bool BinaryReader::readHeader()
+{
+   if (Buf.size() < sizeof(FileHeader) || !isBinaryRecordFile(Buf))
+      return error("invalid header");
+
+   memcpy(&Header, Buf.data(), sizeof(FileHeader));
+   if (Header.Version != FormatVersion) {
+      return error("unsupported version " + std::to_string(Header.Version));
+   }
+
+   if (Header.NumTables != TK_NumTables)
+      return error("unexpected number of tables");
+
+   return readTable(TK_Strings, Strings)
+      && readTable(TK_Indices, Indices)
+      && readTable(TK_Types, TypeEntries)
+      && readTable(TK_Values, ValueEntries)
+      && readTable(TK_NamedValues, NamedValues)
+      && readTable(TK_Fields, Fields)
+      && readTable(TK_Bases, Bases)
+      && readTable(TK_Classes, ClassEntries)
+      && readTable(TK_EnumCases, EnumCases)
+      && readTable(TK_Enums, EnumEntries)
+      && readTable(TK_Records, RecordEntries)
+      && readTable(TK_Namespaces, NamespaceEntries);
+}
+
+bool BinaryReader::checkIndex(uint32_t Idx, size_t Count, const char *What)
+{
+   if (Idx >= Count)
+      return error(string("invalid ") + What + " index");
+
+   return true;
+}
+
+bool BinaryReader::checkRange(Range R, size_t Count, const char *What)
+{
+   if ((uint64_t)R.Begin + R.Count > Count)
+      return error(string("invalid ") + What + " range");
+
+   return true;
+}
+
+bool BinaryReader::getString(StringRef Ref, std::string_view &Result)
+{
+   if ((uint64_t)Ref.Offset + Ref.Length > Strings.Count)
+      return error("invalid string reference");
+
+   Result = std::string_view(Strings.Data + Ref.Offset, Ref.Length);
+   return true;
+}
+
+bool BinaryReader::getType(uint32_t Idx, Type *&Result)
+{
+   if (Idx == InvalidIndex) {
+      Result = nullptr;
+      return true;
+   }
+
+   if (!checkIndex(Idx, Types.size(), "type"))
+      return false;
+
+   Result = Types[Idx];
+   return true;
+}
+
+bool BinaryReader::getValue(uint32_t Idx, Value *&Result)
+{
+   if (Idx == InvalidIndex) {
+      Result = nullptr;
+      return true;
+   }
+
+   // Values are only ever allowed to refer to values that precede them,
+   // which also rules out cycles.
+   if (!checkIndex(Idx, Values.size(), "value"))
+      return false;
+
+   Result = Values[Idx];
+   return true;
+}
+
+bool BinaryReader::getValueList(Range R, std::vector<Value*> &Result)
+{
+   if (!checkRange(R, Indices.Count, "index"))
+      return false;
+
+   Result.resize(R.Count);
+   for (uint32_t i = 0; i < R.Count; ++i) {
+      if (!getValue(Indices[R.Begin + i], Result[i]))
+         return false;
+   }
+
+   return true;
+}
+
+bool BinaryReader::readNamespaces()
+{
+   if (NamespaceEntries.Count == 0)
+      return error("missing global namespace");
+
+   Namespaces.push_back(TG.GlobalRK.get());
+
+   for (size_t i = 1; i < NamespaceEntries.Count; ++i) {
+      auto &Entry = NamespaceEntries[i];
+
+      std::string_view Name;
+      if (!getString(Entry.Name, Name))
+         return false;
+
+      // Parents always precede their nested namespaces.
+      if (!checkIndex(Entry.Parent, i, "namespace"))
+         return false;
+
+      Namespaces.push_back(Namespaces[Entry.Parent]->addNamespace(
+         string(Name), SourceLocation()));
+   }
+
+   return true;
+}
+
+bool BinaryReader::readDecls()
+{
+   for (size_t i = 0; i < ClassEntries.Count; ++i) {
+      auto &Entry = ClassEntries[i];
+
+      std::string_view Name;
+      if (!getString(Entry.Name, Name)
+            || !checkIndex(Entry.Namespace, Namespaces.size(), "namespace"))
+         return false;
+
+      auto *NS = Namespaces[Entry.Namespace];
+      if (NS->getAllClasses().count(string(Name)) != 0)
+         return error("duplicate class name");
+
+      Classes.push_back(NS->CreateClass(string(Name), SourceLocation()));
+   }
+
+   for (size_t i = 0; i < EnumEntries.Count; ++i) {
+      auto &Entry = EnumEntries[i];
+
+      std::string_view Name;
+      if (!getString(Entry.Name, Name)
+            || !checkIndex(Entry.Namespace, Namespaces.size(), "namespace")
+            || !checkRange(Entry.Cases, EnumCases.Count, "enum case"))
+         return false;
+
+      auto *NS = Namespaces[Entry.Namespace];
+      if (NS->getAllEnums().count(string(Name)) != 0)
+         return error("duplicate enum name");
+
+      auto *E = NS->CreateEnum(string(Name), SourceLocation());
+
+      for (uint32_t j = 0; j < Entry.Cases.Count; ++j) {
+         auto &Case = EnumCases[Entry.Cases.Begin + j];
+
+         std::string_view CaseName;
+         if (!getString(Case.Name, CaseName))
+            return false;
+
+         if (E->hasCase(string(CaseName)) || E->hasCase(Case.Value))
+            return error("duplicate enum case");
+
+         E->addCase(CaseName, Case.Value);
+      }
+
+      Enums.push_back(E);
+   }
+
+   // Named records are created in declaration order per namespace, the
+   // remaining ones are anonymous.
+   Records.resize(RecordEntries.Count);
+   for (size_t i = 0; i < NamespaceEntries.Count; ++i) {
+      auto &Entry = NamespaceEntries[i];
+      if (!checkRange(Entry.Records, Indices.Count, "index"))
+         return false;
+
+      for (uint32_t j = 0; j < Entry.Records.Count; ++j) {
+         uint32_t Idx = Indices[Entry.Records.Begin + j];
+         if (!checkIndex(Idx, Records.size(), "record"))
+            return false;
+
+         auto &RecEntry = RecordEntries[Idx];
+         if (Records[Idx] || RecEntry.IsAnonymous || RecEntry.Namespace != i)
+            return error("invalid record declaration");
+
+         std::string_view Name;
+         if (!getString(RecEntry.Name, Name))
+            return false;
+
+         // Records of parent namespaces may have the same name.
+         auto *Prev = Namespaces[i]->lookupRecord(string(Name));
+         if (Prev && &Prev->getRecordKeeper() == Namespaces[i])
+            return error("duplicate record name");
+
+         Records[Idx] = Namespaces[i]->CreateRecord(string(Name),
+                                                    SourceLocation());
+      }
+   }
+
+   for (size_t i = 0; i < RecordEntries.Count; ++i) {
+      if (Records[i])
+         continue;
+
+      auto &Entry = RecordEntries[i];
+      if (!Entry.IsAnonymous)
+         return error("record without namespace");
+
+      if (!checkIndex(Entry.Namespace, Namespaces.size(), "namespace"))
+         return false;
+
+      Records[i] = Namespaces[Entry.Namespace]->CreateAnonymousRecord(
+         SourceLocation());
+   }
+
+   return true;
+}
+
+bool BinaryReader::readTypes()
+{
+   for (size_t i = 0; i < TypeEntries.Count; ++i) {
+      auto &Entry = TypeEntries[i];
+
+      Type *Ty;
+      switch (Entry.Kind) {
+      case Type::IntTypeID:
+         switch (Entry.Operand) {
+         case 1: case 8: case 16: case 32: case 64:
+            break;
+         default:
+            return error("invalid integer bit width");
+         }
+
+         Ty = TG.getIntegerTy(Entry.Operand, Entry.IsUnsigned != 0);
+         break;
+      case Type::FloatTypeID:
+         Ty = TG.getFloatTy();
+         break;
+      case Type::DoubleTypeID:
+         Ty = TG.getDoubleTy();
+         break;
+      case Type::StringTypeID:
+         Ty = TG.getStringTy();
+         break;
+      case Type::CodeTypeID:
+         Ty = TG.getCodeTy();
+         break;
+      case Type::UndefTypeID:
+         Ty = TG.getUndefTy();
+         break;
+      case Type::ListTypeID:
+      case Type::DictTypeID: {
+         // Element types always precede the types that refer to them.
+         if (!checkIndex(Entry.Operand, Types.size(), "type"))
+            return false;
+
+         if (Entry.Kind == Type::ListTypeID)
+            Ty = TG.getListType(Types[Entry.Operand]);
+         else
+            Ty = TG.getDictType(Types[Entry.Operand]);
+
+         break;
+      }
+      case Type::ClassTypeID:
+         if (!checkIndex(Entry.Operand, Classes.size(), "class"))
+            return false;
+
+         Ty = TG.getClassType(Classes[Entry.Operand]);
+         break;
+      case Type::RecordTypeID:
+         if (!checkIndex(Entry.Operand, Records.size(), "record"))
+            return false;
+
+         Ty = TG.getRecordType(Records[Entry.Operand]);
+         break;
+      case Type::EnumTypeID:
+         if (!checkIndex(Entry.Operand, Enums.size(), "enum"))
+            return false;
+
+         Ty = TG.getEnumType(Enums[Entry.Operand]);
+         break;
+      default:
+         return error("invalid type kind");
+      }
+
+      Types.push_back(Ty);
+   }
+
+   return true;
+}
+
+bool BinaryReader::checkValueType(const ValueEntry &Entry, Type *Ty)
+{
+   bool Valid;
+   switch (Entry.Kind) {
+   case Value::IntegerLiteralID:
+      Valid = Ty && isa<IntType>(Ty);
+      break;
+   case Value::FPLiteralID:
+      Valid = Ty && (isa<FloatType>(Ty) || isa<DoubleType>(Ty));
+      break;
+   case Value::StringLiteralID:
+      Valid = Ty && isa<StringType>(Ty);
+      break;
+   case Value::CodeBlockID:
+      Valid = Ty && isa<CodeType>(Ty);
+      break;
+   case Value::ListLiteralID:
+      Valid = Ty && isa<ListType>(Ty);
+      break;
+   case Value::DictLiteralID:
+      Valid = Ty && isa<DictType>(Ty);
+      break;
+   case Value::RecordValID: {
+      auto *RecordTy = dyn_cast_or_null<RecordType>(Ty);
+      Valid = RecordTy && RecordTy->getRecord() == Records[Entry.Payload];
+      break;
+   }
+   case Value::EnumValID: {
+      auto *EnumTy = dyn_cast_or_null<EnumType>(Ty);
+      Valid = EnumTy && EnumTy->getEnum() == Enums[Entry.Elements.Begin];
+      break;
+   }
+   case Value::IdentifierValID:
+      Valid = Ty != nullptr;
+      break;
+   default:
+      // Undef and dictionary accesses don't store a type, invalid kinds are
+      // reported by readValue().
+      Valid = true;
+      break;
+   }
+
+   if (!Valid)
+      return error("invalid value type");
+
+   return true;
+}
+
+bool BinaryReader::readValue(const ValueEntry &Entry, Value *&Result)
+{
+   Type *Ty;
+   if (!getType(Entry.Type, Ty))
+      return false;
+
+   // Indices in the payload are 32 bits wide like all other indices.
+   uint32_t PayloadIdx = Entry.Payload < InvalidIndex ? (uint32_t)Entry.Payload
+                                                      : InvalidIndex;
+
+   // Records and enums are looked up by checkValueType(), so their indices
+   // are checked first.
+   if (Entry.Kind == Value::RecordValID
+         && !checkIndex(PayloadIdx, Records.size(), "record"))
+      return false;
+
+   if (Entry.Kind == Value::EnumValID
+         && !checkIndex(Entry.Elements.Begin, Enums.size(), "enum"))
+      return false;
+
+   if (!checkValueType(Entry, Ty))
+      return false;
+
+   switch (Entry.Kind) {
+   case Value::IntegerLiteralID:
+      Result = TG.getIntegerLiteral(Ty, (uint64_t)Entry.Payload);
+      break;
+   case Value::FPLiteralID: {
+      double D;
+      memcpy(&D, &Entry.Payload, sizeof(D));
+
+      Result = TG.getFPLiteral(Ty, D);
+      break;
+   }
+   case Value::StringLiteralID:
+   case Value::CodeBlockID:
+   case Value::IdentifierValID: {
+      std::string_view Str;
+      if (!getString(Entry.Str, Str))
+         return false;
+
+      if (Entry.Kind == Value::StringLiteralID)
+         Result = TG.getStringLiteral(Ty, Str);
+      else if (Entry.Kind == Value::CodeBlockID)
+         Result = new (TG) CodeBlock(Ty, string(Str));
+      else
+         Result = new (TG) IdentifierVal(Ty, Str);
+
+      break;
+   }
+   case Value::ListLiteralID: {
+      std::vector<Value*> Elements;
+      if (!getValueList(Entry.Elements, Elements))
+         return false;
+
+      for (auto *El : Elements) {
+         if (!El)
+            return error("missing list element");
+      }
+
+      Result = new (TG) ListLiteral(Ty, move(Elements));
+      break;
+   }
+   case Value::DictLiteralID: {
+      if (!checkRange(Entry.Elements, NamedValues.Count, "named value"))
+         return false;
+
+      std::unordered_map<string, Value*> Elements;
+      for (uint32_t i = 0; i < Entry.Elements.Count; ++i) {
+         auto &El = NamedValues[Entry.Elements.Begin + i];
+
+         std::string_view Key;
+         Value *V;
+
+         if (!getString(El.Name, Key) || !getValue(El.Value, V))
+            return false;
+
+         if (!V)
+            return error("missing dictionary value");
+
+         Elements.emplace(string(Key), V);
+      }
+
+      Result = new (TG) DictLiteral(Ty, move(Elements));
+      break;
+   }
+   case Value::RecordValID:
+      Result = new (TG) RecordVal(Ty, Records[PayloadIdx]);
+      break;
+   case Value::EnumValID: {
+      if (!checkIndex(PayloadIdx, EnumCases.Count, "enum case"))
+         return false;
+
+      std::string_view CaseName;
+      if (!getString(EnumCases[PayloadIdx].Name, CaseName))
+         return false;
+
+      auto *E = Enums[Entry.Elements.Begin];
+      auto *C = E->getCase(string(CaseName));
+
+      if (!C)
+         return error("enum case does not belong to enum");
+
+      Result = new (TG) EnumVal(Ty, E, C);
+      break;
+   }
+   case Value::UndefValID:
+      Result = TG.getUndef();
+      break;
+   case Value::DictAccessExprID: {
+      // The key is not owned by the expression, so refer to the string table
+      // directly.
+      std::string_view Key;
+      Value *Dict;
+
+      if (!getString(Entry.Str, Key) || !getValue(PayloadIdx, Dict))
+         return false;
+
+      // Only dictionaries and parameters of dictionary type can be accessed.
+      if (!Dict || !dyn_cast_or_null<DictType>(Dict->getType()))
+         return error("invalid dictionary access");
+
+      Result = new (TG) DictAccessExpr(Dict, Key);
+      break;
+   }
+   default:
+      return error("invalid value kind");
+   }
+
+   return true;
+}
+
+bool BinaryReader::readValues()
+{
+   Values.reserve(ValueEntries.Count);
+   for (size_t i = 0; i < ValueEntries.Count; ++i) {
+      Value *V;
+      if (!readValue(ValueEntries[i], V))
+         return false;
+
+      Values.push_back(V);
+   }
+
+   return true;
+}
+
+bool BinaryReader::readBases(Range R, std::vector<Class::BaseClass> &Result)
+{
+   if (!checkRange(R, Bases.Count, "base"))
+      return false;
+
+   for (uint32_t i = 0; i < R.Count; ++i) {
+      auto &Entry = Bases[R.Begin + i];
+      if (!checkIndex(Entry.Class, Classes.size(), "class"))
+         return false;
+
+      std::vector<Value*> TemplateArgs;
+      if (!getValueList(Entry.TemplateArgs, TemplateArgs))
+         return false;
+
+      Result.emplace_back(Classes[Entry.Class], move(TemplateArgs));
+   }
+
+   return true;
+}
+
+bool BinaryReader::readClasses()
+{
+   ClassState.resize(ClassEntries.Count, CS_Unvisited);
+   for (size_t i = 0; i < ClassEntries.Count; ++i) {
+      if (!readClass(i))
+         return false;
+   }
+
+   return true;
+}
+
+bool BinaryReader::readClass(size_t i)
+{
+   if (ClassState[i] == CS_Done)
+      return true;
+
+   if (ClassState[i] == CS_Visiting)
+      return error("cyclic class hierarchy");
+
+   ClassState[i] = CS_Visiting;
+
+   auto &Entry = ClassEntries[i];
+   auto *C = Classes[i];
+
+   // Classes cache the fields they inherit, so bases have to be complete
+   // before they are used.
+   if (!checkRange(Entry.Bases, Bases.Count, "base"))
+      return false;
+
+   for (uint32_t j = 0; j < Entry.Bases.Count; ++j) {
+      uint32_t Idx = Bases[Entry.Bases.Begin + j].Class;
+      if (!checkIndex(Idx, Classes.size(), "class") || !readClass(Idx))
+         return false;
+   }
+
+   std::vector<Class::BaseClass> ClassBases;
+   if (!readBases(Entry.Bases, ClassBases))
+      return false;
+
+   for (auto &B : ClassBases) {
+      std::vector<Value*> TemplateArgs = B.getTemplateArgs();
+      C->addBase(B.getBase(), move(TemplateArgs));
+   }
+
+   if (!checkRange(Entry.Parameters, Fields.Count, "field")
+         || !checkRange(Entry.Fields, Fields.Count, "field")
+         || !checkRange(Entry.Overrides, Fields.Count, "field"))
+      return false;
+
+   auto ReadField = [&](uint32_t Idx, std::string_view &Name, Type *&Ty,
+                        Value *&DefaultVal) {
+      auto &F = Fields[Idx];
+      return getString(F.Name, Name) && getType(F.Type, Ty)
+         && getValue(F.DefaultValue, DefaultVal);
+   };
+
+   std::string_view Name;
+   Type *Ty;
+   Value *DefaultVal;
+
+   for (uint32_t j = 0; j < Entry.Parameters.Count; ++j) {
+      if (!ReadField(Entry.Parameters.Begin + j, Name, Ty, DefaultVal))
+         return false;
+
+      C->addTemplateParam(Name, Ty, DefaultVal, SourceLocation());
+   }
+
+   for (uint32_t j = 0; j < Entry.Fields.Count; ++j) {
+      uint32_t Idx = Entry.Fields.Begin + j;
+      if (!ReadField(Idx, Name, Ty, DefaultVal))
+         return false;
+
+      uint32_t Parm = Fields[Idx].AssociatedTemplateParm;
+      if (Parm != InvalidIndex
+            && !checkIndex(Parm, Entry.Parameters.Count, "parameter"))
+         return false;
+
+      C->addField(Name, Ty, DefaultVal, SourceLocation(),
+                  Parm == InvalidIndex ? size_t(-1) : size_t(Parm));
+   }
+
+   for (uint32_t j = 0; j < Entry.Overrides.Count; ++j) {
+      uint32_t Idx = Entry.Overrides.Begin + j;
+      if (!ReadField(Idx, Name, Ty, DefaultVal))
+         return false;
+
+      C->addOverride(Name, Ty, DefaultVal, SourceLocation(),
+                     Fields[Idx].IsAppend != 0);
+   }
+
+   ClassState[i] = CS_Done;
+   return true;
+}
+
+bool BinaryReader::readRecords()
+{
+   for (size_t i = 0; i < RecordEntries.Count; ++i) {
+      auto &Entry = RecordEntries[i];
+      auto *R = Records[i];
+
+      std::vector<Class::BaseClass> RecordBases;
+      if (!readBases(Entry.Bases, RecordBases))
+         return false;
+
+      for (auto &B : RecordBases) {
+         std::vector<Value*> TemplateArgs = B.getTemplateArgs();
+         R->addBase(B.getBase(), move(TemplateArgs));
+      }
+
+      if (!checkRange(Entry.OwnFields, Fields.Count, "field")
+            || !checkRange(Entry.FieldValues, NamedValues.Count,
+                           "named value"))
+         return false;
+
+      for (uint32_t j = 0; j < Entry.OwnFields.Count; ++j) {
+         auto &F = Fields[Entry.OwnFields.Begin + j];
+
+         std::string_view Name;
+         Type *Ty;
+         Value *DefaultVal;
+
+         if (!getString(F.Name, Name) || !getType(F.Type, Ty)
+               || !getValue(F.DefaultValue, DefaultVal))
+            return false;
+
+         R->addOwnField(SourceLocation(), Name, Ty, DefaultVal);
+      }
+
+      for (uint32_t j = 0; j < Entry.FieldValues.Count; ++j) {
+         auto &FV = NamedValues[Entry.FieldValues.Begin + j];
+
+         std::string_view Name;
+         Value *V;
+
+         if (!getString(FV.Name, Name) || !getValue(FV.Value, V))
+            return false;
+
+         R->setFieldValue(string(Name), V);
+      }
+   }
+
+   return true;
+}
+
+bool BinaryReader::readValueDecls()
+{
+   for (size_t i = 0; i < NamespaceEntries.Count; ++i) {
+      auto &Entry = NamespaceEntries[i];
+      if (!checkRange(Entry.Values, NamedValues.Count, "named value"))
+         return false;
+
+      for (uint32_t j = 0; j < Entry.Values.Count; ++j) {
+         auto &Decl = NamedValues[Entry.Values.Begin + j];
+
+         std::string_view Name;
+         Value *V;
+
+         if (!getString(Decl.Name, Name) || !getValue(Decl.Value, V))
+            return false;
+
+         Namespaces[i]->addValue(string(Name), V, SourceLocation());
+      }
+   }
+
+   return true;
+}
+
+bool BinaryReader::read()
+{
+   // Declarations have to exist before the types that refer to them, and
+   // types before the values. Classes and records refer to all of them.
+   return readHeader()
+      && readNamespaces()
+      && readDecls()
+      && readTypes()
+      && readValues()
+      && readClasses()
+      && readRecords()
+      && readValueDecls();
+}
+
+bool readBinaryRecords(TableGen &TG, std::string_view Buf, string *errMsg)
+{
+   BinaryReader Reader(TG, Buf);
+   if (Reader.read())
+      return true;
+
+   if (errMsg)
+      *errMsg = Reader.getErrorMessage();
+
+   return false;
+}
+
+} // namespace serial
+} // namespace tblgen
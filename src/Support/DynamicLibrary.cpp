@@ -30,6 +30,10 @@ DynamicLibrary &DynamicLibrary::operator=(DynamicLibrary &&other)
 
 DynamicLibrary::~DynamicLibrary()
 {
+   // Moved-from libraries have nothing to close.
+   if (!dylib)
+      return;
+
 #ifdef OS_IS_WINDOWS
    FreeLibrary(dylib);
 #else
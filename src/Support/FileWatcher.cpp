@@ -0,0 +1,182 @@
+#include "tblgen/Support/FileWatcher.h"
+
+#include <chrono>
+#include <filesystem>
+#include <thread>
+
+#ifdef __linux__
+#   include <cerrno>
+#   include <cstring>
+#   include <poll.h>
+#   include <sys/inotify.h>
+#   include <unistd.h>
+#endif
+
+using namespace tblgen;
+using namespace tblgen::support;
+
+namespace stdfs = std::filesystem;
+
+FileWatcher::FileWatcher()
+{
+#ifdef __linux__
+   fd = inotify_init1(IN_CLOEXEC);
+#endif
+}
+
+FileWatcher::~FileWatcher()
+{
+#ifdef __linux__
+   if (fd != -1)
+      ::close(fd);
+#endif
+}
+
+FileWatcher::Stamp FileWatcher::getStamp(const std::string &fileName)
+{
+   Stamp S;
+   std::error_code ec;
+
+   S.size = stdfs::file_size(fileName, ec);
+   if (ec)
+      return Stamp();
+
+   auto mtime = stdfs::last_write_time(fileName, ec);
+   if (ec)
+      return Stamp();
+
+   S.exists = true;
+   S.mtime = (int64_t)mtime.time_since_epoch().count();
+
+   return S;
+}
+
+bool FileWatcher::watchFile(const std::string &fileName, std::string *errMsg)
+{
+   if (fd == -1) {
+      PolledFiles.try_emplace(fileName, getStamp(fileName));
+      return true;
+   }
+
+#ifdef __linux__
+   stdfs::path path(fileName);
+   auto dir = path.parent_path().string();
+
+   auto it = DirDescriptors.find(dir);
+   if (it == DirDescriptors.end()) {
+      int wd = inotify_add_watch(fd, dir.c_str(),
+                                 IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB
+                                 | IN_CREATE | IN_DELETE | IN_MOVED_FROM
+                                 | IN_MOVED_TO);
+
+      if (wd == -1) {
+         if (errMsg)
+            *errMsg = "could not watch '" + dir + "': " + strerror(errno);
+
+         return false;
+      }
+
+      it = DirDescriptors.emplace(dir, wd).first;
+      Dirs[wd].path = dir;
+   }
+
+   Dirs[it->second].fileNames.insert(path.filename().string());
+#endif
+
+   return true;
+}
+
+void FileWatcher::readEvents(std::unordered_set<std::string> &Changed)
+{
+#ifdef __linux__
+   alignas(inotify_event) char Buf[16 * 1024];
+
+   ssize_t size = ::read(fd, Buf, sizeof(Buf));
+   if (size <= 0)
+      return;
+
+   for (char *Ptr = Buf; Ptr < Buf + size;) {
+      auto *Event = reinterpret_cast<inotify_event*>(Ptr);
+      Ptr += sizeof(inotify_event) + Event->len;
+
+      // Events were lost, assume that everything changed.
+      if (Event->mask & IN_Q_OVERFLOW) {
+         for (auto &Entry : Dirs) {
+            for (auto &fileName : Entry.second.fileNames) {
+               Changed.insert(Entry.second.path + "/" + fileName);
+            }
+         }
+
+         continue;
+      }
+
+      auto it = Dirs.find(Event->wd);
+      if (it == Dirs.end() || Event->len == 0)
+         continue;
+
+      std::string fileName(Event->name);
+      if (it->second.fileNames.count(fileName) != 0)
+         Changed.insert(it->second.path + "/" + fileName);
+   }
+#else
+   (void)Changed;
+#endif
+}
+
+std::vector<std::string> FileWatcher::waitForChanges(unsigned settleMs)
+{
+   std::unordered_set<std::string> Changed;
+
+   if (fd == -1) {
+      if (PolledFiles.empty())
+         return {};
+
+      auto pollOnce = [&]() {
+         for (auto &Entry : PolledFiles) {
+            auto S = getStamp(Entry.first);
+            if (!(S == Entry.second)) {
+               Changed.insert(Entry.first);
+               Entry.second = S;
+            }
+         }
+      };
+
+      while (Changed.empty()) {
+         std::this_thread::sleep_for(std::chrono::milliseconds(100));
+         pollOnce();
+      }
+
+      std::this_thread::sleep_for(std::chrono::milliseconds(settleMs));
+      pollOnce();
+
+      return std::vector<std::string>(Changed.begin(), Changed.end());
+   }
+
+#ifdef __linux__
+   if (Dirs.empty())
+      return {};
+
+   pollfd PFD{ fd, POLLIN, 0 };
+   int timeout = -1;
+
+   while (true) {
+      int result = ::poll(&PFD, 1, timeout);
+      if (result < 0) {
+         if (errno == EINTR)
+            continue;
+
+         return {};
+      }
+
+      // Nothing changed during the settle time.
+      if (result == 0)
+         break;
+
+      readEvents(Changed);
+      if (!Changed.empty())
+         timeout = (int)settleMs;
+   }
+#endif
+
+   return std::vector<std::string>(Changed.begin(), Changed.end());
+}
@@ -0,0 +1,180 @@
+#include "tblgen/Support/MemoryBuffer.h"
+
+#include <cassert>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#ifdef _WIN32
+#   define OS_IS_WINDOWS
+#   include <fstream>
+#elif defined(__APPLE__) || defined(__linux__) || defined(__unix__)
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#else
+#   error "unsupported operating system!"
+#endif
+
+using namespace tblgen;
+using namespace tblgen::support;
+
+MemoryBuffer::MemoryBuffer(const char *BufStart, const char *BufEnd,
+                           size_t MappedSize, BufferKind Kind)
+   : BufStart(BufStart), BufEnd(BufEnd), MappedSize(MappedSize), Kind(Kind)
+{
+   assert(*BufEnd == '\0' && "buffer is not NUL terminated!");
+}
+
+MemoryBuffer::MemoryBuffer()
+   : BufStart(nullptr), BufEnd(nullptr), MappedSize(0), Kind(MB_Invalid)
+{}
+
+MemoryBuffer::MemoryBuffer(MemoryBuffer &&other) noexcept
+   : BufStart(other.BufStart), BufEnd(other.BufEnd),
+     MappedSize(other.MappedSize), Kind(other.Kind)
+{
+   other.BufStart = nullptr;
+   other.BufEnd = nullptr;
+   other.MappedSize = 0;
+   other.Kind = MB_Invalid;
+}
+
+MemoryBuffer &MemoryBuffer::operator=(MemoryBuffer &&other) noexcept
+{
+   if (this == &other)
+      return *this;
+
+   this->~MemoryBuffer();
+   new(this) MemoryBuffer(std::move(other));
+
+   return *this;
+}
+
+MemoryBuffer::~MemoryBuffer()
+{
+   switch (Kind) {
+   case MB_Invalid:
+      break;
+   case MB_Malloc:
+      free(const_cast<char*>(BufStart));
+      break;
+   case MB_MMap:
+#ifndef OS_IS_WINDOWS
+      ::munmap(const_cast<char*>(BufStart), MappedSize);
+#endif
+      break;
+   }
+}
+
+#ifdef OS_IS_WINDOWS
+
+MemoryBuffer MemoryBuffer::getFile(const std::string &path,
+                                   bool allowMapping,
+                                   std::string *errMsg) {
+   std::ifstream ifs(path, std::ios::binary | std::ios::ate);
+   if (ifs.fail()) {
+      if (errMsg)
+         *errMsg = "could not open file";
+
+      return MemoryBuffer();
+   }
+
+   size_t FileSize = (size_t)ifs.tellg();
+   ifs.seekg(0);
+
+   char *Buf = (char*)malloc(FileSize + 1);
+   ifs.read(Buf, FileSize);
+   Buf[FileSize] = '\0';
+
+   return MemoryBuffer(Buf, Buf + FileSize, 0, MB_Malloc);
+}
+
+#else
+
+MemoryBuffer MemoryBuffer::readFile(int FD, size_t FileSize)
+{
+   char *Buf = (char*)malloc(FileSize + 1);
+
+   // Read in large chunks; a short read only means we have to try again.
+   size_t BytesRead = 0;
+   while (BytesRead < FileSize) {
+      ssize_t Result = ::read(FD, Buf + BytesRead, FileSize - BytesRead);
+      if (Result < 0) {
+         if (errno == EINTR)
+            continue;
+
+         free(Buf);
+         return MemoryBuffer();
+      }
+
+      // The file was truncated while we were reading it.
+      if (Result == 0)
+         break;
+
+      BytesRead += (size_t)Result;
+   }
+
+   Buf[BytesRead] = '\0';
+   return MemoryBuffer(Buf, Buf + BytesRead, 0, MB_Malloc);
+}
+
+MemoryBuffer MemoryBuffer::getFile(const std::string &path,
+                                   bool allowMapping,
+                                   std::string *errMsg) {
+   int FD = ::open(path.c_str(), O_RDONLY);
+   if (FD < 0) {
+      if (errMsg)
+         *errMsg = strerror(errno);
+
+      return MemoryBuffer();
+   }
+
+   struct stat Stat;
+   if (::fstat(FD, &Stat) != 0) {
+      if (errMsg)
+         *errMsg = strerror(errno);
+
+      ::close(FD);
+      return MemoryBuffer();
+   }
+
+   if (!S_ISREG(Stat.st_mode)) {
+      if (errMsg)
+         *errMsg = "not a regular file";
+
+      ::close(FD);
+      return MemoryBuffer();
+   }
+
+   size_t FileSize = (size_t)Stat.st_size;
+   static const size_t PageSize = (size_t)::sysconf(_SC_PAGESIZE);
+
+   // We can only map the file if the sentinel falls into the zero-filled
+   // remainder of the last page; if the file size is a multiple of the page
+   // size, the byte after the end is not mapped.
+   bool shouldMap = allowMapping
+      && FileSize >= MinMappedFileSize
+      && (FileSize & (PageSize - 1)) != 0;
+
+   if (shouldMap) {
+      void *Pages = ::mmap(nullptr, FileSize, PROT_READ, MAP_PRIVATE, FD, 0);
+      if (Pages != MAP_FAILED) {
+         ::close(FD);
+
+         auto *Start = static_cast<const char*>(Pages);
+         return MemoryBuffer(Start, Start + FileSize, FileSize, MB_MMap);
+      }
+   }
+
+   MemoryBuffer Buf = readFile(FD, FileSize);
+   if (!Buf.isValid() && errMsg)
+      *errMsg = strerror(errno);
+
+   ::close(FD);
+   return Buf;
+}
+
+#endif
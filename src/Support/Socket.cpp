@@ -0,0 +1,323 @@
+#include "tblgen/Support/Socket.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+#ifdef _WIN32
+#   define OS_IS_WINDOWS
+#elif defined(__APPLE__) || defined(__linux__) || defined(__unix__)
+#   include <sys/socket.h>
+#   include <sys/stat.h>
+#   include <sys/un.h>
+#   include <unistd.h>
+#else
+#   error "unsupported operating system!"
+#endif
+
+using namespace tblgen;
+using namespace tblgen::support;
+
+namespace {
+
+void setError(std::string *errMsg, const std::string &msg)
+{
+   if (errMsg) {
+      *errMsg = msg;
+   }
+}
+
+#ifndef OS_IS_WINDOWS
+
+#  ifdef MSG_NOSIGNAL
+constexpr int SendFlags = MSG_NOSIGNAL;
+#  else
+constexpr int SendFlags = 0;
+#  endif
+
+/// Don't raise SIGPIPE when writing to a socket whose peer went away, the
+/// write fails with EPIPE instead.
+void disableSigPipe(int fd)
+{
+#  ifdef SO_NOSIGPIPE
+   int on = 1;
+   setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#  else
+   (void)fd;
+#  endif
+}
+
+/// \return true if the process on the other end of \p fd runs as the same
+/// user as this one.
+bool isSameUser(int fd)
+{
+#  ifdef SO_PEERCRED
+   struct ucred cred;
+   socklen_t len = sizeof(cred);
+   if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0)
+      return false;
+
+   return cred.uid == ::geteuid();
+#  else
+   uid_t uid;
+   gid_t gid;
+   if (getpeereid(fd, &uid, &gid) != 0)
+      return false;
+
+   return uid == ::geteuid();
+#  endif
+}
+
+bool makeAddress(const std::string &path, sockaddr_un &addr,
+                 std::string *errMsg)
+{
+   std::memset(&addr, 0, sizeof(addr));
+   addr.sun_family = AF_UNIX;
+
+   if (path.size() >= sizeof(addr.sun_path)) {
+      setError(errMsg, "socket path too long: " + path);
+      return false;
+   }
+
+   std::memcpy(addr.sun_path, path.data(), path.size());
+   return true;
+}
+
+bool writeAll(int fd, const char *data, size_t size)
+{
+   while (size != 0) {
+      ssize_t written = ::send(fd, data, size, SendFlags);
+      if (written < 0) {
+         if (errno == EINTR)
+            continue;
+
+         return false;
+      }
+
+      data += written;
+      size -= (size_t)written;
+   }
+
+   return true;
+}
+
+bool readAll(int fd, char *data, size_t size)
+{
+   while (size != 0) {
+      ssize_t read = ::recv(fd, data, size, 0);
+      if (read < 0 && errno == EINTR)
+         continue;
+
+      if (read <= 0)
+         return false;
+
+      data += read;
+      size -= (size_t)read;
+   }
+
+   return true;
+}
+
+#endif
+
+} // anonymous namespace
+
+LocalSocket::LocalSocket(int fd, std::string listenPath)
+   : fd(fd), listenPath(move(listenPath))
+{}
+
+LocalSocket::LocalSocket(LocalSocket &&other) noexcept
+   : fd(other.fd), listenPath(move(other.listenPath))
+{
+   other.fd = -1;
+   other.listenPath.clear();
+}
+
+LocalSocket &LocalSocket::operator=(LocalSocket &&other) noexcept
+{
+   // The previous socket is closed when other is destroyed.
+   std::swap(fd, other.fd);
+   std::swap(listenPath, other.listenPath);
+
+   return *this;
+}
+
+LocalSocket::~LocalSocket()
+{
+   if (fd == -1)
+      return;
+
+#ifndef OS_IS_WINDOWS
+   ::close(fd);
+
+   if (!listenPath.empty())
+      ::unlink(listenPath.c_str());
+#endif
+}
+
+#ifdef OS_IS_WINDOWS
+
+LocalSocket LocalSocket::Listen(const std::string &, std::string *errMsg)
+{
+   setError(errMsg, "local sockets are not supported on this platform");
+   return LocalSocket(-1);
+}
+
+LocalSocket LocalSocket::Connect(const std::string &, std::string *errMsg)
+{
+   setError(errMsg, "local sockets are not supported on this platform");
+   return LocalSocket(-1);
+}
+
+LocalSocket LocalSocket::Accept(std::string *errMsg) const
+{
+   setError(errMsg, "local sockets are not supported on this platform");
+   return LocalSocket(-1);
+}
+
+bool LocalSocket::sendMessage(std::string_view)
+{
+   return false;
+}
+
+bool LocalSocket::receiveMessage(std::string &)
+{
+   return false;
+}
+
+#else
+
+LocalSocket LocalSocket::Listen(const std::string &path, std::string *errMsg)
+{
+   sockaddr_un addr;
+   if (!makeAddress(path, addr, errMsg)) {
+      return LocalSocket(-1);
+   }
+
+   // Only replace a socket file if nobody answers on it anymore, never an
+   // unrelated file.
+   struct stat st;
+   if (::lstat(path.c_str(), &st) == 0) {
+      if (!S_ISSOCK(st.st_mode)) {
+         setError(errMsg, "'" + path + "' exists and is not a socket");
+         return LocalSocket(-1);
+      }
+
+      if (Connect(path).isValid()) {
+         setError(errMsg, "a server is already listening on '" + path + "'");
+         return LocalSocket(-1);
+      }
+
+      ::unlink(path.c_str());
+   }
+
+   int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+   if (fd == -1) {
+      setError(errMsg, std::strerror(errno));
+      return LocalSocket(-1);
+   }
+
+   // The socket file gets its permissions from the umask, so restrict them
+   // to the owner while binding.
+   mode_t prevMask = ::umask(S_IXUSR | S_IRWXG | S_IRWXO);
+   int result = ::bind(fd, (sockaddr*)&addr, sizeof(addr));
+   ::umask(prevMask);
+
+   if (result != 0 || ::listen(fd, SOMAXCONN) != 0) {
+      setError(errMsg, "could not listen on '" + path + "': "
+                          + std::strerror(errno));
+
+      ::close(fd);
+      return LocalSocket(-1);
+   }
+
+   return LocalSocket(fd, path);
+}
+
+LocalSocket LocalSocket::Connect(const std::string &path, std::string *errMsg)
+{
+   sockaddr_un addr;
+   if (!makeAddress(path, addr, errMsg)) {
+      return LocalSocket(-1);
+   }
+
+   int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+   if (fd == -1) {
+      setError(errMsg, std::strerror(errno));
+      return LocalSocket(-1);
+   }
+
+   if (::connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+      setError(errMsg, "could not connect to '" + path + "': "
+                          + std::strerror(errno));
+
+      ::close(fd);
+      return LocalSocket(-1);
+   }
+
+   disableSigPipe(fd);
+   return LocalSocket(fd);
+}
+
+LocalSocket LocalSocket::Accept(std::string *errMsg) const
+{
+   while (true) {
+      int conn = ::accept(fd, nullptr, nullptr);
+      if (conn != -1) {
+         // The permissions of the socket file should keep other users out
+         // already, but they are not honored everywhere.
+         if (!isSameUser(conn)) {
+            ::close(conn);
+            continue;
+         }
+
+         disableSigPipe(conn);
+         return LocalSocket(conn);
+      }
+
+      if (errno != EINTR) {
+         setError(errMsg, std::strerror(errno));
+         return LocalSocket(-1);
+      }
+   }
+}
+
+bool LocalSocket::sendMessage(std::string_view msg)
+{
+   // The length is sent as 8 little endian bytes.
+   unsigned char header[8];
+   uint64_t size = msg.size();
+   if (size > MaxMessageSize) {
+      return false;
+   }
+
+   for (unsigned i = 0; i < 8; ++i) {
+      header[i] = (unsigned char)(size >> (i * 8));
+   }
+
+   return writeAll(fd, (const char*)header, sizeof(header))
+      && writeAll(fd, msg.data(), msg.size());
+}
+
+bool LocalSocket::receiveMessage(std::string &msg)
+{
+   unsigned char header[8];
+   if (!readAll(fd, (char*)header, sizeof(header))) {
+      return false;
+   }
+
+   uint64_t size = 0;
+   for (unsigned i = 0; i < 8; ++i) {
+      size |= uint64_t(header[i]) << (i * 8);
+   }
+
+   if (size > MaxMessageSize) {
+      return false;
+   }
+
+   msg.resize(size);
+   return readAll(fd, msg.data(), size);
+}
+
+#endif
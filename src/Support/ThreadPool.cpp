@@ -0,0 +1,88 @@
+#include "tblgen/Support/ThreadPool.h"
+
+using namespace tblgen;
+using namespace tblgen::support;
+
+ThreadPool::ThreadPool(unsigned NumThreads)
+{
+   if (NumThreads == 0) {
+      NumThreads = getHardwareConcurrency();
+   }
+
+   Threads.reserve(NumThreads);
+   for (unsigned i = 0; i < NumThreads; ++i) {
+      Threads.emplace_back([this] { workerLoop(); });
+   }
+}
+
+ThreadPool::~ThreadPool()
+{
+   {
+      std::unique_lock<std::mutex> Lock(QueueLock);
+      EnableFlag = false;
+   }
+
+   QueueCondition.notify_all();
+   for (auto &Thread : Threads) {
+      Thread.join();
+   }
+}
+
+unsigned ThreadPool::getHardwareConcurrency()
+{
+   unsigned N = std::thread::hardware_concurrency();
+   return N == 0 ? 1 : N;
+}
+
+void ThreadPool::async(TaskTy Task)
+{
+   {
+      std::unique_lock<std::mutex> Lock(QueueLock);
+      Tasks.push_back(std::move(Task));
+   }
+
+   QueueCondition.notify_one();
+}
+
+void ThreadPool::wait()
+{
+   std::unique_lock<std::mutex> Lock(QueueLock);
+   CompletionCondition.wait(Lock, [this] {
+      return Tasks.empty() && ActiveTasks == 0;
+   });
+}
+
+void ThreadPool::workerLoop()
+{
+   while (true) {
+      TaskTy Task;
+      {
+         std::unique_lock<std::mutex> Lock(QueueLock);
+         QueueCondition.wait(Lock, [this] {
+            return !EnableFlag || !Tasks.empty();
+         });
+
+         if (Tasks.empty()) {
+            // The pool is shutting down and there's nothing left to do.
+            return;
+         }
+
+         Task = std::move(Tasks.front());
+         Tasks.pop_front();
+         ++ActiveTasks;
+      }
+
+      Task();
+
+      bool Notify;
+      {
+         std::unique_lock<std::mutex> Lock(QueueLock);
+         --ActiveTasks;
+         Notify = ActiveTasks == 0 && Tasks.empty();
+      }
+
+      if (Notify) {
+         CompletionCondition.notify_all();
+      }
+   }
+}
@@ -0,0 +1,340 @@
+#include "tblgen/Support/Timer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+
+#ifdef _WIN32
+#   define OS_IS_WINDOWS
+#   include <windows.h>
+#elif defined(__APPLE__) || defined(__linux__) || defined(__unix__)
+#   include <sys/resource.h>
+#   include <time.h>
+#else
+#   error "unsupported operating system!"
+#endif
+
+using namespace tblgen;
+using namespace tblgen::support;
+
+TimeReport *TimeReport::Active = nullptr;
+
+namespace {
+
+/// The innermost active region on this thread.
+thread_local TimeRegion *CurrentRegion = nullptr;
+
+uint64_t getWallTimeNs()
+{
+   return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// \return the CPU time used by the calling thread.
+uint64_t getThreadCPUTimeNs()
+{
+#ifdef OS_IS_WINDOWS
+   FILETIME Creation, Exit, Kernel, User;
+   if (!GetThreadTimes(GetCurrentThread(), &Creation, &Exit, &Kernel, &User))
+      return 0;
+
+   auto toNs = [](const FILETIME &T) {
+      return ((uint64_t(T.dwHighDateTime) << 32) | T.dwLowDateTime) * 100;
+   };
+
+   return toNs(Kernel) + toNs(User);
+#else
+   timespec TS;
+   if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &TS) != 0)
+      return 0;
+
+   return uint64_t(TS.tv_sec) * 1000000000 + uint64_t(TS.tv_nsec);
+#endif
+}
+
+/// \return the CPU time used by the whole process.
+uint64_t getProcessCPUTimeNs()
+{
+#ifdef OS_IS_WINDOWS
+   FILETIME Creation, Exit, Kernel, User;
+   if (!GetProcessTimes(GetCurrentProcess(), &Creation, &Exit, &Kernel,
+                        &User))
+      return 0;
+
+   auto toNs = [](const FILETIME &T) {
+      return ((uint64_t(T.dwHighDateTime) << 32) | T.dwLowDateTime) * 100;
+   };
+
+   return toNs(Kernel) + toNs(User);
+#else
+   rusage Usage;
+   if (getrusage(RUSAGE_SELF, &Usage) != 0)
+      return 0;
+
+   auto toNs = [](const timeval &T) {
+      return uint64_t(T.tv_sec) * 1000000000 + uint64_t(T.tv_usec) * 1000;
+   };
+
+   return toNs(Usage.ru_utime) + toNs(Usage.ru_stime);
+#endif
+}
+
+/// \return the peak resident set size of the process in bytes, or zero if
+/// it is unknown.
+uint64_t getPeakRSS()
+{
+#ifdef OS_IS_WINDOWS
+   return 0;
+#else
+   rusage Usage;
+   if (getrusage(RUSAGE_SELF, &Usage) != 0)
+      return 0;
+
+#  ifdef __APPLE__
+   return uint64_t(Usage.ru_maxrss);
+#  else
+   return uint64_t(Usage.ru_maxrss) * 1024;
+#  endif
+#endif
+}
+
+/// \return a small number that identifies the calling thread in traces.
+unsigned getThreadID()
+{
+   static std::atomic<unsigned> NextID(1);
+   thread_local unsigned ID = NextID++;
+
+   return ID;
+}
+
+std::string formatTime(uint64_t Ns)
+{
+   char Buf[32];
+   snprintf(Buf, sizeof(Buf), "%.4fs", double(Ns) / 1e9);
+
+   return Buf;
+}
+
+std::string formatBytes(uint64_t Bytes)
+{
+   char Buf[32];
+   if (Bytes < 1024)
+      snprintf(Buf, sizeof(Buf), "%lluB", (unsigned long long)Bytes);
+   else if (Bytes < 1024 * 1024)
+      snprintf(Buf, sizeof(Buf), "%.1fKB", double(Bytes) / 1024);
+   else
+      snprintf(Buf, sizeof(Buf), "%.1fMB", double(Bytes) / (1024 * 1024));
+
+   return Buf;
+}
+
+void writeJSONString(std::ostream &OS, std::string_view Str)
+{
+   OS << '"';
+   for (char c : Str) {
+      switch (c) {
+      case '"': OS << "\\\""; break;
+      case '\\': OS << "\\\\"; break;
+      case '\n': OS << "\\n"; break;
+      case '\t': OS << "\\t"; break;
+      default:
+         if ((unsigned char)c < 0x20) {
+            char Buf[8];
+            snprintf(Buf, sizeof(Buf), "\\u%04x", (unsigned)c);
+            OS << Buf;
+         }
+         else {
+            OS << c;
+         }
+
+         break;
+      }
+   }
+
+   OS << '"';
+}
+
+/// Print \p Str right aligned in a column of \p Width characters.
+void printColumn(std::ostream &OS, const std::string &Str, size_t Width)
+{
+   if (Str.size() < Width)
+      OS << std::string(Width - Str.size(), ' ');
+
+   OS << Str;
+}
+
+} // anonymous namespace
+
+TimeReport::TimeReport(bool RecordTrace)
+   : StartNs(getWallTimeNs()), RecordTrace(RecordTrace)
+{
+   Active = this;
+}
+
+TimeReport::~TimeReport()
+{
+   if (Active == this)
+      Active = nullptr;
+}
+
+void TimeReport::addCall(const TimeRegion &R, uint64_t WallNs,
+                         uint64_t CPUNs, uint64_t ArenaBytes)
+{
+   uint64_t PeakRSS = getPeakRSS();
+
+   std::lock_guard<std::mutex> Lock(Mtx);
+
+   auto &Stats = Phases[R.Key];
+   ++Stats.NumCalls;
+   Stats.SelfWallNs += WallNs - std::min(WallNs, R.ChildWallNs);
+   Stats.SelfCPUNs += CPUNs - std::min(CPUNs, R.ChildCPUNs);
+   Stats.ArenaBytes += ArenaBytes - std::min(ArenaBytes, R.ChildArena);
+   Stats.PeakRSS = std::max(Stats.PeakRSS, PeakRSS);
+
+   if (!R.IsRecursive) {
+      Stats.WallNs += WallNs;
+      Stats.CPUNs += CPUNs;
+   }
+
+   if (RecordTrace) {
+      Events.push_back(TraceEvent{ R.Key, R.Detail, R.StartNs - StartNs,
+                                   WallNs, getThreadID() });
+   }
+}
+
+TimeReport::PhaseStats TimeReport::getPhaseStats(const std::string &Name) const
+{
+   std::lock_guard<std::mutex> Lock(Mtx);
+
+   auto It = Phases.find(Name);
+   if (It == Phases.end())
+      return PhaseStats();
+
+   return It->second;
+}
+
+void TimeReport::print(std::ostream &OS) const
+{
+   std::lock_guard<std::mutex> Lock(Mtx);
+
+   std::vector<std::pair<const std::string*, const PhaseStats*>> Sorted;
+   for (auto &Entry : Phases) {
+      Sorted.emplace_back(&Entry.first, &Entry.second);
+   }
+
+   std::sort(Sorted.begin(), Sorted.end(), [](auto &LHS, auto &RHS) {
+      if (LHS.second->SelfWallNs != RHS.second->SelfWallNs)
+         return LHS.second->SelfWallNs > RHS.second->SelfWallNs;
+
+      return *LHS.first < *RHS.first;
+   });
+
+   OS << "===" << std::string(70, '-') << "===\n"
+      << std::string(28, ' ') << "TblGen time report\n"
+      << "===" << std::string(70, '-') << "===\n"
+      << "  Total wall time: " << formatTime(getWallTimeNs() - StartNs)
+      << ", CPU time: " << formatTime(getProcessCPUTimeNs())
+      << ", peak RSS: " << formatBytes(getPeakRSS()) << "\n\n";
+
+   OS << "   Self wall  Total wall    Self CPU   Total CPU     Calls"
+         "      Arena   Peak RSS  Phase\n";
+
+   for (auto &Entry : Sorted) {
+      auto &Stats = *Entry.second;
+      printColumn(OS, formatTime(Stats.SelfWallNs), 12);
+      printColumn(OS, formatTime(Stats.WallNs), 12);
+      printColumn(OS, formatTime(Stats.SelfCPUNs), 12);
+      printColumn(OS, formatTime(Stats.CPUNs), 12);
+      printColumn(OS, std::to_string(Stats.NumCalls), 10);
+      printColumn(OS, formatBytes(Stats.ArenaBytes), 11);
+      printColumn(OS, formatBytes(Stats.PeakRSS), 11);
+      OS << "  " << *Entry.first << "\n";
+   }
+}
+
+void TimeReport::writeTrace(std::ostream &OS) const
+{
+   std::lock_guard<std::mutex> Lock(Mtx);
+
+   OS << "{\"traceEvents\":[";
+
+   bool First = true;
+   char Buf[64];
+
+   for (auto &E : Events) {
+      if (!First)
+         OS << ",";
+
+      First = false;
+
+      OS << "\n{\"name\":";
+      writeJSONString(OS, E.Name);
+
+      snprintf(Buf, sizeof(Buf), "%.3f", double(E.StartNs) / 1000);
+      OS << ",\"cat\":\"tblgen\",\"ph\":\"X\",\"ts\":" << Buf;
+
+      snprintf(Buf, sizeof(Buf), "%.3f", double(E.DurationNs) / 1000);
+      OS << ",\"dur\":" << Buf << ",\"pid\":1,\"tid\":" << E.ThreadID;
+
+      if (!E.Detail.empty()) {
+         OS << ",\"args\":{\"detail\":";
+         writeJSONString(OS, E.Detail);
+         OS << "}";
+      }
+
+      OS << "}";
+   }
+
+   OS << "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
+
+void TimeRegion::start(TimeReport &R, std::string_view Phase,
+                       std::string_view Name, std::string_view Detail)
+{
+   Report = &R;
+
+   Key = Phase;
+   if (!Name.empty()) {
+      Key += ' ';
+      Key += Name;
+   }
+
+   if (R.RecordTrace)
+      this->Detail = Detail;
+
+   Parent = CurrentRegion;
+   CurrentRegion = this;
+
+   for (auto *P = Parent; P; P = P->Parent) {
+      if (P->Key == Key) {
+         IsRecursive = true;
+         break;
+      }
+   }
+
+   if (R.ArenaCounter)
+      StartArena = R.ArenaCounter();
+
+   StartCPUNs = getThreadCPUTimeNs();
+   StartNs = getWallTimeNs();
+}
+
+void TimeRegion::stop()
+{
+   uint64_t WallNs = getWallTimeNs() - StartNs;
+   uint64_t CPUNs = getThreadCPUTimeNs() - StartCPUNs;
+
+   uint64_t ArenaBytes = 0;
+   if (Report->ArenaCounter)
+      ArenaBytes = Report->ArenaCounter() - StartArena;
+
+   CurrentRegion = Parent;
+   if (Parent) {
+      Parent->ChildWallNs += WallNs;
+      Parent->ChildCPUNs += CPUNs;
+      Parent->ChildArena += ArenaBytes;
+   }
+
+   Report->addCall(*this, WallNs, CPUNs, ArenaBytes);
+}
@@ -1,14 +1,50 @@
 
 #include "tblgen/Message/Diagnostics.h"
 #include "tblgen/TableGen.h"
+#include "tblgen/Basic/FileManager.h"
+#include "tblgen/Basic/FileUtils.h"
+#include "tblgen/Lex/Lexer.h"
+#include "tblgen/Message/DiagnosticsEngine.h"
 #include "tblgen/Record.h"
+#include "tblgen/RecordIndex.h"
 #include "tblgen/Value.h"
 #include "tblgen/Support/Casting.h"
+#include "tblgen/Support/Timer.h"
+
+#include <atomic>
+#include <cstring>
 
 using namespace tblgen::support;
 
 namespace tblgen {
 
+namespace {
+
+/// Source of the IDs that tell apart lists of thread allocators.
+std::atomic<uint64_t> NextAllocatorListID(1);
+
+/// The allocator of the current thread, and the ID of the list it belongs
+/// to.
+thread_local uint64_t ThreadAllocatorOwner = 0;
+thread_local ArenaAllocator *ThreadAllocator = nullptr;
+
+/// Create the types of the classes and enums in \p RK and its namespaces.
+/// Record types are not created for every record, since most of them are
+/// never needed.
+void materializeTypes(const TableGen &TG, const RecordKeeper &RK)
+{
+   for (auto &C : RK.getAllClasses())
+      TG.getListType(TG.getClassType(C.second));
+
+   for (auto &E : RK.getAllEnums())
+      TG.getListType(TG.getEnumType(E.second));
+
+   for (auto &NS : RK.getAllNamespaces())
+      materializeTypes(TG, *NS.second);
+}
+
+} // anonymous namespace
+
 TableGen::TableGen(support::ArenaAllocator &Allocator, fs::FileManager &fileMgr,
                    DiagnosticsEngine &Diags)
    : Allocator(Allocator), fileMgr(fileMgr), Diags(Diags),
@@ -22,6 +58,200 @@ TableGen::TableGen(support::ArenaAllocator &Allocator, fs::FileManager &fileMgr,
      Undef(&UndefTy)
 {}
 
+TableGen::~TableGen() = default;
+
+TableGen::ThreadAllocatorList::ThreadAllocatorList()
+   : ID(NextAllocatorListID++)
+{}
+
+ArenaAllocator &TableGen::ThreadAllocatorList::get()
+{
+   if (ThreadAllocatorOwner == ID)
+      return *ThreadAllocator;
+
+   std::lock_guard<std::mutex> Lock(Mtx);
+   Allocators.push_back(std::make_unique<ArenaAllocator>());
+
+   ThreadAllocatorOwner = ID;
+   ThreadAllocator = Allocators.back().get();
+
+   return *ThreadAllocator;
+}
+
+void TableGen::ThreadAllocatorList::printStats(std::ostream &OS,
+                                               const char *Name) const
+{
+   std::lock_guard<std::mutex> Lock(Mtx);
+   for (size_t i = 0; i < Allocators.size(); ++i) {
+      OS << Name << " #" << i << ":\n";
+      Allocators[i]->printStats(OS);
+   }
+}
+
+TableGen::ScratchSpace::ScratchSpace(TableGen &TG) : TG(TG)
+{
+   assert(TG.Frozen && !TG.Scratch && "cannot attach a scratch space");
+   TG.Scratch = this;
+}
+
+TableGen::ScratchSpace::~ScratchSpace()
+{
+   TG.Scratch = nullptr;
+}
+
+ArenaAllocator &TableGen::getThreadAllocator() const
+{
+   if (Scratch)
+      return Scratch->Allocators.get();
+
+   return ThreadAllocators.get();
+}
+
+void *TableGen::AllocatePersistent(size_t size, size_t alignment) const
+{
+   if (!Scratch)
+      return Allocate(size, alignment);
+
+   // The thread allocators of this instance might belong to threads that
+   // are gone, so the memory is taken from the allocator used for parsing.
+   // The identifier table allocates from it as well.
+   std::lock_guard<std::mutex> Lock(IdentsMtx);
+   return Allocator.Allocate(size, alignment);
+}
+
+void TableGen::freeze()
+{
+   if (Frozen)
+      return;
+
+   // Create the types that backends and templates commonly ask for, so
+   // that they are found without taking a lock.
+   materializeTypes(*this, *GlobalRK);
+
+   Type *BuiltinTypes[] = {
+      &Int1Ty, &Int8Ty, &UInt8Ty, &Int16Ty, &UInt16Ty, &Int32Ty, &UInt32Ty,
+      &Int64Ty, &UInt64Ty, &FloatTy, &DoubleTy, &StringTy, &CodeTy,
+   };
+
+   for (auto *Ty : BuiltinTypes) {
+      getListType(Ty);
+      getDictType(Ty);
+   }
+
+   // Fill the lazily built caches of the classes, since lookups would
+   // otherwise modify them.
+   for (auto *C : ClassesByID)
+      C->buildInheritedFields();
+
+   ClassTypes.freeze();
+   RecordTypes.freeze();
+   EnumTypes.freeze();
+   ListTypes.freeze();
+   DictTypes.freeze();
+   IntLiterals.freeze();
+   FPLiterals.freeze();
+   StringLiterals.freeze();
+
+   Idents.setMutex(&IdentsMtx);
+   Frozen = true;
+}
+
+void TableGen::printAllocatorStats(std::ostream &OS) const
+{
+   Allocator.printStats(OS);
+
+   ThreadAllocators.printStats(OS, "Thread allocator");
+   if (Scratch)
+      Scratch->Allocators.printStats(OS, "Scratch allocator");
+
+   if (!PrelexedTokens.empty()) {
+      size_t NumTokens = 0;
+      size_t Bytes = 0;
+      for (auto &Entry : PrelexedTokens) {
+         NumTokens += Entry.second.size();
+         Bytes += Entry.second.getMemoryUsage();
+      }
+
+      OS << "Prelexed tokens: " << NumTokens << " in " << PrelexedTokens.size()
+         << " files, " << Bytes << " bytes\n";
+   }
+}
+
+IntegerLiteral *TableGen::getIntegerLiteral(Type *Ty, uint64_t Val)
+{
+   LiteralKey Key{ Ty, Val };
+   if (auto *Lit = IntLiterals.find(Key))
+      return *Lit;
+
+   return IntLiterals.insert(Key, createPersistent<IntegerLiteral>(Ty, Val));
+}
+
+FPLiteral *TableGen::getFPLiteral(Type *Ty, double Val)
+{
+   uint64_t Bits;
+   memcpy(&Bits, &Val, sizeof(Bits));
+
+   LiteralKey Key{ Ty, Bits };
+   if (auto *Lit = FPLiterals.find(Key))
+      return *Lit;
+
+   return FPLiterals.insert(Key, createPersistent<FPLiteral>(Ty, Val));
+}
+
+StringLiteral *TableGen::getStringLiteral(Type *Ty, std::string_view Val)
+{
+   if (auto *Lit = StringLiterals.find(StringLiteralKey{ Ty, Val }))
+      return *Lit;
+
+   auto *Lit = createPersistent<StringLiteral>(Ty, Val);
+   return StringLiterals.insert(StringLiteralKey{ Ty, Lit->getVal() }, Lit);
+}
+
+std::string TableGen::findIncludeFile(std::string_view file,
+                                     unsigned sourceId) {
+   std::string path(fs::getPath(fileMgr.getFileName(sourceId)));
+
+   std::string key = path;
+   key += '\0';
+   key += file;
+
+   auto it = IncludeFileCache.find(key);
+   if (it != IncludeFileCache.end())
+      return it->second;
+
+   auto realFile = fs::findFileInDirectories(file,
+                                             std::vector<std::string>{path});
+
+   IncludeFileCache.emplace(move(key), realFile);
+   return realFile;
+}
+
+const lex::TokenBuffer *TableGen::prelexFile(const fs::OpenFile &File)
+{
+   if (auto *Toks = getPrelexedTokens(File.SourceId))
+      return Toks;
+
+   support::TimeRegion Timer("Lex", {}, fileMgr.getFileName(File.SourceId));
+
+   // Keywords have to be known before the first identifier is lexed.
+   Idents.addTblGenKeywords();
+
+   // Don't report errors out of order, the parser lexes the file again.
+   DiagnosticsEngine LexDiags(Allocator);
+   lex::Lexer Lex(Idents, LexDiags, File.Buf, File.SourceId, File.BaseOffset,
+                  '\0');
+
+   lex::TokenBuffer Toks(File.Buf, File.BaseOffset);
+   Lex.lexAll(Toks);
+
+   if (LexDiags.getNumErrors() != 0)
+      return nullptr;
+
+   Toks.finish();
+   return &PrelexedTokens.emplace(File.SourceId, std::move(Toks))
+      .first->second;
+}
+
 static Value *resolveValue(Value *V,
                            Class::BaseClass const &PreviousBase,
                            const std::vector<Value *> &ConcreteTemplateArgs,
@@ -68,38 +298,12 @@ static void resolveValues(Class::BaseClass const &Base,
    }
 }
 
-static Value *getOverride(const TableGen &TG, Record &R, std::string_view FieldName)
+static Value *getOverride(TableGen &TG, Record &R, std::string_view FieldName)
 {
    for (auto &Base : R.getBases()) {
       if (auto *OV = Base.getBase()->getOverride(FieldName)) {
          if (OV->isAppend())
-         {
-            auto baseValue = Base.getBase()->getOwnField(FieldName);
-            auto *defaultVal = baseValue->getDefaultValue();
-
-            assert(defaultVal != nullptr && "no default value for overriden field");
-
-            if (auto *list = cast<ListLiteral>(defaultVal))
-            {
-               auto *listToAppend = cast<ListLiteral>(OV->getDefaultValue());
-               std::vector<Value*> vec(list->getValues());
-               vec.insert(vec.end(), listToAppend->getValues().begin(),
-                          listToAppend->getValues().end());
-
-               return new(TG) ListLiteral(list->getType(), move(vec));
-            }
-            else
-            {
-               auto *dict = cast<DictLiteral>(defaultVal);
-               auto *dictToAppend = cast<DictLiteral>(OV->getDefaultValue());
-
-               auto map = dict->getValues();
-               map.insert(dictToAppend->getValues().begin(),
-                          dictToAppend->getValues().end());
-
-               return new(TG) DictLiteral(dict->getType(), move(map));
-            }
-         }
+            return TG.getAppendedValue(Base.getBase(), OV);
 
          return OV->getDefaultValue();
       }
@@ -108,24 +312,25 @@ static Value *getOverride(const TableGen &TG, Record &R, std::string_view FieldN
    return nullptr;
 }
 
-static RecordField const*
-implementBaseForRecord(const TableGen &TG, Class::BaseClass const& Base,
-                       Record &R,
-                       const std::vector<Value *> &BaseTemplateArgs) {
+/// Add the values that the fields of \p Base and its bases get in records
+/// that derive from the bases of \p R to \p Plan. Which fields a record
+/// defines itself is only known later, so the values of all fields are
+/// resolved.
+static void addBaseToPlan(TableGen &TG, TableGen::FinalizePlan &Plan,
+                          Class::BaseClass const& Base, Record &R,
+                          const std::vector<Value *> &BaseTemplateArgs) {
+   auto &Entries = Plan.Entries;
    for (auto &Field : Base.getBase()->getFields()) {
-      std::string fieldName(Field.getName());
-      if (auto val = R.getOwnField(Field.getName())) {
-         R.setFieldValue(fieldName, val->getDefaultValue());
-      }
-      else if (auto Override = getOverride(TG, R, Field.getName())) {
-         R.setFieldValue(fieldName, resolveValue(Override, Base,
-                                                       BaseTemplateArgs,
-                                                       Field.getDeclLoc()));
+      auto slot = Plan.Layout->getSlot(Field.getName());
+      assert(slot && "inherited field is not part of the layout");
+
+      Value *val = nullptr;
+      if (auto Override = getOverride(TG, R, Field.getName())) {
+         val = resolveValue(Override, Base, BaseTemplateArgs,
+                            Field.getDeclLoc());
       }
       else if (auto def = Field.getDefaultValue()) {
-         R.setFieldValue(fieldName, resolveValue(def, Base,
-                                                       BaseTemplateArgs,
-                                                       Field.getDeclLoc()));
+         val = resolveValue(def, Base, BaseTemplateArgs, Field.getDeclLoc());
       }
       else if (Field.hasAssociatedTemplateParm()) {
          size_t idx = Field.getAssociatedTemplateParm();
@@ -134,55 +339,273 @@ implementBaseForRecord(const TableGen &TG, Class::BaseClass const& Base,
                 && "invalid template parameter index");
 
          if (idx < Base.getTemplateArgs().size()) {
-            R.setFieldValue(fieldName,
-                            resolveValue(Base.getTemplateArgs()[idx], Base,
-                                         BaseTemplateArgs, Field.getDeclLoc()));
+            val = resolveValue(Base.getTemplateArgs()[idx], Base,
+                               BaseTemplateArgs, Field.getDeclLoc());
          }
          else {
             auto P = Base.getBase()->getParameters()[idx];
             assert (P.getDefaultValue() && "template parm not supplied!");
-            R.setFieldValue(fieldName,
-                            resolveValue(P.getDefaultValue(), Base,
-                                         BaseTemplateArgs,
-                                         Field.getDeclLoc()));
+            val = resolveValue(P.getDefaultValue(), Base, BaseTemplateArgs,
+                               Field.getDeclLoc());
          }
       }
       else {
-         return &Field;
+         Entries.push_back({ Field.getName(), slot.getValue(), nullptr,
+                             &Field });
+
+         continue;
       }
+
+      Entries.push_back({ Field.getName(), slot.getValue(), val, nullptr });
    }
 
    // propagate resolved template arguments to the next base
    std::vector<Value*> NextBaseTemplateArgs;
    for (auto &NextBase : Base.getBase()->getBases()) {
       resolveValues(NextBase, Base, BaseTemplateArgs, NextBaseTemplateArgs);
-
-      if (auto missing = implementBaseForRecord(TG, NextBase, R,
-                                                NextBaseTemplateArgs)) {
-         return missing;
-      }
+      addBaseToPlan(TG, Plan, NextBase, R, NextBaseTemplateArgs);
 
       NextBaseTemplateArgs.clear();
    }
+}
 
-   return nullptr;
+void TableGen::addFieldsToLayout(RecordLayout &Layout, Class *C)
+{
+   for (auto &F : C->getFields())
+      Layout.addField(Idents.get(F.getName()).getIdentifier());
+
+   for (auto &B : C->getBases())
+      addFieldsToLayout(Layout, B.getBase());
 }
 
-TableGen::FinalizeResult TableGen::finalizeRecord(Record &R)
+const RecordLayout *TableGen::getRecordLayout(const std::vector<Class*> &Bases)
+{
+   std::unique_lock<std::mutex> Lock(LayoutsMtx, std::defer_lock);
+   if (Frozen)
+      Lock.lock();
+
+   auto &Layout = RecordLayouts[Bases];
+   if (Layout)
+      return Layout;
+
+   Layout = createPersistent<RecordLayout>();
+   for (auto *C : Bases)
+      addFieldsToLayout(*Layout, C);
+
+   // Reserve a slot for the name field added by finalizeRecord().
+   bool hasName = Layout->getSlot("name").hasValue();
+   Layout->addField(Idents.get(hasName ? "__name" : "name").getIdentifier());
+
+   return Layout;
+}
+
+const support::BitVector *
+TableGen::getAncestors(const support::BitVector *Ancestors, Class *Base)
+{
+   std::unique_lock<std::mutex> Lock(LayoutsMtx, std::defer_lock);
+   if (Frozen)
+      Lock.lock();
+
+   auto Result = RecordAncestors.try_emplace(std::make_pair(Ancestors, Base));
+   auto &IDs = Result.first->second;
+
+   if (Result.second) {
+      if (Ancestors)
+         IDs = *Ancestors;
+
+      IDs.set(Base->getID());
+      IDs |= Base->getAncestors();
+   }
+
+   return &IDs;
+}
+
+const RecordIndex &TableGen::getRecordIndex(const RecordKeeper &RK, Class *C,
+                                            std::string_view FieldName,
+                                            bool WithOrder)
+{
+   std::unique_lock<std::mutex> Lock(RecordIndexesMtx, std::defer_lock);
+   if (Frozen)
+      Lock.lock();
+
+   auto &Index = RecordIndexes[std::make_tuple(&RK, C, std::string(FieldName))];
+   if (!Index) {
+      auto *Field = C->getField(FieldName);
+      assert(Field && RecordIndex::supportsType(Field->getType())
+             && "field cannot be indexed");
+
+      Index = std::make_unique<RecordIndex>(FieldName, Field->getType());
+   }
+
+   // Records can still be added before freeze().
+   Index->update(RK.getDefinitionsOf(C));
+
+   if (WithOrder)
+      Index->buildOrder();
+
+   return *Index;
+}
+
+Value *TableGen::getAppendedValue(Class *C, const RecordField *Override)
 {
+   auto It = AppendedValues.find(Override);
+   if (It != AppendedValues.end())
+      return It->second;
+
+   // A field can only be overridden once, so the override appends to the
+   // field's default value.
+   auto *Field = C->getField(Override->getName());
+   assert(Field && "override of unknown field");
+
+   auto *baseValue = Field->getDefaultValue();
+   assert(baseValue != nullptr && "no default value for overriden field");
+
+   Value *result;
+   if (auto *list = dyn_cast<ListLiteral>(baseValue)) {
+      auto *listToAppend = cast<ListLiteral>(Override->getDefaultValue());
+      std::vector<Value*> vec(list->getValues());
+      vec.insert(vec.end(), listToAppend->getValues().begin(),
+                 listToAppend->getValues().end());
+
+      result = createPersistent<ListLiteral>(list->getType(), move(vec));
+   }
+   else {
+      auto *dict = cast<DictLiteral>(baseValue);
+      auto *dictToAppend = cast<DictLiteral>(Override->getDefaultValue());
+
+      auto map = dict->getValues();
+      map.insert(dictToAppend->getValues().begin(),
+                 dictToAppend->getValues().end());
+
+      result = createPersistent<DictLiteral>(dict->getType(), move(map));
+   }
+
+   AppendedValues.emplace(Override, result);
+   return result;
+}
+
+const TableGen::FinalizePlan &TableGen::getFinalizePlan(Record &R)
+{
+   std::vector<const void*> Key;
+   std::vector<Class*> BaseClasses;
+
    for (auto &Base : R.getBases()) {
-      if (auto missing = implementBaseForRecord(*this, Base, R,
-                                                Base.getTemplateArgs())) {
+      auto &Args = Base.getTemplateArgs();
+
+      Key.push_back(Base.getBase());
+      Key.push_back(reinterpret_cast<const void*>(Args.size()));
+      Key.insert(Key.end(), Args.begin(), Args.end());
+
+      BaseClasses.push_back(Base.getBase());
+   }
+
+   // The layout is computed first, since it takes the same lock.
+   auto *Layout = getRecordLayout(BaseClasses);
+
+   std::unique_lock<std::mutex> Lock(LayoutsMtx, std::defer_lock);
+   if (Frozen)
+      Lock.lock();
+
+   auto It = FinalizePlans.find(Key);
+   if (It != FinalizePlans.end())
+      return It->second;
+
+   // The template arguments in the key might be allocated from the scratch
+   // space, so the plan must not outlive it.
+   auto &Plans = Scratch ? Scratch->FinalizePlans : FinalizePlans;
+   if (Scratch) {
+      It = Plans.find(Key);
+      if (It != Plans.end())
+         return It->second;
+   }
+
+   FinalizePlan Plan;
+   Plan.Layout = Layout;
+
+   for (auto &Base : R.getBases()) {
+      addBaseToPlan(*this, Plan, Base, R, Base.getTemplateArgs());
+   }
+
+   for (unsigned i = 0; i < Plan.Entries.size(); ++i) {
+      if (Plan.Entries[i].Missing)
+         Plan.MissingEntries.push_back(i);
+   }
+
+   return Plans.emplace(std::move(Key), std::move(Plan)).first->second;
+}
+
+TableGen::FinalizeResult TableGen::finalizeRecord(Record &R)
+{
+   if (!LazyFinalization)
+      return finalizeRecordNow(R);
+
+   // Only report missing fields now, which are rare and cheap to check.
+   auto &Plan = getFinalizePlan(R);
+   for (unsigned idx : Plan.MissingEntries) {
+      auto &Entry = Plan.Entries[idx];
+      if (!R.findOwnField(Entry.Name)) {
          return {
-            RFS_MissingFieldValue, std::string(missing->getName()),
-            missing->getDeclLoc()
+            RFS_MissingFieldValue, std::string(Entry.Missing->getName()),
+            Entry.Missing->getDeclLoc()
          };
       }
    }
 
-   auto name = R.hasField("name") ? "__name" : "name";
+   R.NeedsFinalization.store(true, std::memory_order_release);
+   return { RFS_Success };
+}
+
+void TableGen::finalizeDeferredRecord(Record &R)
+{
+   std::unique_lock<std::recursive_mutex> Lock(DeferredFinalizeMtx,
+                                               std::defer_lock);
+   if (Frozen)
+      Lock.lock();
+
+   if (!R.NeedsFinalization.load(std::memory_order_relaxed))
+      return;
+
+   // Missing fields were checked by finalizeRecord() already.
+   auto result = finalizeRecordNow(R);
+   assert(result.status == RFS_Success && "unchecked missing field");
+   (void)result;
+
+   R.NeedsFinalization.store(false, std::memory_order_release);
+}
+
+TableGen::FinalizeResult TableGen::finalizeRecordNow(Record &R)
+{
+   support::TimeRegion Timer("Finalize record");
+   auto &Plan = getFinalizePlan(R);
+
+   // The layout only differs if values were set before all bases were
+   // added, in which case the slots of the plan can't be used.
+   bool useSlots = R.getOrCreateLayout() == Plan.Layout;
+   bool hasOwnFields = !R.ownFields.empty();
+
+   for (auto &Entry : Plan.Entries) {
+      Value *val = Entry.Val;
+      if (auto own = hasOwnFields ? R.findOwnField(Entry.Name) : nullptr) {
+         val = own->getDefaultValue();
+      }
+      else if (Entry.Missing) {
+         return {
+            RFS_MissingFieldValue, std::string(Entry.Missing->getName()),
+            Entry.Missing->getDeclLoc()
+         };
+      }
+
+      if (useSlots) {
+         R.setFieldValueBySlot(Entry.Slot, val);
+      }
+      else {
+         R.setFieldValue(Entry.Name, val);
+      }
+   }
+
+   auto name = R.lookupFieldValue("name") ? "__name" : "name";
    R.addOwnField(SourceLocation(), name, getStringTy(),
-      new (*this) StringLiteral(getStringTy(), std::string(R.getName())));
+      getStringLiteral(getStringTy(), R.getName()));
 
    return { RFS_Success };
 }
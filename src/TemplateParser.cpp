@@ -1,4 +1,3 @@
-
 #include "tblgen/Parser.h"
 
 #include "tblgen/Record.h"
@@ -8,8 +7,10 @@
 #include "tblgen/Basic/FileUtils.h"
 #include "tblgen/Support/Casting.h"
 #include "tblgen/Support/LiteralParser.h"
-#include "tblgen/Support/SaveAndRestore.h"
+#include "tblgen/Support/Timer.h"
 
+#include <algorithm>
+#include <iterator>
 #include <sstream>
 
 using namespace tblgen::lex;
@@ -19,150 +20,159 @@ using namespace tblgen::support;
 using std::string;
 
 namespace tblgen {
+namespace {
+
+/// Binds a for_each or macro value for the duration of a loop. A value of
+/// the same name that was visible before is restored afterwards.
+class ValueBinding {
+public:
+   ValueBinding(std::unordered_map<std::string, Value*> &Vals,
+                const std::string &name)
+      : Vals(Vals), name(name)
+   {
+      if (name.empty())
+         return;
+
+      auto Result = Vals.emplace(name, nullptr);
+      slot = &Result.first->second;
+      owned = Result.second;
+      prev = *slot;
+   }
+
+   ~ValueBinding()
+   {
+      if (!slot)
+         return;
+
+      if (owned)
+         Vals.erase(name);
+      else
+         *slot = prev;
+   }
 
-TemplateParser::TemplateParser(tblgen::TableGen &TG, const std::string &Buf,
+   void set(Value *V)
+   {
+      if (slot)
+         *slot = V;
+   }
+
+private:
+   std::unordered_map<std::string, Value*> &Vals;
+   const std::string &name;
+   Value **slot = nullptr;
+   Value *prev = nullptr;
+   bool owned = false;
+};
+
+} // anonymous namespace
+
+TemplateParser::TemplateParser(tblgen::TableGen &TG, std::string_view Buf,
                                unsigned sourceId, unsigned baseOffset)
-                               : Parser(TG, Buf, sourceId, baseOffset)
+                               : Parser(TG, Buf, sourceId, baseOffset),
+                                 commandTokens(Buf, baseOffset)
 {
-   ActiveOS = &OS;
+
 }
 
-TemplateParser::TemplateParser(tblgen::TableGen &TG, const std::vector<Token> &Toks,
-                               unsigned sourceId, unsigned baseOffset,
-                               const std::unordered_map<std::string, Macro> &macros)
-   : Parser(TG, Toks, sourceId, baseOffset), macros(macros)
+TemplateParser::TemplateParser(tblgen::TableGen &TG, unsigned sourceId,
+                               unsigned baseOffset)
+   : Parser(TG, TokenRange(), sourceId, baseOffset)
 {
-   ActiveOS = &OS;
+
 }
 
-bool TemplateParser::parseTemplate()
+TemplateParser::~TemplateParser()
 {
-   while (!currentTok().is(tok::eof)) {
-      if (!commandFollows()) {
-         currentTokens.push_back(currentTok());
-         advanceNoSkip();
-
-         continue;
-      }
 
-      if (!currentTokens.empty()) {
-         appendTokens(currentTok().getIdentifierInfo()->isStr("<%"));
-      }
+}
 
-      handleTemplateExpr();
-      advanceNoSkip();
-   }
+bool TemplateParser::compileTemplate()
+{
+   compileBlock(program, BlockKind::TopLevel);
 
-   if (!currentTokens.empty()) {
-      appendTokens(false);
-   }
+   // The executor is created here rather than in emitTemplate(), since
+   // constructing a parser modifies the identifier table.
+   executor.reset(new TemplateParser(TG, lex.getSourceId(), lex.getOffset()));
 
    return TG.Diags.getNumErrors() == 0;
 }
 
-void TemplateParser::appendTokens(bool beforeCommand)
+bool TemplateParser::emitTemplate(std::ostream &OS)
 {
-   int remove = 0;
-   bool foundNewline = false;
+   assert(executor && "template was not compiled");
 
-   if (beforeCommand) {
-      for (int i = currentTokens.size() - 1; i >= 0; --i) {
-         if (currentTokens[i].is(tok::newline)) {
-            foundNewline = true;
-            ++remove;
+   executor->ActiveOS = &OS;
+   executor->execute(program);
+   executor->ActiveOS = nullptr;
 
-            break;
-         }
-
-         if (currentTokens[i].isWhitespace()) {
-            ++remove;
-         }
-         else {
-            break;
-         }
-      }
-   }
+   return TG.Diags.getNumErrors() == 0;
+}
 
-   if (!foundNewline) {
-      remove = 0;
+void TemplateParser::appendTokens(OpList &ops, bool beforeCommand)
+{
+   // Drop the whitespace in front of a command on its own line.
+   if (beforeCommand && currentTextNewline != string::npos) {
+      currentText.resize(currentTextNewline);
    }
 
-   for (int i = 0; i < currentTokens.size() - remove; ++i) {
-      *ActiveOS << currentTokens[i].rawRepr();
-   }
+   std::string text = std::move(currentText);
+   currentText.clear();
+   currentTextNewline = string::npos;
 
-   currentTokens.clear();
-}
+   if (text.empty())
+      return;
 
-std::string TemplateParser::getResult()
-{
-   return OS.str();
+   ops.emplace_back(TemplateOp::Text, false, SourceLocation());
+   ops.back().text = std::move(text);
 }
 
-void TemplateParser::parseUntilEnd(bool *isElse)
+bool TemplateParser::compileBlock(OpList &ops, BlockKind kind)
 {
    while (!currentTok().is(tok::eof)) {
       if (!commandFollows()) {
-         currentTokens.push_back(currentTok());
+         if (currentTok().is(tok::newline)) {
+            currentTextNewline = currentText.size();
+         }
+         else if (!currentTok().isWhitespace()) {
+            currentTextNewline = string::npos;
+         }
+
+         currentText += currentTok().rawRepr();
          advanceNoSkip();
 
          continue;
       }
 
-      if (!currentTokens.empty()) {
-         appendTokens(currentTok().getIdentifierInfo()->isStr("<%"));
-      }
+      if (!currentText.empty()) {
+         bool trim = currentTok().getIdentifierInfo()->isStr("<%");
 
-      bool isEnd = false;
-      handleTemplateExpr(&isEnd, isElse);
+         // The text before the end of a macro is not trimmed, since it used
+         // to be the end of the macro's token stream.
+         if (kind == BlockKind::Macro && peek().isIdentifier("end"))
+            trim = false;
 
-      if (isEnd || (isElse && *isElse)) {
-         break;
+         appendTokens(ops, trim);
       }
 
-      advanceNoSkip();
-   }
+      bool isEnd = false;
+      bool isElse = false;
 
-   if (!currentTokens.empty()) {
-      appendTokens(false);
-   }
-}
+      compileCommand(ops, kind,
+                     kind == BlockKind::TopLevel ? nullptr : &isEnd,
+                     kind == BlockKind::IfBody ? &isElse : nullptr);
 
-void TemplateParser::skipUntilEnd(std::vector<lex::Token> *tokens)
-{
-   int openEnds = 1;
-   while (!currentTok().is(tok::eof)) {
-      if (tokens)
-         tokens->push_back(currentTok());
-
-      if (!commandFollows()) {
-         advanceNoSkip();
-         continue;
+      if (isEnd || isElse) {
+         return isElse;
       }
 
-      advance();
-
-      if (currentTok().isIdentifier("end")) {
-         if (tokens && openEnds > 1)
-            tokens->push_back(currentTok());
+      advanceNoSkip();
+   }
 
-         advance();
-         if (--openEnds == 0) {
-            break;
-         }
-      }
-      else if (currentTok().is(tok::tblgen_if)
-      || currentTok().isIdentifier("for_each")
-      || currentTok().isIdentifier("for_each_record")
-      || currentTok().isIdentifier("for_each_join")
-      || currentTok().isIdentifier("define")) {
-         ++openEnds;
-      }
+   if (!currentText.empty()) {
+      appendTokens(ops, false);
    }
 
-   // Remove the '<%' from '<% end'
-   if (tokens && !tokens->empty() && tokens->back().is(tok::op_ident))
-      tokens->pop_back();
+   return false;
 }
 
 bool TemplateParser::commandFollows()
@@ -180,7 +190,8 @@ static bool isParameterlessCommand(const IdentifierInfo *ident)
       || ident->isStr("define");
 }
 
-void TemplateParser::handleTemplateExpr(bool *isEnd, bool *isElse)
+void TemplateParser::compileCommand(OpList &ops, BlockKind kind,
+                                    bool *isEnd, bool *isElse)
 {
    auto openParenLoc = currentTok().getSourceLoc();
    assert(currentTok().is(tok::op_ident));
@@ -194,33 +205,132 @@ void TemplateParser::handleTemplateExpr(bool *isEnd, bool *isElse)
                     && (peek().is(tok::op_or)
                     || isParameterlessCommand(currentTok().getIdentifierInfo()));
 
-   const Value *result = nullptr;
-   bool explicitStr = false;
+   if (!isCommand) {
+      TemplateOp op(TemplateOp::Expr, paste, openParenLoc);
+      collectCommandTokens(op);
+      analyzeCommand(op, 0);
 
-   if (isCommand) {
-      result = handleCommand(paste, explicitStr, isEnd, isElse);
+      ops.push_back(std::move(op));
+      return;
+   }
+
+   const IdentifierInfo *cmd;
+   if (currentTok().is(tok::tblgen_if)) {
+      cmd = &TG.getIdents().get("if");
    }
    else {
-      result = parseExpr();
-      advance();
+      cmd = currentTok().getIdentifierInfo();
    }
 
-   if (paste) {
-      if (!result) {
+   if (cmd->isStr("if")
+   || cmd->isStr("for_each")
+   || cmd->isStr("for_each_record")
+   || cmd->isStr("for_each_join")) {
+      TemplateOp op(cmd->isStr("if") ? TemplateOp::If : TemplateOp::ForEach,
+                    paste, openParenLoc);
+
+      compileBlockCommand(op);
+      ops.push_back(std::move(op));
+
+      return;
+   }
+
+   if (cmd->isStr("define")) {
+      TemplateOp op(TemplateOp::Define, paste, openParenLoc);
+
+      compileDefine(op);
+      ops.push_back(std::move(op));
+
+      return;
+   }
+
+   if (cmd->isStr("invoke")) {
+      TemplateOp op(TemplateOp::Invoke, paste, openParenLoc);
+      collectCommandTokens(op);
+
+      // Remember the macro name for the timers, the tokens start with
+      // 'invoke'.
+      size_t nameIdx = findCommandToken(op, tok::ident, 1);
+      if (nameIdx != op.tokens.size())
+         op.text = string(op.tokens[nameIdx].getIdentifier());
+
+      if (paste) {
          TG.Diags.Diag(warn_generic_warn)
             << "expression does not produce code to paste"
             << openParenLoc;
       }
+
+      ops.push_back(std::move(op));
+      return;
+   }
+
+   if (cmd->isStr("end") || cmd->isStr("else")) {
+      advance();
+
+      bool *found = cmd->isStr("end") ? isEnd : isElse;
+      if (found == nullptr) {
+         TG.Diags.Diag(err_generic_error)
+            << "command '" + cmd->getIdentifier() + "' is not allowed here"
+            << lex.getSourceLoc();
+      }
       else {
-         if (!explicitStr && isa<StringLiteral>(result)) {
-            *ActiveOS << cast<StringLiteral>(result)->getVal();
-         }
-         else {
-            *ActiveOS << result;
-         }
+         *found = true;
+      }
+
+      if (paste) {
+         TG.Diags.Diag(warn_generic_warn)
+            << "expression does not produce code to paste"
+            << openParenLoc;
       }
+
+      checkCommandEnd(paste);
+      return;
+   }
+
+   // A command that produces a value, like 'str'.
+   TemplateOp op(TemplateOp::Expr, paste, openParenLoc);
+   collectCommandTokens(op);
+
+   if (cmd->isStr("str")
+   || cmd->isStr("record_name")
+   || cmd->isStr("case_name")
+   || cmd->isStr("case_value")) {
+      op.command = cmd;
+   }
+
+   analyzeCommand(op, findCommandToken(op, tok::op_or) + 1);
+   ops.push_back(std::move(op));
+}
+
+void TemplateParser::collectCommandTokens(TemplateOp &op)
+{
+   size_t begin = commandTokens.size();
+   while (!currentTok().is(tok::eof)) {
+      commandTokens.push_back(currentTok());
+
+      if (currentTok().isIdentifier("%>") || currentTok().isIdentifier("%%>"))
+         break;
+
+      advanceNoSkip();
+   }
+
+   op.tokens = TokenRange(commandTokens, begin, commandTokens.size());
+   checkCommandEnd(op.paste);
+}
+
+size_t TemplateParser::findCommandToken(const TemplateOp &op,
+                                        tok::TokenType kind,
+                                        size_t begin) {
+   for (size_t i = begin; i < op.tokens.size(); ++i) {
+      if (op.tokens.getKind(i) == kind)
+         return i;
    }
 
+   return op.tokens.size();
+}
+
+void TemplateParser::checkCommandEnd(bool paste)
+{
    if ((paste && !currentTok().isIdentifier("%%>")) || (!paste && !currentTok().isIdentifier("%>"))) {
       TG.Diags.Diag(err_generic_error)
          << "unexpected token " + currentTok().toString() + ", expecting '%>'"
@@ -230,6 +340,393 @@ void TemplateParser::handleTemplateExpr(bool *isEnd, bool *isElse)
    }
 }
 
+void TemplateParser::compileBlockCommand(TemplateOp &op)
+{
+   collectCommandTokens(op);
+
+   if (op.kind == TemplateOp::If) {
+      analyzeCommand(op, findCommandToken(op, tok::op_or) + 1);
+   }
+   else {
+      analyzeCommand(op, op.tokens.size());
+   }
+
+   advanceNoSkip();
+
+   if (op.kind == TemplateOp::If) {
+      bool foundElse = compileBlock(op.body, BlockKind::IfBody);
+      if (foundElse) {
+         advanceNoSkip();
+         compileBlock(op.elseBody, BlockKind::Body);
+      }
+   }
+   else {
+      compileBlock(op.body, BlockKind::Body);
+   }
+
+   if (op.paste) {
+      TG.Diags.Diag(warn_generic_warn)
+         << "expression does not produce code to paste"
+         << op.loc;
+   }
+
+   checkCommandEnd(op.paste);
+}
+
+void TemplateParser::compileDefine(TemplateOp &op)
+{
+   if (!peek().is(tok::ident)) {
+      TG.Diags.Diag(err_generic_error)
+         << "unexpected token " + peek().toString() + ", expecting macro name"
+         << lex.getSourceLoc();
+
+      abortBP();
+   }
+
+   advance();
+   op.text = string(currentTok().getIdentifier());
+
+   if (peek().is(tok::open_paren)) {
+      advance();
+      advance();
+
+      while (!currentTok().is(tok::close_paren)) {
+         if (!currentTok().is(tok::ident)) {
+            TG.Diags.Diag(err_generic_error)
+               << "unexpected token " + currentTok().toString() + ", expecting parameter name"
+               << lex.getSourceLoc();
+
+            abortBP();
+         }
+
+         op.params.emplace_back(currentTok().getIdentifier());
+
+         advance();
+         if (currentTok().is(tok::comma))
+            advance();
+      }
+   }
+
+   if ((op.paste && !peek().isIdentifier("%%>")) || (!op.paste && !peek().isIdentifier("%>"))) {
+      TG.Diags.Diag(err_generic_error)
+         << "unexpected token " + currentTok().toString() + ", expecting '%>'"
+         << lex.getSourceLoc();
+
+      abortBP();
+   }
+
+   advance();
+   advanceNoSkip();
+
+   compileBlock(op.body, BlockKind::Macro);
+
+   if (op.paste) {
+      TG.Diags.Diag(warn_generic_warn)
+         << "expression does not produce code to paste"
+         << op.loc;
+   }
+
+   checkCommandEnd(op.paste);
+}
+
+void TemplateParser::analyzeCommand(TemplateOp &op, size_t exprBegin)
+{
+   op.isConstant = findCommandToken(op, tok::dollar) == op.tokens.size();
+
+   // Recognize expressions of the form $(X).a.b, which are evaluated without
+   // parsing them.
+   std::vector<Token> toks;
+   for (size_t i = exprBegin; i < op.tokens.size(); ++i) {
+      Token tok = op.tokens[i];
+      if (!tok.isWhitespace())
+         toks.push_back(tok);
+   }
+
+   if (toks.size() < 5
+   || !toks[0].is(tok::dollar)
+   || !toks[1].is(tok::open_paren)
+   || !toks[2].is(tok::ident)
+   || !toks[3].is(tok::close_paren)) {
+      return;
+   }
+
+   std::vector<FieldRef> fieldPath;
+
+   size_t i = 4;
+   for (; i + 1 < toks.size() && toks[i].is(tok::period); i += 2) {
+      if (!toks[i + 1].is(tok::ident))
+         return;
+
+      fieldPath.emplace_back(toks[i + 1].getIdentifier());
+   }
+
+   // Only the closing '%>' may follow.
+   if (i != toks.size() - 1)
+      return;
+
+   op.varName = string(toks[2].getIdentifier());
+   op.fieldPath = std::move(fieldPath);
+}
+
+void TemplateParser::execute(const OpList &ops)
+{
+   for (auto &op : ops) {
+      switch (op.kind) {
+      case TemplateOp::Text:
+         *ActiveOS << op.text;
+         break;
+      case TemplateOp::Expr: {
+         TimeRegion Timer("Template", "expr");
+         executeExpr(op);
+         break;
+      }
+      case TemplateOp::If: {
+         TimeRegion Timer("Template", "if");
+         executeIf(op);
+         break;
+      }
+      case TemplateOp::ForEach: {
+         TimeRegion Timer("Template", "foreach");
+         executeForeach(op);
+         break;
+      }
+      case TemplateOp::Define: {
+         // A redefinition replaces a macro of the same invocation.
+         auto it = std::find_if(macros.begin() + macroScopeBegin, macros.end(),
+                                [&](const std::pair<std::string_view, const TemplateOp*> &M) {
+                                   return M.first == op.text;
+                                });
+
+         if (it != macros.end()) {
+            it->second = &op;
+         }
+         else {
+            macros.emplace_back(op.text, &op);
+         }
+
+         break;
+      }
+      case TemplateOp::Invoke: {
+         TimeRegion Timer("Template", "invoke", op.text);
+         executeInvoke(op);
+         break;
+      }
+      }
+   }
+}
+
+void TemplateParser::resetTo(const TemplateOp &op)
+{
+   lex.reset(op.tokens);
+
+   if (currentTok().isWhitespace()) {
+      advance();
+   }
+}
+
+Value *TemplateParser::evaluatePath(const TemplateOp &op)
+{
+   auto it = ForEachVals.find(op.varName);
+   if (it == ForEachVals.end())
+      return nullptr;
+
+   Value *V = it->second;
+   for (auto &F : op.fieldPath) {
+      auto *RV = dyn_cast<RecordVal>(V);
+      if (!RV)
+         return nullptr;
+
+      auto *R = RV->getRecord();
+      auto *Layout = R->getLayout();
+
+      // Records of the same classes share a layout, so the slot found for
+      // the last record is usually right for this one too.
+      if (Layout && Layout != F.layout) {
+         if (auto slot = Layout->getSlot(F.name)) {
+            F.layout = Layout;
+            F.slot = slot.getValue();
+         }
+      }
+
+      if (Layout && Layout == F.layout) {
+         V = R->getFieldValueBySlot(F.slot);
+      }
+      else {
+         V = R->getFieldValue(F.name);
+      }
+
+      if (!V)
+         return nullptr;
+   }
+
+   return V;
+}
+
+void TemplateParser::pasteResult(const TemplateOp &op, const Value *result,
+                                 bool explicitStr) {
+   if (!op.paste)
+      return;
+
+   if (!result) {
+      TG.Diags.Diag(warn_generic_warn)
+         << "expression does not produce code to paste"
+         << op.loc;
+   }
+   else {
+      if (!explicitStr && isa<StringLiteral>(result)) {
+         *ActiveOS << cast<StringLiteral>(result)->getVal();
+      }
+      else {
+         *ActiveOS << result;
+      }
+   }
+}
+
+void TemplateParser::executeExpr(const TemplateOp &op)
+{
+   const Value *result = op.cachedValue;
+   bool explicitStr = op.cachedExplicitStr;
+
+   if (!result) {
+      if (!op.varName.empty()) {
+         if (auto *V = evaluatePath(op)) {
+            if (op.command) {
+               std::vector<Value*> args{ V };
+               result = applyCommand(op.command, args, op.loc, explicitStr);
+            }
+            else {
+               result = V;
+            }
+         }
+      }
+
+      // Anything else is evaluated by parsing the command.
+      if (!result) {
+         resetTo(op);
+         result = handleTemplateExpr(op.paste, explicitStr);
+      }
+
+      if (op.isConstant) {
+         op.cachedValue = result;
+         op.cachedExplicitStr = explicitStr;
+      }
+   }
+
+   pasteResult(op, result, explicitStr);
+}
+
+void TemplateParser::executeIf(const TemplateOp &op)
+{
+   const Value *cond = op.cachedValue;
+
+   if (!cond && !op.varName.empty()) {
+      cond = evaluatePath(op);
+
+      if (cond && (!isa<IntegerLiteral>(cond)
+            || !isa<IntType>(cond->getType())
+            || cast<IntType>(cond->getType())->getBitWidth() != 1)) {
+         cond = nullptr;
+      }
+   }
+
+   if (!cond) {
+      resetTo(op);
+      cond = handleIf(op.paste);
+
+      if (op.isConstant) {
+         op.cachedValue = cond;
+      }
+   }
+
+   if (cast<IntegerLiteral>(cond)->getVal() > 0) {
+      execute(op.body);
+   }
+   else {
+      execute(op.elseBody);
+   }
+}
+
+void TemplateParser::executeForeach(const TemplateOp &op)
+{
+   std::unique_ptr<ForEachHeader> header;
+   const ForEachHeader *H = op.cachedHeader.get();
+
+   if (!H) {
+      header = std::make_unique<ForEachHeader>();
+
+      resetTo(op);
+      handleForeach(op.paste, *header);
+
+      H = header.get();
+      if (op.isConstant) {
+         op.cachedHeader = std::move(header);
+      }
+   }
+
+   ValueBinding var(ForEachVals, H->varName);
+   ValueBinding index(ForEachVals, H->indexName);
+
+   uint64_t i = 0;
+   for (auto *V : H->values) {
+      if (H->join && i != 0) {
+         *ActiveOS << cast<StringLiteral>(H->separator)->getVal();
+      }
+
+      var.set(V);
+
+      if (!H->indexName.empty()) {
+         index.set(TG.getIntegerLiteral(TG.getInt64Ty(), i));
+      }
+
+      execute(op.body);
+      ++i;
+   }
+}
+
+void TemplateParser::executeInvoke(const TemplateOp &op)
+{
+   resetTo(op);
+
+   std::vector<Value*> args;
+   auto *macro = handleInvoke(op.paste, args);
+
+   // A macro only sees its own parameters.
+   std::unordered_map<std::string, Value*> vals;
+   for (int i = 0; i < macro->params.size(); ++i)
+   {
+      vals[macro->params[i]] = args[i];
+   }
+
+   std::swap(ForEachVals, vals);
+
+   // Macros defined by the invoked macro go out of scope when it returns.
+   auto prevScopeBegin = macroScopeBegin;
+   macroScopeBegin = macros.size();
+
+   execute(macro->body);
+
+   macros.resize(macroScopeBegin);
+   macroScopeBegin = prevScopeBegin;
+
+   std::swap(ForEachVals, vals);
+}
+
+const Value *TemplateParser::handleTemplateExpr(bool paste, bool &explicitStr)
+{
+   const Value *result = nullptr;
+
+   if (currentTok().is(tok::ident) && peek().is(tok::op_or)) {
+      result = handleCommand(explicitStr);
+   }
+   else {
+      result = parseExpr();
+      advance();
+   }
+
+   checkCommandEnd(paste);
+   return result;
+}
+
 #define EXPECT_NUM_ARGS(ArgCnt)                                           \
    if (args.size() != ArgCnt) { TG.Diags.Diag(err_generic_error)          \
       << "function " + func + " expects " + std::to_string(ArgCnt)        \
@@ -246,37 +743,11 @@ void TemplateParser::handleTemplateExpr(bool *isEnd, bool *isElse)
       << "function " + func + " expects arg #" + std::to_string(ArgNo)  \
          + " to be a " #ValKind; abortBP(); }
 
-Value* TemplateParser::handleCommand(bool paste, bool &explicitStr,
-                                     bool *isEnd, bool *isElse)
+Value* TemplateParser::handleCommand(bool &explicitStr)
 {
-   const IdentifierInfo *cmd;
-   if (currentTok().is(tok::tblgen_if)) {
-      cmd = &TG.getIdents().get("if");
-   }
-   else {
-      cmd = currentTok().getIdentifierInfo();
-   }
-
+   const IdentifierInfo *cmd = currentTok().getIdentifierInfo();
    auto parenLoc = currentTok().getSourceLoc();
 
-   if (cmd->isStr("for_each")
-   || cmd->isStr("for_each_record")
-   || cmd->isStr("for_each_join")) {
-      return handleForeach(paste);
-   }
-
-   if (cmd->isStr("if")) {
-      return handleIf(paste);
-   }
-
-   if (cmd->isStr("define")) {
-      return handleDefine(paste);
-   }
-
-   if (cmd->isStr("invoke")) {
-      return handleInvoke(paste);
-   }
-
    std::vector<Value*> args;
    if (peek().is(tok::op_or)) {
       advance();
@@ -297,34 +768,16 @@ Value* TemplateParser::handleCommand(bool paste, bool &explicitStr,
       }
    }
 
-   const std::string &func = cmd->getIdentifier();
    advance();
+   return applyCommand(cmd, args, parenLoc, explicitStr);
+}
 
-   if (cmd->isStr("end")) {
-      if (isEnd == nullptr) {
-         TG.Diags.Diag(err_generic_error)
-            << "command 'end' is not allowed here"
-            << lex.getSourceLoc();
-      }
-      else {
-         *isEnd = true;
-      }
-
-      return nullptr;
-   }
-
-   if (cmd->isStr("else")) {
-      if (isElse == nullptr) {
-         TG.Diags.Diag(err_generic_error)
-            << "command 'else' is not allowed here"
-            << lex.getSourceLoc();
-      }
-      else {
-         *isElse = true;
-      }
-
-      return nullptr;
-   }
+Value* TemplateParser::applyCommand(const IdentifierInfo *cmd,
+                                    std::vector<Value*> &args,
+                                    SourceLocation parenLoc,
+                                    bool &explicitStr) {
+   const std::string &func = cmd->getIdentifier();
+   TimeRegion Timer("Template command", func);
 
    if (cmd->isStr("str")) {
       EXPECT_NUM_ARGS(1)
@@ -338,7 +791,7 @@ Value* TemplateParser::handleCommand(bool paste, bool &explicitStr,
       std::ostringstream str;
       str << args.front();
 
-      return new(TG) StringLiteral(TG.getStringTy(), str.str());
+      return TG.getStringLiteral(TG.getStringTy(), str.str());
    }
 
    if (cmd->isStr("record_name")) {
@@ -363,7 +816,7 @@ Value* TemplateParser::handleCommand(bool paste, bool &explicitStr,
       EXPECT_NUM_ARGS(1)
       EXPECT_ARG_VALUE(0, EnumVal)
 
-      return new(TG) IntegerLiteral(
+      return TG.getIntegerLiteral(
          TG.getInt64Ty(),
          cast<EnumVal>(args.front())->getCase()->caseValue);
    }
@@ -406,40 +859,10 @@ Value* TemplateParser::handleIf(bool paste)
       abortBP();
    }
 
-   advance();
-   advanceNoSkip();
-
-   bool foundElse = false;
-   bool condIsTrue = cast<IntegerLiteral>(cond)->getVal() > 0;
-
-   if (!condIsTrue) {
-      std::ostringstream discard;
-
-      auto SAR = support::saveAndRestore(ActiveOS, &discard);
-      parseUntilEnd(&foundElse);
-   }
-   else {
-      parseUntilEnd(&foundElse);
-   }
-
-   if (foundElse)
-   {
-      advanceNoSkip();
-
-      if (!condIsTrue) {
-         parseUntilEnd();
-      }
-      else {
-         std::ostringstream discard;
-         auto SAR = support::saveAndRestore(ActiveOS, &discard);
-         parseUntilEnd();
-      }
-   }
-
-   return nullptr;
+   return cond;
 }
 
-Value* TemplateParser::handleForeach(bool paste)
+void TemplateParser::handleForeach(bool paste, ForEachHeader &header)
 {
    enum class ForEachType {
       Normal,
@@ -472,7 +895,7 @@ Value* TemplateParser::handleForeach(bool paste)
    bool force = true;
 
    auto *iterator = parseExpr();
-   std::vector<Value*> values;
+   std::vector<Value*> &values = header.values;
 
    if (type == ForEachType::Record) {
       if (!isa<StringLiteral>(iterator)) {
@@ -485,11 +908,38 @@ Value* TemplateParser::handleForeach(bool paste)
          }
       }
 
-      std::vector<Record*> records;
-      RK->getAllDefinitionsOf(cast<StringLiteral>(iterator)->getVal(), records);
+      if (peek().isIdentifier("where")
+      || peek().isIdentifier("sort_by")
+      || peek().isIdentifier("group_by")) {
+         if (!isa<StringLiteral>(iterator)) {
+            TG.Diags.Diag(err_generic_error)
+               << "for_each_record expects a string literal"
+               << lex.getSourceLoc();
+
+            abortBP();
+         }
+
+         auto &className = cast<StringLiteral>(iterator)->getVal();
+         auto *C = RK->lookupClass(className);
+
+         if (!C) {
+            TG.Diags.Diag(err_generic_error)
+               << "class " + className + " does not exist"
+               << lex.getSourceLoc();
+
+            abortBP();
+         }
+
+         parseRecordQuery(C, values);
+      }
+      else {
+         std::vector<Record*> records;
+         RK->getAllDefinitionsOf(cast<StringLiteral>(iterator)->getVal(),
+                                 records);
 
-      for (auto *R : records) {
-         values.push_back(new(TG) RecordVal(TG.getRecordType(R), R));
+         for (auto *R : records) {
+            values.push_back(new(TG) RecordVal(TG.getRecordType(R), R));
+         }
       }
    }
    else {
@@ -498,7 +948,7 @@ Value* TemplateParser::handleForeach(bool paste)
             TG.Diags.Diag(err_generic_error)
                << "for_each expects an iterator of list type"
                << lex.getSourceLoc();
-               
+
             abortBP();
          }
          else {
@@ -529,12 +979,12 @@ Value* TemplateParser::handleForeach(bool paste)
    }
 
    advance();
-   auto *ident = currentTok().getIdentifierInfo();
+   header.varName = string(currentTok().getIdentifier());
 
-   Value *separator = nullptr;
    if (type == ForEachType::Join) {
+      Value *separator;
       if (!peek().is(tok::comma)) {
-         separator = new(TG) StringLiteral(TG.getStringTy(), ", ");
+         separator = TG.getStringLiteral(TG.getStringTy(), ", ");
       }
       else {
          advance();
@@ -550,9 +1000,11 @@ Value* TemplateParser::handleForeach(bool paste)
 
          abortBP();
       }
+
+      header.join = true;
+      header.separator = separator;
    }
 
-   IdentifierInfo *iterName = nullptr;
    if (peek().is(tok::comma)) {
       advance();
 
@@ -565,7 +1017,7 @@ Value* TemplateParser::handleForeach(bool paste)
       }
 
       advance();
-      iterName = currentTok().getIdentifierInfo();
+      header.indexName = string(currentTok().getIdentifier());
    }
 
    if ((paste && !peek().isIdentifier("%%>")) || (!paste && !peek().isIdentifier("%>"))) {
@@ -575,94 +1027,141 @@ Value* TemplateParser::handleForeach(bool paste)
 
       abortBP();
    }
+}
 
-   advance();
-   advanceNoSkip();
+void TemplateParser::parseRecordQuery(Class *C, std::vector<Value*> &values)
+{
+   std::vector<unsigned> positions;
+   bool filtered = false;
 
-   int i = 0;
-   for (auto *V : values) {
-      if (type == ForEachType::Join) {
-         if (i != 0) {
-            OS << cast<StringLiteral>(separator)->getVal();
-         }
+   if (peek().isIdentifier("where")) {
+      advance();
+      parseWhereClause(C, positions);
+      filtered = true;
+   }
+
+   bool group = peek().isIdentifier("group_by");
+   if (group || peek().isIdentifier("sort_by")) {
+      advance();
+
+      if (!peek().is(tok::ident)) {
+         TG.Diags.Diag(err_generic_error)
+            << "unexpected token " + currentTok().toString()
+               + ", expecting field name"
+            << lex.getSourceLoc();
+
+         abortBP();
       }
 
-      Lexer::LookaheadRAII LR(lex);
+      advance();
 
-      auto SAR = support::saveAndRestore(this->LR, &LR);
-      ForEachScope scope(*this, ident->getIdentifier(), V);
+      string fieldName(currentTok().getIdentifier());
+      auto &Index = getRecordIndex(C, fieldName, currentTok().getSourceLoc(),
+                                   true);
 
-      if (iterName != nullptr) {
-         ForEachVals[iterName->getIdentifier()] =
-            new(TG) IntegerLiteral(TG.getInt64Ty(), (uint64_t)i);
+      if (filtered) {
+         Index.sortPositions(positions);
+      }
+      else {
+         positions = Index.getOrder();
       }
 
-      parseUntilEnd();
-      ++i;
-   }
+      // A group is represented by its value, its records can be visited
+      // with a where clause on the same field.
+      if (group) {
+         for (size_t i = 0; i < positions.size(); ++i) {
+            // Records without a value are ordered last.
+            auto *Val = Index.getValue(positions[i]);
+            if (!Val)
+               break;
 
-   if (iterName != nullptr && !values.empty()) {
-      ForEachVals.erase(ForEachVals.find(iterName->getIdentifier()));
+            if (i != 0 && Index.equalValues(positions[i - 1], positions[i]))
+               continue;
+
+            values.push_back(Val);
+         }
+
+         return;
+      }
    }
 
-   skipUntilEnd();
-   return nullptr;
+   auto &definitions = RK->getDefinitionsOf(C);
+   for (unsigned i : positions) {
+      values.push_back(new(TG) RecordVal(TG.getRecordType(definitions[i]),
+                                         definitions[i]));
+   }
 }
 
-Value* TemplateParser::handleDefine(bool paste)
+void TemplateParser::parseWhereClause(Class *C, std::vector<unsigned> &positions)
 {
-   if (!peek().is(tok::ident)) {
-      TG.Diags.Diag(err_generic_error)
-         << "unexpected token " + peek().toString() + ", expecting macro name"
-         << lex.getSourceLoc();
+   std::vector<unsigned> matches;
+   std::vector<unsigned> intersection;
+   bool first = true;
 
-      abortBP();
-   }
+   while (true) {
+      if (!peek().is(tok::ident)) {
+         TG.Diags.Diag(err_generic_error)
+            << "unexpected token " + currentTok().toString()
+               + ", expecting field name"
+            << lex.getSourceLoc();
 
-   advance();
+         abortBP();
+      }
 
-   Macro macro;
-   std::string name(currentTok().getIdentifier());
+      advance();
+
+      string fieldName(currentTok().getIdentifier());
+      auto fieldLoc = currentTok().getSourceLoc();
+
+      RecordIndex::Predicate Pred;
+      switch (peek().getKind()) {
+      case tok::double_equals: Pred = RecordIndex::Eq; break;
+      case tok::exclaim_equals: Pred = RecordIndex::Ne; break;
+      case tok::smaller: Pred = RecordIndex::Lt; break;
+      case tok::smaller_equals: Pred = RecordIndex::Le; break;
+      case tok::greater: Pred = RecordIndex::Gt; break;
+      case tok::greater_equals: Pred = RecordIndex::Ge; break;
+      default:
+         TG.Diags.Diag(err_generic_error)
+            << "unexpected token " + currentTok().toString()
+               + ", expecting comparison operator"
+            << lex.getSourceLoc();
+
+         abortBP();
+      }
 
-   if (peek().is(tok::open_paren)) {
       advance();
       advance();
 
-      while (!currentTok().is(tok::close_paren)) {
-         if (!currentTok().is(tok::ident)) {
-            TG.Diags.Diag(err_generic_error)
-               << "unexpected token " + currentTok().toString() + ", expecting parameter name"
-               << lex.getSourceLoc();
+      // The field type makes enum cases like '.Bird' possible.
+      auto *Val = parseExpr(getQueryFieldType(C, fieldName));
 
-            abortBP();
-         }
+      matches.clear();
+      queryRecords(C, fieldName, Pred, Val, fieldLoc, matches);
 
-         macro.params.emplace_back(currentTok().getIdentifier());
+      if (first) {
+         positions.swap(matches);
+         first = false;
+      }
+      else {
+         // Both are in declaration order.
+         intersection.clear();
+         std::set_intersection(positions.begin(), positions.end(),
+                               matches.begin(), matches.end(),
+                               std::back_inserter(intersection));
 
-         advance();
-         if (currentTok().is(tok::comma))
-            advance();
+         positions.swap(intersection);
       }
-   }
 
-   if ((paste && !peek().isIdentifier("%%>")) || (!paste && !peek().isIdentifier("%>"))) {
-      TG.Diags.Diag(err_generic_error)
-         << "unexpected token " + currentTok().toString() + ", expecting '%>'"
-         << lex.getSourceLoc();
+      if (!peek().is(tok::logical_and))
+         break;
 
-      abortBP();
+      advance();
    }
-
-   advance();
-   advanceNoSkip();
-
-   skipUntilEnd(&macro.tokens);
-   macros[name] = macro;
-
-   return nullptr;
 }
 
-Value* TemplateParser::handleInvoke(bool paste)
+const TemplateParser::TemplateOp*
+TemplateParser::handleInvoke(bool paste, std::vector<Value*> &args)
 {
    if (!peek().is(tok::ident)) {
       TG.Diags.Diag(err_generic_error)
@@ -675,7 +1174,12 @@ Value* TemplateParser::handleInvoke(bool paste)
    advance();
    std::string name(currentTok().getIdentifier());
 
-   if (macros.find(name) == macros.end())
+   auto it = std::find_if(macros.rbegin(), macros.rend(),
+                          [&](const std::pair<std::string_view, const TemplateOp*> &M) {
+                             return M.first == name;
+                          });
+
+   if (it == macros.rend())
    {
       TG.Diags.Diag(err_generic_error)
          << "macro " + name + " is not defined"
@@ -684,8 +1188,7 @@ Value* TemplateParser::handleInvoke(bool paste)
       abortBP();
    }
 
-   auto &macro = macros[name];
-   std::vector<Value*> args;
+   auto &macro = *it->second;
 
    if (peek().is(tok::open_paren)) {
       advance();
@@ -718,20 +1221,7 @@ Value* TemplateParser::handleInvoke(bool paste)
       abortBP();
    }
 
-   advance();
-
-   TemplateParser parser(TG, macro.tokens, this->lex.getSourceId(), this->lex.getOffset(), macros);
-   for (int i = 0; i < macro.params.size(); ++i)
-   {
-      parser.ForEachVals[macro.params[i]] = args[i];
-   }
-
-   if (parser.parseTemplate())
-   {
-      *ActiveOS << parser.getResult();
-   }
-
-   return nullptr;
+   return &macro;
 }
 
-} // namespace tblgen
\ No newline at end of file
+} // namespace tblgen